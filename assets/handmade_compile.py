@@ -15,6 +15,8 @@ for file in files:
 		compile(file, f"{output_file}_vert.spv")
 	if file.endswith('.frag'):
 		compile(file, f"{output_file}_frag.spv")
+	if file.endswith('.comp'):
+		compile(file, f"{output_file}_comp.spv")
 
 
 
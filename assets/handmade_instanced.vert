@@ -0,0 +1,14 @@
+#version 450
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec4 iTransform;
+layout (location = 3) in vec3 iColor;
+layout (location = 0) out vec3 passedColor;
+invariant gl_Position;
+
+void main() {
+	
+	// xyz is the translation, w a uniform scale
+	gl_Position = vec4(aPosition * iTransform.w + iTransform.xyz, 1.0f);
+	passedColor = aColor * iColor;
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #version 450 core
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aColor;
+invariant gl_Position;
 
 void main() {
 
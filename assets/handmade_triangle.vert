@@ -2,6 +2,7 @@
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aColor;
 layout (location = 0) out vec3 passedColor;
+invariant gl_Position;
 
 void main() {
 	
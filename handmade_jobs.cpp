@@ -0,0 +1,338 @@
+#include "handmade_jobs.h"
+
+namespace handmade {
+	
+	// Idle rounds a worker spins, then yields, before it goes to sleep
+	static const u32 JobSpinCount = 64;
+	static const u32 JobYieldCount = 256;
+	
+	static thread_local JobWorker* JobCurrentWorker = nullptr;
+	
+	static bool JobDequePush(JobDeque* deque, Job* job) {
+		
+		u64 bottom = PlatformAtomicLoad64(&deque->Bottom);
+		u64 top = PlatformAtomicLoad64(&deque->Top);
+		if (bottom - top > deque->Mask) {
+			
+			return false;
+		}
+		
+		deque->Slots[bottom & deque->Mask] = *job;
+		PlatformAtomicStore64(&deque->Bottom, bottom + 1);
+		
+		return true;
+	}
+	
+	static bool JobDequePop(JobDeque* deque, Job* job) {
+		
+		u64 bottom = PlatformAtomicLoad64(&deque->Bottom) - 1;
+		PlatformAtomicStore64(&deque->Bottom, bottom);
+		u64 top = PlatformAtomicLoad64(&deque->Top);
+		
+		if ((i64)(bottom - top) < 0) {
+			
+			PlatformAtomicStore64(&deque->Bottom, bottom + 1);
+			return false;
+		}
+		
+		*job = deque->Slots[bottom & deque->Mask];
+		if (bottom != top) {
+			
+			return true;
+		}
+		
+		// The last job, thieves may be after it as well
+		bool taken = PlatformAtomicCompareExchange64(&deque->Top, top, top + 1);
+		PlatformAtomicStore64(&deque->Bottom, bottom + 1);
+		
+		return taken;
+	}
+	
+	// Fails when the deque is empty or another thief got there first
+	static bool JobDequeSteal(JobDeque* deque, Job* job) {
+		
+		u64 top = PlatformAtomicLoad64(&deque->Top);
+		u64 bottom = PlatformAtomicLoad64(&deque->Bottom);
+		if ((i64)(bottom - top) <= 0) {
+			
+			return false;
+		}
+		
+		// The slot may be overwritten as soon as Top moves on, the copy only counts if Top didn't
+		*job = deque->Slots[top & deque->Mask];
+		
+		return PlatformAtomicCompareExchange64(&deque->Top, top, top + 1);
+	}
+	
+	static bool JobSystemHasWork(JobSystem* system) {
+		
+		for (u32 i = 0; i < system->WorkerCount; i++) {
+			
+			JobDeque* deque = &(system->Workers + i)->Deque;
+			if ((i64)(PlatformAtomicLoad64(&deque->Bottom) - PlatformAtomicLoad64(&deque->Top)) > 0) {
+				
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	static void JobSystemWake(JobSystem* system) {
+		
+		if (PlatformAtomicLoad(&system->Sleeping) == 0) {
+			
+			return;
+		}
+		
+		PlatformMutexLock(&system->Mutex);
+		PlatformConditionSignal(&system->WorkAvailable);
+		PlatformMutexUnlock(&system->Mutex);
+	}
+	
+	// Sleeping is raised before the deques are checked and pushes check it after they publish a job,
+	// so either the sleeper sees the job or the pusher sees the sleeper
+	static void JobSystemSleep(JobSystem* system) {
+		
+		PlatformMutexLock(&system->Mutex);
+		PlatformAtomicAdd(&system->Sleeping, 1);
+		if (PlatformAtomicLoad(&system->Running) && !JobSystemHasWork(system)) {
+			
+			PlatformConditionWait(&system->WorkAvailable, &system->Mutex);
+		}
+		PlatformAtomicAdd(&system->Sleeping, (u32)-1);
+		PlatformMutexUnlock(&system->Mutex);
+	}
+	
+	static void JobPush(JobSystem* system, Job* job);
+	
+	static void JobExecute(JobSystem* system, Job* job) {
+		
+		while (job->End - job->First > job->BatchSize) {
+			
+			u32 batches = (job->End - job->First + job->BatchSize - 1) / job->BatchSize;
+			u32 middle = job->First + (batches / 2) * job->BatchSize;
+			
+			Job half = *job;
+			half.First = middle;
+			if (half.Counter) {
+				
+				PlatformAtomicAdd(&half.Counter->Value, 1);
+			}
+			JobPush(system, &half);
+			
+			job->End = middle;
+		}
+		
+		job->Proc(job->Data, job->First, job->End);
+		
+		if (job->Counter) {
+			
+			PlatformAtomicAdd(&job->Counter->Value, (u32)-1);
+		}
+	}
+	
+	static void JobPush(JobSystem* system, Job* job) {
+		
+		JobWorker* worker = JobCurrentWorker;
+		if (!worker || worker->System != system || !JobDequePush(&worker->Deque, job)) {
+			
+			JobExecute(system, job);
+			return;
+		}
+		
+		JobSystemWake(system);
+	}
+	
+	// Own jobs first, newest first, then the oldest job of someone else starting at a random worker
+	static bool JobFind(JobWorker* worker, Job* job) {
+		
+		if (JobDequePop(&worker->Deque, job)) {
+			
+			return true;
+		}
+		
+		JobSystem* system = worker->System;
+		worker->Random ^= worker->Random << 13;
+		worker->Random ^= worker->Random >> 17;
+		worker->Random ^= worker->Random << 5;
+		
+		u32 start = worker->Random % system->WorkerCount;
+		for (u32 i = 0; i < system->WorkerCount; i++) {
+			
+			u32 victim = (start + i) % system->WorkerCount;
+			if (victim != worker->Index && JobDequeSteal(&(system->Workers + victim)->Deque, job)) {
+				
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	static void JobWorkerLoop(void* data) {
+		
+		JobWorker* worker = (JobWorker*)data;
+		JobSystem* system = worker->System;
+		JobCurrentWorker = worker;
+		
+		u32 idle = 0;
+		while (PlatformAtomicLoad(&system->Running)) {
+			
+			Job job;
+			if (JobFind(worker, &job)) {
+				
+				JobExecute(system, &job);
+				idle = 0;
+			}
+			else if (++idle < JobSpinCount) {
+				
+				PlatformCpuRelax();
+			}
+			else if (idle < JobYieldCount) {
+				
+				PlatformYield();
+			}
+			else {
+				
+				JobSystemSleep(system);
+				idle = 0;
+			}
+		}
+		
+		JobCurrentWorker = nullptr;
+	}
+	
+	bool JobSystemInit(JobSystem* system, u32 threadCount) {
+		
+		threadCount = threadCount ? threadCount : PlatformGetProcessorCount();
+		threadCount = threadCount < JobMaxThreads ? threadCount : JobMaxThreads;
+		threadCount = threadCount > 1 ? threadCount : 1;
+		
+		// Threads[0] stays unused, worker 0 is the calling thread
+		system->WorkerCount = threadCount;
+		system->Workers = (JobWorker*)calloc(threadCount, sizeof(JobWorker));
+		system->Threads = (PlatformThread*)calloc(threadCount, sizeof(PlatformThread));
+		system->Sleeping = 0;
+		system->Running = 1;
+		
+		if (!system->Workers || !system->Threads) {
+			
+			return false;
+		}
+		
+		bool complete = PlatformMutexInit(&system->Mutex);
+		complete &= PlatformConditionInit(&system->WorkAvailable);
+		
+		for (u32 i = 0; i < threadCount; i++) {
+			
+			JobWorker* worker = (system->Workers + i);
+			worker->System = system;
+			worker->Index = i;
+			worker->Random = 0x9e3779b9u * (i + 1);
+			worker->Deque.Slots = (Job*)malloc(JobDequeCapacity * sizeof(Job));
+			worker->Deque.Mask = JobDequeCapacity - 1;
+			complete &= worker->Deque.Slots != nullptr;
+		}
+		JobCurrentWorker = system->Workers;
+		
+		for (u32 i = 1; complete && i < threadCount; i++) {
+			
+			complete &= PlatformThreadCreate(system->Threads + i, JobWorkerLoop, system->Workers + i);
+		}
+		
+		return complete;
+	}
+	
+	void JobSystemDestroy(JobSystem* system) {
+		
+		// Sleepers check Running under the mutex, none of them can miss the broadcast
+		PlatformAtomicStore(&system->Running, 0);
+		PlatformMutexLock(&system->Mutex);
+		PlatformConditionBroadcast(&system->WorkAvailable);
+		PlatformMutexUnlock(&system->Mutex);
+		
+		for (u32 i = 1; i < system->WorkerCount; i++) {
+			
+			PlatformThreadJoin(system->Threads + i);
+		}
+		
+		for (u32 i = 0; system->Workers && i < system->WorkerCount; i++) {
+			
+			free((system->Workers + i)->Deque.Slots);
+		}
+		
+		if (JobCurrentWorker && JobCurrentWorker->System == system) {
+			
+			JobCurrentWorker = nullptr;
+		}
+		
+		PlatformConditionDestroy(&system->WorkAvailable);
+		PlatformMutexDestroy(&system->Mutex);
+		free(system->Threads);
+		free(system->Workers);
+		system->Threads = nullptr;
+		system->Workers = nullptr;
+		system->WorkerCount = 0;
+	}
+	
+	void JobSystemAttach(JobSystem* system) {
+		
+		JobCurrentWorker = system->Workers;
+	}
+	
+	void JobSystemRun(JobSystem* system, JobProc proc, void* data, JobCounter* counter) {
+		
+		JobSystemParallelFor(system, proc, data, 1, 1, counter);
+	}
+	
+	void JobSystemParallelFor(JobSystem* system, JobProc proc, void* data, u32 count, u32 batchSize, JobCounter* counter) {
+		
+		if (count == 0) {
+			
+			return;
+		}
+		
+		Job job{};
+		job.Proc = proc;
+		job.Data = data;
+		job.First = 0;
+		job.End = count;
+		job.BatchSize = batchSize ? batchSize : 1;
+		job.Counter = counter;
+		
+		if (counter) {
+			
+			PlatformAtomicAdd(&counter->Value, 1);
+		}
+		JobPush(system, &job);
+	}
+	
+	void JobSystemWait(JobSystem* system, JobCounter* counter) {
+		
+		JobWorker* worker = JobCurrentWorker;
+		if (worker && worker->System != system) {
+			
+			worker = nullptr;
+		}
+		
+		u32 idle = 0;
+		while (PlatformAtomicLoad(&counter->Value) != 0) {
+			
+			Job job;
+			if (worker && JobFind(worker, &job)) {
+				
+				JobExecute(system, &job);
+				idle = 0;
+			}
+			else if (++idle < JobSpinCount) {
+				
+				PlatformCpuRelax();
+			}
+			else {
+				
+				PlatformYield();
+			}
+		}
+	}
+}
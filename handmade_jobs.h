@@ -0,0 +1,91 @@
+#ifndef HANDMADE_JOBS_H
+#define HANDMADE_JOBS_H
+
+#include "handmade_types.h"
+#include "handmade_platform.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace handmade {
+	
+	static const u32 JobMaxThreads = 64;
+	// Per worker, a job pushed onto a full deque runs right away on the pushing thread
+	static const u32 JobDequeCapacity = 4096;
+	
+	// Every job covers the work items [first, end), a single job is the range [0, 1)
+	typedef void (*JobProc)(void* data, u32 first, u32 end);
+	
+	// Counts the jobs started with it that haven't finished yet, zero initialized it can be reused once it is back at 0
+	struct JobCounter {
+		
+		volatile u32 Value;
+	};
+	
+	// Ranges larger than BatchSize are split in halves, one half is pushed for someone to steal and the rest runs on
+	struct Job {
+		
+		JobProc Proc;
+		void* Data;
+		u32 First;
+		u32 End;
+		u32 BatchSize;
+		JobCounter* Counter;
+	};
+	
+	struct JobSystem;
+	
+	// Chase-Lev deque, only its worker pushes and pops at Bottom, every other worker steals at Top.
+	// The indices only grow, Slots is indexed with them masked.
+	struct JobDeque {
+		
+		Job* Slots;
+		u64 Mask;
+		volatile u64 Top;
+		
+		// Keeps Top and Bottom on different cache lines, thieves and the owner don't fight over one
+		u8 Padding[56];
+		volatile u64 Bottom;
+	};
+	
+	struct JobWorker {
+		
+		JobSystem* System;
+		u32 Index;
+		u32 Random;
+		JobDeque Deque;
+	};
+	
+	// Fixed set of workers with one deque each. The thread that initialized the system is worker 0, it runs
+	// jobs while it waits on a counter and so do jobs waiting on other jobs. Idle workers spin, then yield and
+	// finally sleep until new work is pushed.
+	struct JobSystem {
+		
+		PlatformThread* Threads;
+		JobWorker* Workers;
+		u32 WorkerCount;
+		
+		PlatformMutex Mutex;
+		PlatformConditionVariable WorkAvailable;
+		volatile u32 Sleeping;
+		volatile u32 Running;
+	};
+	
+	// threadCount includes the calling thread, 0 picks one per processor. Capped at JobMaxThreads.
+	bool JobSystemInit(JobSystem* system, u32 threadCount);
+	// Jobs still queued are dropped
+	void JobSystemDestroy(JobSystem* system);
+	// Makes the calling thread worker 0, for systems driven by whichever thread currently owns them. The thread
+	// that was worker 0 before runs the jobs it starts right away from then on.
+	void JobSystemAttach(JobSystem* system);
+	
+	// Only worker 0 and jobs may start jobs, any other thread runs them right away. counter may be null.
+	void JobSystemRun(JobSystem* system, JobProc proc, void* data, JobCounter* counter);
+	// proc is called with ranges of at most batchSize items that together cover [0, count)
+	void JobSystemParallelFor(JobSystem* system, JobProc proc, void* data, u32 count, u32 batchSize, JobCounter* counter);
+	
+	// Runs other jobs until counter drops to 0, a job waiting on jobs it started is how dependencies are expressed
+	void JobSystemWait(JobSystem* system, JobCounter* counter);
+}
+
+#endif // HANDMADE_JOBS_H
@@ -1,58 +1,939 @@
 #include "handmade_vulkan.h"
 #include "handmade_window.h"
+#include "handmade_platform.h"
+#include "handmade_jobs.h"
+#include "handmade_render_thread.h"
 
 namespace handmade {
 	
-	int Main(int argc, char** argv) {
+	static Vertex QuadVertices[4] = {
 		
-		Window window{};
-		if (WindowCreate(&window, "Handmade Vulkan", 800, 600)) {
+		{{-1.0f, -1.0f}, {1.0f, 0.0f, 0.0f}},
+		{{ 1.0f, -1.0f}, {0.0f, 1.0f, 0.0f}},
+		{{ 1.0f,  1.0f}, {0.0f, 0.0f, 1.0f}},
+		{{-1.0f,  1.0f}, {1.0f, 1.0f, 1.0f}}
+	};
+	
+	static u32 QuadIndices[6] = {
+		
+		0, 1, 2, 2, 3, 0
+	};
+	
+	// Renders a fixed number of frames into offscreen images and reports the throughput
+	static int MainHeadless(u64 frameCount, u32 framesInFlight, u32 samples) {
+		
+		VulkanState vulkanState{};
+		if (VulkanStateInitHeadless(&vulkanState, 800, 600, framesInFlight) && VulkanSetSampleCount(&vulkanState, samples)) {
+			
+			u32 indexCount = ARRAY_SIZE(QuadIndices);
+			
+			VulkanBuffer vertexBuffer{};
+			VulkanCreateVertexBuffer(&vulkanState, &vertexBuffer, QuadVertices, ARRAY_SIZE(QuadVertices));
+			
+			VulkanBuffer indexBuffer{};
+			VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, QuadIndices, ARRAY_SIZE(QuadIndices));
+			
+			f64 startTime = PlatformGetTime();
+			
+			for (u64 i = 0; i < frameCount; i++) {
+				
+				VulkanDrawIndexed(&vulkanState, &vertexBuffer, &indexBuffer, indexCount);
+			}
+			
+			vkDeviceWaitIdle(vulkanState.Device);
+			f64 elapsed = PlatformGetTime() - startTime;
+			
+			printf("[Headless] - %llu frames in %lf s (%lf fps)\n", (unsigned long long)frameCount, elapsed, (f64)frameCount / elapsed);
+			
+			VulkanDestroyVertexBuffer(&vulkanState, &vertexBuffer);
+			VulkanDestroyIndexBuffer(&vulkanState, &indexBuffer);
+		}
+		else {
+			
+			fprintf(stderr, "Couldn't initialize headless vulkan state!\n");
+		}
+		
+		VulkanStateDestroy(&vulkanState);
+		
+		return 0;
+	}
+	
+	// Runs the headless loop once per frames in flight setting, cpuTime of simulated game work per frame gives the GPU something to overlap with
+	static int MainBenchmark(u64 frameCount, f64 cpuTime) {
+		
+		printf("[Benchmark] - %llu frames, %.2lf ms CPU work per frame\n", (unsigned long long)frameCount, cpuTime * 1000.0);
+		printf("[Benchmark] - in flight |     fps | cpu ms | gpu ms | wait ms | overlap | latency ms | max latency ms\n");
+		
+		for (u32 framesInFlight = VulkanMinFramesInFlight; framesInFlight <= VulkanMaxFramesInFlight; framesInFlight++) {
+			
+			VulkanState vulkanState{};
+			if (!VulkanStateInitHeadless(&vulkanState, 800, 600, framesInFlight)) {
+				
+				fprintf(stderr, "Couldn't initialize headless vulkan state!\n");
+				VulkanStateDestroy(&vulkanState);
+				return 1;
+			}
+			
+			u32 indexCount = ARRAY_SIZE(QuadIndices);
+			
+			VulkanBuffer vertexBuffer{};
+			VulkanCreateVertexBuffer(&vulkanState, &vertexBuffer, QuadVertices, ARRAY_SIZE(QuadVertices));
+			
+			VulkanBuffer indexBuffer{};
+			VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, QuadIndices, ARRAY_SIZE(QuadIndices));
+			
+			// Warm up so the measured frames run in steady state
+			for (u32 i = 0; i < 2 * VulkanMaxFramesInFlight; i++) {
+				
+				VulkanDrawIndexed(&vulkanState, &vertexBuffer, &indexBuffer, indexCount);
+			}
+			VulkanResetFrameStats(&vulkanState);
+			
+			f64 startTime = PlatformGetTime();
+			
+			for (u64 i = 0; i < frameCount; i++) {
+				
+				f64 workStart = PlatformGetTime();
+				while (PlatformGetTime() - workStart < cpuTime) {
+				
+				}
+				
+				VulkanDrawIndexed(&vulkanState, &vertexBuffer, &indexBuffer, indexCount);
+			}
+			
+			f64 elapsed = PlatformGetTime() - startTime;
+			VulkanFrameStats* stats = &vulkanState.FrameStats;
+			
+			// Busy time the two sides spent at the same time, 0 when they strictly alternate and 1 when the shorter one is fully hidden
+			f64 cpuBusy = elapsed - stats->WaitTime;
+			f64 gpuBusy = stats->GpuTime;
+			f64 shorter = cpuBusy < gpuBusy ? cpuBusy : gpuBusy;
+			f64 overlap = shorter > 0.0 ? (cpuBusy + gpuBusy - elapsed) / shorter : 0.0;
+			overlap = overlap < 0.0 ? 0.0 : (overlap > 1.0 ? 1.0 : overlap);
+			
+			f64 frames = (f64)(stats->FrameCount ? stats->FrameCount : 1);
+			printf("[Benchmark] - %9u | %7.1lf | %6.3lf | %6.3lf | %7.3lf | %6.1lf%% | %10.3lf | %14.3lf\n",
+				   framesInFlight,
+				   (f64)frameCount / elapsed,
+				   cpuBusy * 1000.0 / (f64)frameCount,
+				   gpuBusy * 1000.0 / frames,
+				   stats->WaitTime * 1000.0 / (f64)frameCount,
+				   overlap * 100.0,
+				   stats->Latency * 1000.0 / frames,
+				   stats->MaxLatency * 1000.0);
+			
+			VulkanDestroyVertexBuffer(&vulkanState, &vertexBuffer);
+			VulkanDestroyIndexBuffer(&vulkanState, &indexBuffer);
+			VulkanStateDestroy(&vulkanState);
+		}
+		
+		return 0;
+	}
+	
+	// Full screen layers drawn back to front in a single instanced draw, so the draw sort can't help early-Z
+	static int MainDepthBenchmark(u64 frameCount) {
+		
+		const u32 layerCount = 16;
+		printf("[Depth] - %llu frames, %u overlapping full screen layers drawn back to front\n", (unsigned long long)frameCount, layerCount);
+		printf("[Depth] - prepass | gpu ms | fragment invocations per frame\n");
+		
+		InstanceData layers[layerCount]{};
+		for (u32 i = 0; i < layerCount; i++) {
+			
+			f32 t = (f32)i / (f32)layerCount;
+			layers[i].Translation = { 0.0f, 0.0f, 0.9f - 0.8f * t };
+			layers[i].Scale = 1.0f;
+			layers[i].Color = { t, 1.0f - t, 0.5f };
+		}
+		
+		for (u32 prepass = 0; prepass < 2; prepass++) {
+			
+			VulkanState vulkanState{};
+			if (!VulkanStateInitHeadless(&vulkanState, 800, 600, VulkanDefaultFramesInFlight) || !VulkanSetDepthPrepass(&vulkanState, prepass != 0)) {
+				
+				fprintf(stderr, "Couldn't initialize headless vulkan state!\n");
+				VulkanStateDestroy(&vulkanState);
+				return 1;
+			}
+			
+			VulkanBuffer vertexBuffer{};
+			VulkanCreateVertexBuffer(&vulkanState, &vertexBuffer, QuadVertices, ARRAY_SIZE(QuadVertices));
+			
+			VulkanBuffer indexBuffer{};
+			VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, QuadIndices, ARRAY_SIZE(QuadIndices));
+			
+			VulkanBuffer instanceBuffer{};
+			VulkanCreateInstanceBuffer(&vulkanState, &instanceBuffer, layers, layerCount);
+			
+			VulkanDraw draw{};
+			draw.VertexBuffer = &vertexBuffer;
+			draw.IndexBuffer = &indexBuffer;
+			draw.IndexCount = ARRAY_SIZE(QuadIndices);
+			draw.InstanceBuffer = &instanceBuffer;
+			draw.InstanceCount = layerCount;
+			
+			for (u64 i = 0; i < frameCount + 2 * VulkanMaxFramesInFlight; i++) {
+				
+				// Warm up so the measured frames run in steady state
+				if (i == 2 * VulkanMaxFramesInFlight) {
+					
+					vkDeviceWaitIdle(vulkanState.Device);
+					VulkanResetFrameStats(&vulkanState);
+				}
+				
+				VulkanBeginFrame(&vulkanState);
+				VulkanSubmitDraw(&vulkanState, &draw);
+				VulkanEndFrame(&vulkanState);
+			}
+			
+			vkDeviceWaitIdle(vulkanState.Device);
+			VulkanFrameStats* stats = &vulkanState.FrameStats;
+			f64 frames = (f64)(stats->FrameCount ? stats->FrameCount : 1);
+			
+			// Invocations stay 0 on devices without pipeline statistics queries
+			printf("[Depth] - %7s | %6.3lf | %.0lf\n",
+				   prepass ? "on" : "off",
+				   stats->GpuTime * 1000.0 / frames,
+				   (f64)stats->FragmentInvocations / frames);
+			
+			VulkanDestroyInstanceBuffer(&vulkanState, &instanceBuffer);
+			VulkanDestroyVertexBuffer(&vulkanState, &vertexBuffer);
+			VulkanDestroyIndexBuffer(&vulkanState, &indexBuffer);
+			VulkanStateDestroy(&vulkanState);
+		}
+		
+		return 0;
+	}
+	
+	// Every quad has its own vertex buffer, so every draw is a batch of its own. Each frame leaves out a different
+	// quad, so no frame can be resubmitted as recorded. Measured once per thread count.
+	static int MainRecordBenchmark(u64 frameCount) {
+		
+		const u32 drawCount = 4096;
+		u32 processorCount = PlatformGetProcessorCount();
+		u32 maxThreads = processorCount < VulkanMaxRecordThreads ? processorCount : VulkanMaxRecordThreads;
+		
+		printf("[Record] - %llu frames of %u draws, %u processors\n", (unsigned long long)frameCount, drawCount, processorCount);
+		printf("[Record] - threads | record ms | speedup\n");
+		
+		VulkanState vulkanState{};
+		if (!VulkanStateInitHeadless(&vulkanState, 800, 600, VulkanDefaultFramesInFlight)) {
+			
+			fprintf(stderr, "Couldn't initialize headless vulkan state!\n");
+			VulkanStateDestroy(&vulkanState);
+			return 1;
+		}
+		
+		VulkanBuffer* vertexBuffers = (VulkanBuffer*)calloc(drawCount, sizeof(VulkanBuffer));
+		VulkanBuffer indexBuffer{};
+		VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, QuadIndices, ARRAY_SIZE(QuadIndices));
+		
+		VulkanBeginUploads(&vulkanState);
+		for (u32 i = 0; vertexBuffers && i < drawCount; i++) {
+			
+			f32 x = -1.0f + 2.0f * (f32)(i % 64) / 64.0f;
+			f32 y = -1.0f + 2.0f * (f32)(i / 64) / 64.0f;
+			Vertex vertices[4] = {
+				
+				{{x, y}, {1.0f, 0.0f, 0.0f}},
+				{{x + 0.03f, y}, {0.0f, 1.0f, 0.0f}},
+				{{x + 0.03f, y + 0.03f}, {0.0f, 0.0f, 1.0f}},
+				{{x, y + 0.03f}, {1.0f, 1.0f, 1.0f}}
+			};
+			VulkanCreateVertexBuffer(&vulkanState, vertexBuffers + i, vertices, ARRAY_SIZE(vertices));
+		}
+		VulkanEndUploads(&vulkanState);
+		
+		f64 singleTime = 0.0;
+		for (u32 threads = 1; vertexBuffers && threads <= maxThreads; threads = (threads < maxThreads && threads * 2 > maxThreads) ? maxThreads : threads * 2) {
+			
+			if (!VulkanSetRecordThreads(&vulkanState, threads)) {
+				
+				fprintf(stderr, "Couldn't start %u record threads!\n", threads);
+				break;
+			}
+			
+			for (u64 i = 0; i < frameCount + 2 * VulkanMaxFramesInFlight; i++) {
+				
+				// Warm up so the measured frames run in steady state
+				if (i == 2 * VulkanMaxFramesInFlight) {
+					
+					vkDeviceWaitIdle(vulkanState.Device);
+					VulkanResetFrameStats(&vulkanState);
+				}
+				
+				VulkanBeginFrame(&vulkanState);
+				for (u32 j = 0; j < drawCount; j++) {
+					
+					if (j == i % drawCount) {
+						
+						continue;
+					}
+					
+					VulkanDraw draw{};
+					draw.VertexBuffer = vertexBuffers + j;
+					draw.IndexBuffer = &indexBuffer;
+					draw.IndexCount = ARRAY_SIZE(QuadIndices);
+					VulkanSubmitDraw(&vulkanState, &draw);
+				}
+				VulkanEndFrame(&vulkanState);
+			}
+			
+			vkDeviceWaitIdle(vulkanState.Device);
+			VulkanFrameStats* stats = &vulkanState.FrameStats;
+			u64 recorded = stats->FrameCount - stats->RecordedFrameReuses;
+			f64 recordTime = stats->RecordTime / (f64)(recorded ? recorded : 1);
+			singleTime = threads == 1 ? recordTime : singleTime;
+			
+			printf("[Record] - %7u | %9.3lf | %6.2lfx\n", threads, recordTime * 1000.0, recordTime > 0.0 ? singleTime / recordTime : 0.0);
+			
+			if (threads == maxThreads) {
+				
+				break;
+			}
+		}
+		
+		for (u32 i = 0; vertexBuffers && i < drawCount; i++) {
+			
+			VulkanDestroyVertexBuffer(&vulkanState, vertexBuffers + i);
+		}
+		free(vertexBuffers);
+		VulkanDestroyIndexBuffer(&vulkanState, &indexBuffer);
+		VulkanStateDestroy(&vulkanState);
+		
+		return 0;
+	}
+	
+	static void JobBenchmarkEmpty(void* data, u32 first, u32 end) {
+	
+	}
+	
+	struct JobBenchmarkSteal {
+		
+		f64 PushTime;
+		f64 Latency;
+		volatile u32 Started;
+	};
+	
+	static void JobBenchmarkStolen(void* data, u32 first, u32 end) {
+		
+		JobBenchmarkSteal* steal = (JobBenchmarkSteal*)data;
+		steal->Latency = PlatformGetTime() - steal->PushTime;
+		PlatformAtomicStore(&steal->Started, 1);
+	}
+	
+	// Empty jobs, so only the cost of pushing, popping and stealing them is measured. Single jobs are started
+	// from the main thread in rounds that fit its deque, the parallel for starts one job per item and leaves the
+	// splitting to the workers. Steal latency is the time from pushing a job on the main thread, which then
+	// doesn't help, to another worker starting it.
+	static int MainJobBenchmark(u64 frameCount) {
+		
+		const u32 jobCount = 1000000;
+		const u32 roundSize = JobDequeCapacity / 2;
+		u32 processorCount = PlatformGetProcessorCount();
+		u32 maxThreads = processorCount < JobMaxThreads ? processorCount : JobMaxThreads;
+		
+		printf("[Jobs] - %u jobs, %llu steals, %u processors\n", jobCount, (unsigned long long)frameCount, processorCount);
+		printf("[Jobs] - threads | run Mjobs/s | parallel for Mjobs/s | steal latency us\n");
+		
+		for (u32 threads = 1; threads <= maxThreads; threads = (threads < maxThreads && threads * 2 > maxThreads) ? maxThreads : threads * 2) {
+			
+			JobSystem jobs{};
+			if (!JobSystemInit(&jobs, threads)) {
+				
+				fprintf(stderr, "Couldn't start %u job threads!\n", threads);
+				JobSystemDestroy(&jobs);
+				return 1;
+			}
+			
+			JobCounter counter{};
+			f64 startTime = PlatformGetTime();
+			for (u32 i = 0; i < jobCount; i += roundSize) {
+				
+				for (u32 j = i; j < jobCount && j < i + roundSize; j++) {
+					
+					JobSystemRun(&jobs, JobBenchmarkEmpty, nullptr, &counter);
+				}
+				JobSystemWait(&jobs, &counter);
+			}
+			f64 runTime = PlatformGetTime() - startTime;
+			
+			startTime = PlatformGetTime();
+			JobSystemParallelFor(&jobs, JobBenchmarkEmpty, nullptr, jobCount, 1, &counter);
+			JobSystemWait(&jobs, &counter);
+			f64 parallelForTime = PlatformGetTime() - startTime;
+			
+			// Nobody could steal with a single thread
+			f64 latency = 0.0;
+			for (u64 i = 0; threads > 1 && i < frameCount; i++) {
+				
+				JobBenchmarkSteal steal{};
+				steal.PushTime = PlatformGetTime();
+				JobSystemRun(&jobs, JobBenchmarkStolen, &steal, &counter);
+				
+				while (!PlatformAtomicLoad(&steal.Started)) {
+					
+					PlatformCpuRelax();
+				}
+				JobSystemWait(&jobs, &counter);
+				latency += steal.Latency;
+			}
+			
+			printf("[Jobs] - %7u | %11.2lf | %20.2lf | %16.2lf\n",
+				   threads,
+				   (f64)jobCount / runTime / 1000000.0,
+				   (f64)jobCount / parallelForTime / 1000000.0,
+				   threads > 1 ? latency * 1000000.0 / (f64)frameCount : 0.0);
+			
+			JobSystemDestroy(&jobs);
+			
+			if (threads == maxThreads) {
+				
+				break;
+			}
+		}
+		
+		return 0;
+	}
+	
+	// cpuTime of simulated game work per frame, first followed by rendering on the same thread, then overlapped with
+	// a render thread one frame behind. The frame time should drop from the sum of both sides to the longer one.
+	static int MainRenderThreadBenchmark(u64 frameCount, u32 framesInFlight, f64 cpuTime) {
+		
+		VulkanState vulkanState{};
+		if (!VulkanStateInitHeadless(&vulkanState, 800, 600, framesInFlight)) {
+			
+			fprintf(stderr, "Couldn't initialize headless vulkan state!\n");
+			VulkanStateDestroy(&vulkanState);
+			return 1;
+		}
+		
+		VulkanBuffer vertexBuffer{};
+		VulkanCreateVertexBuffer(&vulkanState, &vertexBuffer, QuadVertices, ARRAY_SIZE(QuadVertices));
+		
+		VulkanBuffer indexBuffer{};
+		VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, QuadIndices, ARRAY_SIZE(QuadIndices));
+		
+		VulkanDraw draw{};
+		draw.VertexBuffer = &vertexBuffer;
+		draw.IndexBuffer = &indexBuffer;
+		draw.IndexCount = ARRAY_SIZE(QuadIndices);
+		
+		printf("[Render Thread] - %llu frames, %.2lf ms CPU work per frame\n", (unsigned long long)frameCount, cpuTime * 1000.0);
+		printf("[Render Thread] - mode     |     fps | frame ms | sim ms | render ms | latency ms\n");
+		
+		for (u32 threaded = 0; threaded < 2; threaded++) {
+			
+			VulkanResetFrameStats(&vulkanState);
+			
+			RenderThread renderThread{};
+			if (threaded && !RenderThreadStart(&renderThread, &vulkanState)) {
+				
+				fprintf(stderr, "Couldn't start the render thread!\n");
+				break;
+			}
+			
+			f64 simTime = 0.0;
+			f64 renderTime = 0.0;
+			f64 startTime = PlatformGetTime();
+			
+			for (u64 i = 0; i < frameCount; i++) {
+				
+				f64 workStart = PlatformGetTime();
+				while (PlatformGetTime() - workStart < cpuTime) {
+				
+				}
+				f64 workEnd = PlatformGetTime();
+				simTime += workEnd - workStart;
+				
+				if (threaded) {
+					
+					RenderPacket* packet = RenderThreadBeginPacket(&renderThread);
+					RenderPacketSubmitDraw(packet, &draw);
+					RenderThreadEndPacket(&renderThread);
+				}
+				else {
+					
+					VulkanBeginFrame(&vulkanState);
+					VulkanSubmitDraw(&vulkanState, &draw);
+					VulkanEndFrame(&vulkanState);
+					renderTime += PlatformGetTime() - workEnd;
+				}
+			}
+			
+			if (threaded) {
+				
+				RenderThreadStop(&renderThread);
+				renderTime = renderThread.RenderTime;
+			}
+			
+			f64 elapsed = PlatformGetTime() - startTime;
+			VulkanFrameStats* stats = &vulkanState.FrameStats;
+			f64 frames = (f64)(stats->FrameCount ? stats->FrameCount : 1);
+			
+			printf("[Render Thread] - %-8s | %7.1lf | %8.3lf | %6.3lf | %9.3lf | %10.3lf\n",
+				   threaded ? "threaded" : "serial",
+				   (f64)frameCount / elapsed,
+				   elapsed * 1000.0 / (f64)frameCount,
+				   simTime * 1000.0 / (f64)frameCount,
+				   renderTime * 1000.0 / (f64)frameCount,
+				   stats->Latency * 1000.0 / frames);
+		}
+		
+		VulkanDestroyVertexBuffer(&vulkanState, &vertexBuffer);
+		VulkanDestroyIndexBuffer(&vulkanState, &indexBuffer);
+		VulkanStateDestroy(&vulkanState);
+		
+		return 0;
+	}
+	
+	struct DrawQueueProducer {
+		
+		VulkanState* State;
+		VulkanDrawBucket* Bucket;
+		PlatformMutex* Mutex;
+		VulkanDraw Draw;
+		u32 DrawCount;
+		u32 FrameCount;
+		volatile u32* Frame;
+		volatile u32* Done;
+	};
+	
+	// Submits DrawCount draws as soon as the main thread begins a frame, through its bucket or under the shared mutex
+	static void DrawQueueProduce(void* data) {
+		
+		DrawQueueProducer* producer = (DrawQueueProducer*)data;
+		VulkanDraw draw = producer->Draw;
+		
+		for (u32 frame = 1; frame <= producer->FrameCount; frame++) {
+			
+			while (PlatformAtomicLoad(producer->Frame) < frame) {
+				
+				PlatformYield();
+			}
+			
+			for (u32 i = 0; i < producer->DrawCount; i++) {
+				
+				draw.Depth = (f32)i / (f32)producer->DrawCount;
+				if (producer->Mutex) {
+					
+					PlatformMutexLock(producer->Mutex);
+					VulkanSubmitDraw(producer->State, &draw);
+					PlatformMutexUnlock(producer->Mutex);
+				}
+				else {
+					
+					VulkanSubmitDrawToBucket(producer->Bucket, &draw);
+				}
+			}
+			PlatformAtomicAdd(producer->Done, 1);
+		}
+	}
+	
+	// Producer threads share the draws of every frame, once serialized by one mutex around VulkanSubmitDraw and once
+	// with a draw bucket each. Submit time runs from the frame being begun to the last producer finishing, merge time
+	// is VulkanEndFrame, which merges the buckets into the draw list, sorts and records it.
+	static int MainDrawQueueBenchmark(u64 frameCount) {
+		
+		const u32 drawCount = 16384;
+		const u32 maxProducers = 16;
+		
+		// Tiny quads, the GPU shouldn't be what limits the frame rate
+		Vertex vertices[4] = {
+			
+			{{-0.01f, -0.01f}, {1.0f, 0.0f, 0.0f}},
+			{{ 0.01f, -0.01f}, {0.0f, 1.0f, 0.0f}},
+			{{ 0.01f,  0.01f}, {0.0f, 0.0f, 1.0f}},
+			{{-0.01f,  0.01f}, {1.0f, 1.0f, 1.0f}}
+		};
+		
+		printf("[Draw Queue] - %llu frames, %u draws per frame\n", (unsigned long long)frameCount, drawCount);
+		printf("[Draw Queue] - producers | mode    | Mdraws/s | submit ms | merge ms\n");
+		
+		for (u32 producers = 1; producers <= maxProducers; producers *= 2) {
 			
-			// Initialize the vulkan state
 			VulkanState vulkanState{};
-			if (VulkanStateInit(&vulkanState, &window)) {
+			if (!VulkanStateInitHeadless(&vulkanState, 800, 600, VulkanDefaultFramesInFlight)) {
+				
+				fprintf(stderr, "Couldn't initialize headless vulkan state!\n");
+				VulkanStateDestroy(&vulkanState);
+				return 1;
+			}
+			
+			VulkanBuffer vertexBuffer{};
+			VulkanCreateVertexBuffer(&vulkanState, &vertexBuffer, vertices, ARRAY_SIZE(vertices));
+			
+			VulkanBuffer indexBuffer{};
+			VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, QuadIndices, ARRAY_SIZE(QuadIndices));
+			
+			PlatformMutex mutex{};
+			PlatformMutexInit(&mutex);
+			
+			for (u32 buckets = 0; buckets < 2; buckets++) {
+				
+				PlatformThread threads[maxProducers]{};
+				DrawQueueProducer producerData[maxProducers]{};
+				volatile u32 frame = 0;
+				volatile u32 done = 0;
+				
+				for (u32 i = 0; i < producers; i++) {
+					
+					DrawQueueProducer* producer = (producerData + i);
+					producer->State = &vulkanState;
+					producer->Bucket = buckets ? VulkanAcquireDrawBucket(&vulkanState, i) : nullptr;
+					producer->Mutex = buckets ? nullptr : &mutex;
+					producer->Draw.VertexBuffer = &vertexBuffer;
+					producer->Draw.IndexBuffer = &indexBuffer;
+					producer->Draw.IndexCount = ARRAY_SIZE(QuadIndices);
+					producer->DrawCount = drawCount / producers;
+					producer->FrameCount = (u32)frameCount;
+					producer->Frame = &frame;
+					producer->Done = &done;
+					PlatformThreadCreate(threads + i, DrawQueueProduce, producer);
+				}
+				
+				f64 submitTime = 0.0;
+				f64 mergeTime = 0.0;
 				
-				Vertex vertices[4] = {
+				for (u32 i = 1; i <= (u32)frameCount; i++) {
+					
+					VulkanBeginFrame(&vulkanState);
+					f64 startTime = PlatformGetTime();
+					
+					PlatformAtomicStore(&frame, i);
+					while (PlatformAtomicLoad(&done) < producers * i) {
+						
+						PlatformYield();
+					}
 					
-					{{-1.0f, -1.0f}, {1.0f, 0.0f, 0.0f}},
-					{{ 1.0f, -1.0f}, {0.0f, 1.0f, 0.0f}},
-					{{ 1.0f,  1.0f}, {0.0f, 0.0f, 1.0f}},
-					{{-1.0f,  1.0f}, {1.0f, 1.0f, 1.0f}}
-				};
+					f64 submittedTime = PlatformGetTime();
+					submitTime += submittedTime - startTime;
+					
+					VulkanEndFrame(&vulkanState);
+					mergeTime += PlatformGetTime() - submittedTime;
+				}
 				
-				u32 indices[6] = {
+				for (u32 i = 0; i < producers; i++) {
 					
-					0, 1, 2, 2, 3, 0
-				};
+					PlatformThreadJoin(threads + i);
+				}
 				
-				u32 indexCount = ARRAY_SIZE(indices);
+				printf("[Draw Queue] - %9u | %-7s | %8.2lf | %9.3lf | %8.3lf\n",
+					   producers,
+					   buckets ? "buckets" : "mutex",
+					   (f64)drawCount * (f64)frameCount / submitTime / 1000000.0,
+					   submitTime * 1000.0 / (f64)frameCount,
+					   mergeTime * 1000.0 / (f64)frameCount);
+			}
+			
+			PlatformMutexDestroy(&mutex);
+			VulkanDestroyVertexBuffer(&vulkanState, &vertexBuffer);
+			VulkanDestroyIndexBuffer(&vulkanState, &indexBuffer);
+			VulkanStateDestroy(&vulkanState);
+		}
+		
+		return 0;
+	}
+	
+	struct UploadLoader {
+		
+		VulkanState* State;
+		VulkanBuffer* VertexBuffers;
+		VulkanBuffer* IndexBuffers;
+		u32 MeshCount;
+		u32 Created;
+		f64 Time;
+		bool Failed;
+	};
+	
+	// Creates MeshCount meshes of 1024 quads each through an upload context of its own, submitting every 16
+	static void UploadLoad(void* data) {
+		
+		UploadLoader* loader = (UploadLoader*)data;
+		const u32 quadCount = 1024;
+		
+		Vertex* vertices = (Vertex*)malloc(4 * quadCount * sizeof(Vertex));
+		u32* indices = (u32*)malloc(6 * quadCount * sizeof(u32));
+		for (u32 i = 0; vertices && indices && i < quadCount; i++) {
+			
+			memcpy(vertices + 4 * i, QuadVertices, sizeof(QuadVertices));
+			for (u32 j = 0; j < 6; j++) {
+				
+				indices[6 * i + j] = QuadIndices[j] + 4 * i;
+			}
+		}
+		
+		VulkanUploadContext context{};
+		f64 startTime = PlatformGetTime();
+		bool complete = vertices && indices && VulkanCreateUploadContext(loader->State, &context);
+		
+		for (u32 i = 0; complete && i < loader->MeshCount; i++) {
+			
+			complete &= VulkanUploadContextCreateVertexBuffer(&context, loader->VertexBuffers + i, vertices, 4 * quadCount);
+			complete &= VulkanUploadContextCreateIndexBuffer(&context, loader->IndexBuffers + i, indices, 6 * quadCount);
+			loader->Created += complete ? 1 : 0;
+			
+			if (i % 16 == 15) {
+				
+				complete &= VulkanSubmitUploadContext(&context);
+			}
+		}
+		complete &= VulkanSubmitUploadContext(&context);
+		
+		VulkanDestroyUploadContext(&context);
+		loader->Time = PlatformGetTime() - startTime;
+		loader->Failed = !complete;
+		
+		free(vertices);
+		free(indices);
+	}
+	
+	// Loader threads create meshes while the main thread keeps rendering, reports the frame rate next to the meshes created per second
+	static int MainUploadBenchmark(u64 frameCount) {
+		
+		const u32 meshCount = 256;
+		const u32 maxLoaders = 4;
+		
+		printf("[Uploads] - %llu frames, %u meshes of 1024 quads per loader\n", (unsigned long long)frameCount, meshCount);
+		printf("[Uploads] - loaders |     fps | meshes/s\n");
+		
+		for (u32 loaders = 0; loaders <= maxLoaders; loaders = loaders ? loaders * 2 : 1) {
+			
+			VulkanState vulkanState{};
+			if (!VulkanStateInitHeadless(&vulkanState, 800, 600, VulkanDefaultFramesInFlight)) {
+				
+				fprintf(stderr, "Couldn't initialize headless vulkan state!\n");
+				VulkanStateDestroy(&vulkanState);
+				return 1;
+			}
+			
+			VulkanBuffer vertexBuffer{};
+			VulkanCreateVertexBuffer(&vulkanState, &vertexBuffer, QuadVertices, ARRAY_SIZE(QuadVertices));
+			
+			VulkanBuffer indexBuffer{};
+			VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, QuadIndices, ARRAY_SIZE(QuadIndices));
+			
+			PlatformThread threads[maxLoaders]{};
+			UploadLoader loaderData[maxLoaders]{};
+			
+			for (u32 i = 0; i < loaders; i++) {
+				
+				UploadLoader* loader = (loaderData + i);
+				loader->State = &vulkanState;
+				loader->VertexBuffers = (VulkanBuffer*)calloc(meshCount, sizeof(VulkanBuffer));
+				loader->IndexBuffers = (VulkanBuffer*)calloc(meshCount, sizeof(VulkanBuffer));
+				loader->MeshCount = loader->VertexBuffers && loader->IndexBuffers ? meshCount : 0;
+			}
+			
+			f64 startTime = PlatformGetTime();
+			
+			for (u32 i = 0; i < loaders; i++) {
+				
+				PlatformThreadCreate(threads + i, UploadLoad, loaderData + i);
+			}
+			
+			for (u64 i = 0; i < frameCount; i++) {
+				
+				VulkanDrawIndexed(&vulkanState, &vertexBuffer, &indexBuffer, ARRAY_SIZE(QuadIndices));
+			}
+			
+			f64 elapsed = PlatformGetTime() - startTime;
+			
+			u32 created = 0;
+			f64 loadTime = 0.0;
+			bool failed = false;
+			
+			for (u32 i = 0; i < loaders; i++) {
+				
+				UploadLoader* loader = (loaderData + i);
+				PlatformThreadJoin(threads + i);
+				created += loader->Created;
+				loadTime = loader->Time > loadTime ? loader->Time : loadTime;
+				failed |= loader->Failed;
+				
+				for (u32 j = 0; j < loader->Created; j++) {
+					
+					VulkanDestroyVertexBuffer(&vulkanState, loader->VertexBuffers + j);
+					VulkanDestroyIndexBuffer(&vulkanState, loader->IndexBuffers + j);
+				}
+				free(loader->VertexBuffers);
+				free(loader->IndexBuffers);
+			}
+			
+			printf("[Uploads] - %7u | %7.1lf | %8.1lf%s\n",
+				   loaders,
+				   (f64)frameCount / elapsed,
+				   loadTime > 0.0 ? (f64)created / loadTime : 0.0,
+				   failed ? " (failed)" : "");
+			
+			VulkanDestroyVertexBuffer(&vulkanState, &vertexBuffer);
+			VulkanDestroyIndexBuffer(&vulkanState, &indexBuffer);
+			VulkanStateDestroy(&vulkanState);
+		}
+		
+		return 0;
+	}
+	
+	int Main(int argc, char** argv) {
+		
+		bool headless = false;
+		bool benchmark = false;
+		bool depthBenchmark = false;
+		bool recordBenchmark = false;
+		bool jobBenchmark = false;
+		bool renderThreadBenchmark = false;
+		bool drawQueueBenchmark = false;
+		bool uploadBenchmark = false;
+		u64 frameCount = 1000;
+		u32 framesInFlight = VulkanDefaultFramesInFlight;
+		u32 samples = 1;
+		f64 cpuTime = 0.002;
+		
+		for (i32 i = 1; i < argc; i++) {
+			
+			if (strcmp(argv[i], "--headless") == 0) {
+				
+				headless = true;
+			}
+			else if (strcmp(argv[i], "--benchmark") == 0) {
+				
+				benchmark = true;
+			}
+			else if (strcmp(argv[i], "--depth-benchmark") == 0) {
+				
+				depthBenchmark = true;
+			}
+			else if (strcmp(argv[i], "--record-benchmark") == 0) {
+				
+				recordBenchmark = true;
+			}
+			else if (strcmp(argv[i], "--job-benchmark") == 0) {
+				
+				jobBenchmark = true;
+			}
+			else if (strcmp(argv[i], "--render-thread-benchmark") == 0) {
+				
+				renderThreadBenchmark = true;
+			}
+			else if (strcmp(argv[i], "--draw-queue-benchmark") == 0) {
+				
+				drawQueueBenchmark = true;
+			}
+			else if (strcmp(argv[i], "--upload-benchmark") == 0) {
+				
+				uploadBenchmark = true;
+			}
+			else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+				
+				frameCount = strtoull(argv[++i], nullptr, 10);
+			}
+			else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+				
+				framesInFlight = (u32)strtoul(argv[++i], nullptr, 10);
+			}
+			else if (strcmp(argv[i], "--cpu-ms") == 0 && i + 1 < argc) {
+				
+				cpuTime = strtod(argv[++i], nullptr) / 1000.0;
+			}
+			else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc) {
+				
+				samples = (u32)strtoul(argv[++i], nullptr, 10);
+			}
+		}
+		
+		if (benchmark) {
+			
+			return MainBenchmark(frameCount, cpuTime);
+		}
+		
+		if (depthBenchmark) {
+			
+			return MainDepthBenchmark(frameCount);
+		}
+		
+		if (recordBenchmark) {
+			
+			return MainRecordBenchmark(frameCount);
+		}
+		
+		if (jobBenchmark) {
+			
+			return MainJobBenchmark(frameCount);
+		}
+		
+		if (renderThreadBenchmark) {
+			
+			return MainRenderThreadBenchmark(frameCount, framesInFlight, cpuTime);
+		}
+		
+		if (drawQueueBenchmark) {
+			
+			return MainDrawQueueBenchmark(frameCount);
+		}
+		
+		if (uploadBenchmark) {
+			
+			return MainUploadBenchmark(frameCount);
+		}
+		
+		if (headless) {
+			
+			return MainHeadless(frameCount, framesInFlight, samples);
+		}
+		
+		Window window{};
+		if (WindowCreate(&window, "Handmade Vulkan", 800, 600)) {
+			
+			// Initialize the vulkan state
+			VulkanState vulkanState{};
+			if (VulkanStateInit(&vulkanState, &window, framesInFlight) && VulkanSetSampleCount(&vulkanState, samples)) {
+				
+				u32 indexCount = ARRAY_SIZE(QuadIndices);
 				
 				VulkanBuffer vertexBuffer{};
-				VulkanCreateVertexBuffer(&vulkanState, &vertexBuffer, vertices, ARRAY_SIZE(vertices));
+				VulkanCreateVertexBuffer(&vulkanState, &vertexBuffer, QuadVertices, ARRAY_SIZE(QuadVertices));
 				
 				VulkanBuffer indexBuffer{};
-				VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, indices, ARRAY_SIZE(indices));
+				VulkanCreateIndexBuffer(&vulkanState, &indexBuffer, QuadIndices, ARRAY_SIZE(QuadIndices));
 				
 				VulkanShader redShader{};
 				VulkanCreateShader(&vulkanState, &redShader, "assets/handmade_red_vert.spv", "assets/handmade_red_frag.spv");
-				VulkanUseShader(&vulkanState, &redShader);
+				// The first frames draw with the default shader while the red pipeline compiles
+				VulkanUseShaderAsync(&vulkanState, &redShader);
 				
-				f64 frameTime = glfwGetTime();
-				u64 inc = 0;
+				VulkanDraw draw{};
+				draw.VertexBuffer = &vertexBuffer;
+				draw.IndexBuffer = &indexBuffer;
+				draw.IndexCount = indexCount;
 				
-				while (WindowIsRunning(&window)) {
+				// This thread polls events and builds the frames, the render thread waits on the GPU and presents
+				RenderThread renderThread{};
+				if (RenderThreadStart(&renderThread, &vulkanState)) {
 					
-					f64 time = glfwGetTime();
-					f64 dt = time - frameTime;
-					frameTime = time;
+					f64 frameTime = glfwGetTime();
+					u64 inc = 0;
 					
-					if (inc++ % 1000 == 0) {
+					while (WindowIsRunning(&window)) {
+						
+						f64 time = glfwGetTime();
+						f64 dt = time - frameTime;
+						frameTime = time;
+						
+						if (inc++ % 1000 == 0) {
+							
+							printf("fps: %lf\r", 1.0 / dt);
+						}
 						
-						printf("fps: %lf\r", 1.0 / dt);
+						RenderPacket* packet = RenderThreadBeginPacket(&renderThread);
+						RenderPacketSubmitDraw(packet, &draw);
+						if (!RenderThreadEndPacket(&renderThread)) {
+							
+							break;
+						}
+						WindowUpdate(&window);
 					}
 					
-					VulkanDrawIndexed(&vulkanState,&vertexBuffer, &indexBuffer, indexCount);
-					WindowUpdate(&window);
+					RenderThreadStop(&renderThread);
 				}
 				
 				VulkanDestroyVertexBuffer(&vulkanState, &vertexBuffer);
@@ -0,0 +1,266 @@
+#include "handmade_platform.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <cstdlib>
+
+namespace handmade {
+	
+	f64 PlatformGetTime() {
+		
+#ifdef _WIN32
+		LARGE_INTEGER frequency{};
+		LARGE_INTEGER counter{};
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&counter);
+		
+		return (f64)counter.QuadPart / (f64)frequency.QuadPart;
+#else
+		timespec time{};
+		clock_gettime(CLOCK_MONOTONIC, &time);
+		
+		return (f64)time.tv_sec + (f64)time.tv_nsec * 1e-9;
+#endif
+	}
+	
+	bool PlatformWriteFileAtomic(const char* path, const void* data, u64 size) {
+		
+		char temporaryPath[1024]{};
+		if (snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path) >= (i32)sizeof(temporaryPath)) {
+			
+			return false;
+		}
+		
+		FILE* file = fopen(temporaryPath, "wb");
+		if (!file) {
+			
+			return false;
+		}
+		
+		bool written = fwrite(data, 1, (size_t)size, file) == size;
+		written &= fflush(file) == 0;
+		
+#ifdef _WIN32
+		written &= FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(file))) != 0;
+		fclose(file);
+		
+		if (written && MoveFileExA(temporaryPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			
+			return true;
+		}
+#else
+		written &= fsync(fileno(file)) == 0;
+		fclose(file);
+		
+		if (written && rename(temporaryPath, path) == 0) {
+			
+			return true;
+		}
+#endif
+		
+		remove(temporaryPath);
+		return false;
+	}
+	
+#ifdef _WIN32
+	static DWORD WINAPI PlatformThreadEntry(LPVOID parameter) {
+		
+		PlatformThread* thread = (PlatformThread*)parameter;
+		thread->Proc(thread->Data);
+		
+		return 0;
+	}
+#else
+	static void* PlatformThreadEntry(void* parameter) {
+		
+		PlatformThread* thread = (PlatformThread*)parameter;
+		thread->Proc(thread->Data);
+		
+		return nullptr;
+	}
+#endif
+	
+	bool PlatformThreadCreate(PlatformThread* thread, PlatformThreadProc proc, void* data) {
+		
+		thread->Proc = proc;
+		thread->Data = data;
+		
+#ifdef _WIN32
+		thread->Handle = CreateThread(nullptr, 0, PlatformThreadEntry, thread, 0, nullptr);
+		
+		return thread->Handle != nullptr;
+#else
+		pthread_t* handle = (pthread_t*)malloc(sizeof(pthread_t));
+		if (!handle || pthread_create(handle, nullptr, PlatformThreadEntry, thread) != 0) {
+			
+			free(handle);
+			thread->Handle = nullptr;
+			return false;
+		}
+		
+		thread->Handle = handle;
+		return true;
+#endif
+	}
+	
+	void PlatformThreadJoin(PlatformThread* thread) {
+		
+		if (!thread->Handle) {
+			
+			return;
+		}
+		
+#ifdef _WIN32
+		WaitForSingleObject((HANDLE)thread->Handle, INFINITE);
+		CloseHandle((HANDLE)thread->Handle);
+#else
+		pthread_join(*(pthread_t*)thread->Handle, nullptr);
+		free(thread->Handle);
+#endif
+		thread->Handle = nullptr;
+	}
+	
+	u32 PlatformGetProcessorCount() {
+		
+#ifdef _WIN32
+		SYSTEM_INFO info{};
+		GetSystemInfo(&info);
+		
+		return (u32)info.dwNumberOfProcessors;
+#else
+		long count = sysconf(_SC_NPROCESSORS_ONLN);
+		
+		return count > 0 ? (u32)count : 1;
+#endif
+	}
+	
+	void PlatformYield() {
+		
+#ifdef _WIN32
+		SwitchToThread();
+#else
+		sched_yield();
+#endif
+	}
+	
+	bool PlatformMutexInit(PlatformMutex* mutex) {
+		
+#ifdef _WIN32
+		SRWLOCK* lock = (SRWLOCK*)malloc(sizeof(SRWLOCK));
+		if (lock) {
+			
+			InitializeSRWLock(lock);
+		}
+#else
+		pthread_mutex_t* lock = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
+		if (lock && pthread_mutex_init(lock, nullptr) != 0) {
+			
+			free(lock);
+			lock = nullptr;
+		}
+#endif
+		mutex->Handle = lock;
+		
+		return lock != nullptr;
+	}
+	
+	void PlatformMutexDestroy(PlatformMutex* mutex) {
+		
+#ifndef _WIN32
+		if (mutex->Handle) {
+			
+			pthread_mutex_destroy((pthread_mutex_t*)mutex->Handle);
+		}
+#endif
+		free(mutex->Handle);
+		mutex->Handle = nullptr;
+	}
+	
+	void PlatformMutexLock(PlatformMutex* mutex) {
+		
+#ifdef _WIN32
+		AcquireSRWLockExclusive((SRWLOCK*)mutex->Handle);
+#else
+		pthread_mutex_lock((pthread_mutex_t*)mutex->Handle);
+#endif
+	}
+	
+	void PlatformMutexUnlock(PlatformMutex* mutex) {
+		
+#ifdef _WIN32
+		ReleaseSRWLockExclusive((SRWLOCK*)mutex->Handle);
+#else
+		pthread_mutex_unlock((pthread_mutex_t*)mutex->Handle);
+#endif
+	}
+	
+	bool PlatformConditionInit(PlatformConditionVariable* condition) {
+		
+#ifdef _WIN32
+		CONDITION_VARIABLE* variable = (CONDITION_VARIABLE*)malloc(sizeof(CONDITION_VARIABLE));
+		if (variable) {
+			
+			InitializeConditionVariable(variable);
+		}
+#else
+		pthread_cond_t* variable = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+		if (variable && pthread_cond_init(variable, nullptr) != 0) {
+			
+			free(variable);
+			variable = nullptr;
+		}
+#endif
+		condition->Handle = variable;
+		
+		return variable != nullptr;
+	}
+	
+	void PlatformConditionDestroy(PlatformConditionVariable* condition) {
+		
+#ifndef _WIN32
+		if (condition->Handle) {
+			
+			pthread_cond_destroy((pthread_cond_t*)condition->Handle);
+		}
+#endif
+		free(condition->Handle);
+		condition->Handle = nullptr;
+	}
+	
+	void PlatformConditionWait(PlatformConditionVariable* condition, PlatformMutex* mutex) {
+		
+#ifdef _WIN32
+		SleepConditionVariableSRW((CONDITION_VARIABLE*)condition->Handle, (SRWLOCK*)mutex->Handle, INFINITE, 0);
+#else
+		pthread_cond_wait((pthread_cond_t*)condition->Handle, (pthread_mutex_t*)mutex->Handle);
+#endif
+	}
+	
+	void PlatformConditionSignal(PlatformConditionVariable* condition) {
+		
+#ifdef _WIN32
+		WakeConditionVariable((CONDITION_VARIABLE*)condition->Handle);
+#else
+		pthread_cond_signal((pthread_cond_t*)condition->Handle);
+#endif
+	}
+	
+	void PlatformConditionBroadcast(PlatformConditionVariable* condition) {
+		
+#ifdef _WIN32
+		WakeAllConditionVariable((CONDITION_VARIABLE*)condition->Handle);
+#else
+		pthread_cond_broadcast((pthread_cond_t*)condition->Handle);
+#endif
+	}
+}
@@ -0,0 +1,98 @@
+#ifndef HANDMADE_PLATFORM_H
+#define HANDMADE_PLATFORM_H
+
+#include "handmade_types.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace handmade {
+	
+	typedef void (*PlatformThreadProc)(void* data);
+	
+	struct PlatformThread {
+		
+		void* Handle;
+		PlatformThreadProc Proc;
+		void* Data;
+	};
+	
+	struct PlatformMutex {
+		
+		void* Handle;
+	};
+	
+	struct PlatformConditionVariable {
+		
+		void* Handle;
+	};
+	
+	// Monotonic time in seconds, usable without a window (GLFW needs glfwInit for glfwGetTime)
+	f64 PlatformGetTime();
+	
+	// Writes to a temporary file next to path and renames it over path, readers never see a partial file
+	bool PlatformWriteFileAtomic(const char* path, const void* data, u64 size);
+	
+	// Threads, the PlatformThread has to stay alive until it is joined
+	bool PlatformThreadCreate(PlatformThread* thread, PlatformThreadProc proc, void* data);
+	void PlatformThreadJoin(PlatformThread* thread);
+	u32 PlatformGetProcessorCount();
+	void PlatformYield();
+	
+	bool PlatformMutexInit(PlatformMutex* mutex);
+	void PlatformMutexDestroy(PlatformMutex* mutex);
+	void PlatformMutexLock(PlatformMutex* mutex);
+	void PlatformMutexUnlock(PlatformMutex* mutex);
+	
+	bool PlatformConditionInit(PlatformConditionVariable* condition);
+	void PlatformConditionDestroy(PlatformConditionVariable* condition);
+	void PlatformConditionWait(PlatformConditionVariable* condition, PlatformMutex* mutex);
+	void PlatformConditionSignal(PlatformConditionVariable* condition);
+	void PlatformConditionBroadcast(PlatformConditionVariable* condition);
+	
+	// Sequentially consistent atomics, the Add and Exchange variants return the previous value
+#ifdef _MSC_VER
+	inline u32 PlatformAtomicLoad(volatile u32* value) { return (u32)_InterlockedOr((volatile long*)value, 0); }
+	inline void PlatformAtomicStore(volatile u32* value, u32 desired) { _InterlockedExchange((volatile long*)value, (long)desired); }
+	inline u32 PlatformAtomicAdd(volatile u32* value, u32 addend) { return (u32)_InterlockedExchangeAdd((volatile long*)value, (long)addend); }
+	inline u32 PlatformAtomicExchange(volatile u32* value, u32 desired) { return (u32)_InterlockedExchange((volatile long*)value, (long)desired); }
+	inline bool PlatformAtomicCompareExchange(volatile u32* value, u32 expected, u32 desired) { return (u32)_InterlockedCompareExchange((volatile long*)value, (long)desired, (long)expected) == expected; }
+	
+	inline u64 PlatformAtomicLoad64(volatile u64* value) { return (u64)_InterlockedOr64((volatile long long*)value, 0); }
+	inline void PlatformAtomicStore64(volatile u64* value, u64 desired) { _InterlockedExchange64((volatile long long*)value, (long long)desired); }
+	inline u64 PlatformAtomicAdd64(volatile u64* value, u64 addend) { return (u64)_InterlockedExchangeAdd64((volatile long long*)value, (long long)addend); }
+	inline bool PlatformAtomicCompareExchange64(volatile u64* value, u64 expected, u64 desired) { return (u64)_InterlockedCompareExchange64((volatile long long*)value, (long long)desired, (long long)expected) == expected; }
+	
+	inline void* PlatformAtomicLoadPointer(void* volatile* value) { return _InterlockedCompareExchangePointer(value, nullptr, nullptr); }
+	inline void PlatformAtomicStorePointer(void* volatile* value, void* desired) { _InterlockedExchangePointer(value, desired); }
+	inline void* PlatformAtomicExchangePointer(void* volatile* value, void* desired) { return _InterlockedExchangePointer(value, desired); }
+	inline bool PlatformAtomicCompareExchangePointer(void* volatile* value, void* expected, void* desired) { return _InterlockedCompareExchangePointer(value, desired, expected) == expected; }
+	
+	inline void PlatformCpuRelax() { _mm_pause(); }
+#else
+	inline u32 PlatformAtomicLoad(volatile u32* value) { return __atomic_load_n(value, __ATOMIC_SEQ_CST); }
+	inline void PlatformAtomicStore(volatile u32* value, u32 desired) { __atomic_store_n(value, desired, __ATOMIC_SEQ_CST); }
+	inline u32 PlatformAtomicAdd(volatile u32* value, u32 addend) { return __atomic_fetch_add(value, addend, __ATOMIC_SEQ_CST); }
+	inline u32 PlatformAtomicExchange(volatile u32* value, u32 desired) { return __atomic_exchange_n(value, desired, __ATOMIC_SEQ_CST); }
+	inline bool PlatformAtomicCompareExchange(volatile u32* value, u32 expected, u32 desired) { return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+	
+	inline u64 PlatformAtomicLoad64(volatile u64* value) { return __atomic_load_n(value, __ATOMIC_SEQ_CST); }
+	inline void PlatformAtomicStore64(volatile u64* value, u64 desired) { __atomic_store_n(value, desired, __ATOMIC_SEQ_CST); }
+	inline u64 PlatformAtomicAdd64(volatile u64* value, u64 addend) { return __atomic_fetch_add(value, addend, __ATOMIC_SEQ_CST); }
+	inline bool PlatformAtomicCompareExchange64(volatile u64* value, u64 expected, u64 desired) { return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+	
+	inline void* PlatformAtomicLoadPointer(void* volatile* value) { return __atomic_load_n(value, __ATOMIC_SEQ_CST); }
+	inline void PlatformAtomicStorePointer(void* volatile* value, void* desired) { __atomic_store_n(value, desired, __ATOMIC_SEQ_CST); }
+	inline void* PlatformAtomicExchangePointer(void* volatile* value, void* desired) { return __atomic_exchange_n(value, desired, __ATOMIC_SEQ_CST); }
+	inline bool PlatformAtomicCompareExchangePointer(void* volatile* value, void* expected, void* desired) { return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+	
+#if defined(__x86_64__) || defined(__i386__)
+	inline void PlatformCpuRelax() { __builtin_ia32_pause(); }
+#else
+	inline void PlatformCpuRelax() { }
+#endif
+#endif
+}
+
+#endif // HANDMADE_PLATFORM_H
@@ -0,0 +1,224 @@
+#include "handmade_render_thread.h"
+
+namespace handmade {
+	
+	// Rounds a side spins on an empty queue before it goes to sleep
+	static const u32 RenderSpinCount = 64;
+	
+	static u32 RenderQueueCount(RenderPacketQueue* queue) {
+		
+		return PlatformAtomicLoad(&queue->Tail) - PlatformAtomicLoad(&queue->Head);
+	}
+	
+	// Never full, there are only RenderPacketCount packets to go around
+	static void RenderQueuePush(RenderPacketQueue* queue, RenderPacket* packet) {
+		
+		u32 tail = PlatformAtomicLoad(&queue->Tail);
+		queue->Slots[tail % RenderPacketCount] = packet;
+		PlatformAtomicStore(&queue->Tail, tail + 1);
+	}
+	
+	static RenderPacket* RenderQueuePop(RenderPacketQueue* queue) {
+		
+		u32 head = PlatformAtomicLoad(&queue->Head);
+		if (head == PlatformAtomicLoad(&queue->Tail)) {
+			
+			return nullptr;
+		}
+		
+		RenderPacket* packet = queue->Slots[head % RenderPacketCount];
+		PlatformAtomicStore(&queue->Head, head + 1);
+		
+		return packet;
+	}
+	
+	static void RenderThreadNotify(RenderThread* renderThread) {
+		
+		if (PlatformAtomicLoad(&renderThread->Waiting) == 0) {
+			
+			return;
+		}
+		
+		PlatformMutexLock(&renderThread->Mutex);
+		PlatformConditionBroadcast(&renderThread->Changed);
+		PlatformMutexUnlock(&renderThread->Mutex);
+	}
+	
+	// Until queue holds count packets or the render thread is stopped. Waiting is raised before the queue is checked
+	// again and pushes check it after they publish, so either the waiter sees the packet or the pusher sees the waiter.
+	static void RenderThreadWait(RenderThread* renderThread, RenderPacketQueue* queue, u32 count) {
+		
+		for (u32 i = 0; i < RenderSpinCount; i++) {
+			
+			if (RenderQueueCount(queue) >= count) {
+				
+				return;
+			}
+			PlatformCpuRelax();
+		}
+		
+		PlatformMutexLock(&renderThread->Mutex);
+		PlatformAtomicAdd(&renderThread->Waiting, 1);
+		while (RenderQueueCount(queue) < count && PlatformAtomicLoad(&renderThread->Running)) {
+			
+			PlatformConditionWait(&renderThread->Changed, &renderThread->Mutex);
+		}
+		PlatformAtomicAdd(&renderThread->Waiting, (u32)-1);
+		PlatformMutexUnlock(&renderThread->Mutex);
+	}
+	
+	static void RenderThreadRender(RenderThread* renderThread, RenderPacket* packet) {
+		
+		VulkanState* state = renderThread->State;
+		f64 startTime = PlatformGetTime();
+		
+		if (packet->HasCullPlanes) {
+			
+			VulkanSetCullPlanes(state, packet->CullPlanes);
+		}
+		
+		bool complete = VulkanBeginFrame(state);
+		
+		// Latency counts from when the simulation began the packet, not from when it got here
+		state->Frame.InputTime = packet->InputTime;
+		
+		for (u32 i = 0; i < packet->DrawCount; i++) {
+			
+			VulkanSubmitDraw(state, packet->Draws + i);
+		}
+		complete &= VulkanEndFrame(state);
+		
+		u32 failedFrames = complete ? 0 : PlatformAtomicLoad(&renderThread->FailedFrames) + 1;
+		PlatformAtomicStore(&renderThread->FailedFrames, failedFrames);
+		
+		renderThread->FrameCount++;
+		renderThread->RenderTime += PlatformGetTime() - startTime;
+	}
+	
+	static void RenderThreadLoop(void* data) {
+		
+		RenderThread* renderThread = (RenderThread*)data;
+		
+		while (true) {
+			
+			// Only empty once stopped with nothing left to render
+			RenderThreadWait(renderThread, &renderThread->Filled, 1);
+			RenderPacket* packet = RenderQueuePop(&renderThread->Filled);
+			if (!packet) {
+				
+				break;
+			}
+			
+			if (PlatformAtomicLoad(&renderThread->FailedFrames) < RenderMaxFailedFrames) {
+				
+				RenderThreadRender(renderThread, packet);
+			}
+			
+			RenderQueuePush(&renderThread->Free, packet);
+			RenderThreadNotify(renderThread);
+		}
+	}
+	
+	bool RenderThreadStart(RenderThread* renderThread, VulkanState* state) {
+		
+		memset(renderThread, 0, sizeof(RenderThread));
+		renderThread->State = state;
+		renderThread->Running = 1;
+		
+		for (u32 i = 0; i < RenderPacketCount; i++) {
+			
+			RenderQueuePush(&renderThread->Free, renderThread->Packets + i);
+		}
+		
+		if (!PlatformMutexInit(&renderThread->Mutex) || !PlatformConditionInit(&renderThread->Changed)) {
+			
+			return false;
+		}
+		
+		state->DrawsOffWindowThread = true;
+		if (!PlatformThreadCreate(&renderThread->Thread, RenderThreadLoop, renderThread)) {
+			
+			state->DrawsOffWindowThread = false;
+			return false;
+		}
+		
+		return true;
+	}
+	
+	void RenderThreadStop(RenderThread* renderThread) {
+		
+		// The render thread checks Running under the mutex, it can't miss the broadcast
+		PlatformAtomicStore(&renderThread->Running, 0);
+		PlatformMutexLock(&renderThread->Mutex);
+		PlatformConditionBroadcast(&renderThread->Changed);
+		PlatformMutexUnlock(&renderThread->Mutex);
+		
+		PlatformThreadJoin(&renderThread->Thread);
+		renderThread->State->DrawsOffWindowThread = false;
+		
+		for (u32 i = 0; i < RenderPacketCount; i++) {
+			
+			free((renderThread->Packets + i)->Draws);
+		}
+		
+		PlatformConditionDestroy(&renderThread->Changed);
+		PlatformMutexDestroy(&renderThread->Mutex);
+	}
+	
+	void RenderThreadFlush(RenderThread* renderThread) {
+		
+		RenderThreadWait(renderThread, &renderThread->Free, RenderPacketCount - (renderThread->Current ? 1 : 0));
+	}
+	
+	RenderPacket* RenderThreadBeginPacket(RenderThread* renderThread) {
+		
+		if (renderThread->Current) {
+			
+			return renderThread->Current;
+		}
+		
+		RenderThreadWait(renderThread, &renderThread->Free, 1);
+		RenderPacket* packet = RenderQueuePop(&renderThread->Free);
+		
+		packet->DrawCount = 0;
+		packet->HasCullPlanes = false;
+		packet->InputTime = PlatformGetTime();
+		renderThread->Current = packet;
+		
+		return packet;
+	}
+	
+	void RenderPacketSubmitDraw(RenderPacket* packet, VulkanDraw* draw) {
+		
+		if (packet->DrawCount == packet->DrawCapacity) {
+			
+			u32 capacity = packet->DrawCapacity ? packet->DrawCapacity * 2 : 64;
+			VulkanDraw* draws = (VulkanDraw*)realloc(packet->Draws, capacity * sizeof(VulkanDraw));
+			
+			if (!draws) {
+				
+				return;
+			}
+			
+			packet->Draws = draws;
+			packet->DrawCapacity = capacity;
+		}
+		
+		packet->Draws[packet->DrawCount++] = *draw;
+	}
+	
+	void RenderPacketSetCullPlanes(RenderPacket* packet, Vector4* planes) {
+		
+		memcpy(packet->CullPlanes, planes, sizeof(packet->CullPlanes));
+		packet->HasCullPlanes = true;
+	}
+	
+	bool RenderThreadEndPacket(RenderThread* renderThread) {
+		
+		RenderQueuePush(&renderThread->Filled, renderThread->Current);
+		renderThread->Current = nullptr;
+		RenderThreadNotify(renderThread);
+		
+		return PlatformAtomicLoad(&renderThread->FailedFrames) < RenderMaxFailedFrames;
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef HANDMADE_RENDER_THREAD_H
+#define HANDMADE_RENDER_THREAD_H
+
+#include "handmade_types.h"
+#include "handmade_platform.h"
+#include "handmade_vulkan.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace handmade {
+	
+	// One packet is rendered while the other is built, the simulation runs at most one frame ahead
+	static const u32 RenderPacketCount = 2;
+	
+	// A resize or a frame that couldn't be recorded only fails that frame, this many in a row and rendering is given up
+	static const u32 RenderMaxFailedFrames = 16;
+	
+	// Everything the render thread needs for one frame. Once ended it belongs to the render thread and isn't touched
+	// until it comes back for another frame, the buffers and shaders its draws point at have to live that long.
+	struct RenderPacket {
+		
+		VulkanDraw* Draws;
+		u32 DrawCount;
+		u32 DrawCapacity;
+		
+		Vector4 CullPlanes[6];
+		bool HasCullPlanes;
+		
+		// When the packet was begun, input sampled for the frame counts towards its latency from here
+		f64 InputTime;
+	};
+	
+	// Bounded single producer single consumer ring, Head and Tail only grow and are masked into Slots
+	struct RenderPacketQueue {
+		
+		RenderPacket* Slots[RenderPacketCount];
+		volatile u32 Head;
+		volatile u32 Tail;
+	};
+	
+	// Owns the VulkanState while it runs, other threads may only call into it after RenderThreadFlush.
+	// Ended packets go through Filled to the render thread and back through Free, both queues are lock-free,
+	// the mutex only backs the wait of a side that found its queue empty.
+	struct RenderThread {
+		
+		VulkanState* State;
+		PlatformThread Thread;
+		
+		RenderPacket Packets[RenderPacketCount];
+		RenderPacketQueue Filled;
+		RenderPacketQueue Free;
+		RenderPacket* Current;
+		
+		PlatformMutex Mutex;
+		PlatformConditionVariable Changed;
+		volatile u32 Waiting;
+		volatile u32 Running;
+		// Frames failed in a row, reset by every frame that renders
+		volatile u32 FailedFrames;
+		
+		// Accumulated on the render thread, read them after RenderThreadFlush
+		u64 FrameCount;
+		f64 RenderTime;
+	};
+	
+	bool RenderThreadStart(RenderThread* renderThread, VulkanState* state);
+	// Renders the packets already ended, then gives the state back to the calling thread
+	void RenderThreadStop(RenderThread* renderThread);
+	// Waits until every ended packet is rendered
+	void RenderThreadFlush(RenderThread* renderThread);
+	
+	// Waits for a free packet, which is how the simulation is held back when it gets ahead of rendering
+	RenderPacket* RenderThreadBeginPacket(RenderThread* renderThread);
+	void RenderPacketSubmitDraw(RenderPacket* packet, VulkanDraw* draw);
+	void RenderPacketSetCullPlanes(RenderPacket* packet, Vector4* planes);
+	// Hands the packet to the render thread, false once RenderMaxFailedFrames frames in a row failed
+	bool RenderThreadEndPacket(RenderThread* renderThread);
+}
+
+#endif // HANDMADE_RENDER_THREAD_H
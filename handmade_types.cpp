@@ -21,4 +21,30 @@ namespace handmade {
 
 		return description;
 	}
+
+	InstancedVertexDescription VertexGetInstancedDescription() {
+
+		VertexDescription vertexDescription = VertexGetDescription();
+
+		InstancedVertexDescription description{};
+		description.Bindings[0] = vertexDescription.Binding;
+		description.Attributes[0] = vertexDescription.Attributes[0];
+		description.Attributes[1] = vertexDescription.Attributes[1];
+
+		description.Bindings[1].binding = 1;
+		description.Bindings[1].stride = sizeof(InstanceData);
+		description.Bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		description.Attributes[2].binding = 1;
+		description.Attributes[2].location = 2;
+		description.Attributes[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		description.Attributes[2].offset = offsetof(InstanceData, Translation);
+
+		description.Attributes[3].binding = 1;
+		description.Attributes[3].location = 3;
+		description.Attributes[3].format = VK_FORMAT_R32G32B32_SFLOAT;
+		description.Attributes[3].offset = offsetof(InstanceData, Color);
+
+		return description;
+	}
 }
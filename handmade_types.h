@@ -38,19 +38,43 @@ namespace handmade {
 		f32 Z;
 	};
 
+	struct Vector4 {
+
+		f32 X;
+		f32 Y;
+		f32 Z;
+		f32 W;
+	};
+
 	struct Vertex {
 
 		Vector3 Position;
 		Vector3 Color;
 	};
 
+	// Per instance data of instanced draws, Translation and Scale are read as one vec4
+	struct InstanceData {
+
+		Vector3 Translation;
+		f32 Scale;
+		Vector3 Color;
+	};
+
 	struct VertexDescription {
 
 		VkVertexInputBindingDescription Binding;
 		VkVertexInputAttributeDescription Attributes[2];
 	};
 
+	// Binding 0 advances per vertex like VertexDescription, binding 1 per instance
+	struct InstancedVertexDescription {
+
+		VkVertexInputBindingDescription Bindings[2];
+		VkVertexInputAttributeDescription Attributes[4];
+	};
+
 	VertexDescription VertexGetDescription();
+	InstancedVertexDescription VertexGetInstancedDescription();
 }
 
 #endif //HANDMADE_TYPES_H
@@ -10,7 +10,39 @@ namespace handmade {
 	
 	static const char* ValidationLayers[] = { "VK_LAYER_KHRONOS_validation" };
 	static const char* DeviceExtensions[] = { "VK_KHR_swapchain" };
-	static const u32 FramesInFlight = 2;
+	static const char* DrawIndirectCountExtension = "VK_KHR_draw_indirect_count";
+	
+	// Dynamic rendering and the extensions it depends on with a Vulkan 1.1 instance
+	static const char* DynamicRenderingExtensions[] = { "VK_KHR_dynamic_rendering", "VK_KHR_depth_stencil_resolve", "VK_KHR_create_renderpass2" };
+	static const VkDeviceSize StagingRingFrameSize = 4 * 1024 * 1024;
+	static const VkDeviceSize StagingRingAlignment = 16;
+	static const VkDeviceSize UploadBatchChunkSize = 16 * 1024 * 1024;
+	
+	static const char* PipelineCachePath = "pipeline_cache.bin";
+	static const u32 PipelineCacheMagic = 0x43504d48; // "HMPC"
+	static const u32 PipelineCacheVersion = 1;
+	static const u32 PipelineCompilerMaxThreads = 4;
+	
+	// Draw sort key, most significant first: pipeline, vertex buffer, index buffer, depth. Ids are recycled, so
+	// the key only aliases with more live variants or buffers than fit into its bits.
+	static const u32 DrawKeyPipelineBits = 12;
+	static const u32 DrawKeyVertexBufferBits = 14;
+	static const u32 DrawKeyIndexBufferBits = 14;
+	static const u32 DrawKeyDepthBits = 24;
+	
+	// Must match local_size_x of handmade_cull.comp
+	static const char* CullShaderPath = "assets/handmade_cull_comp.spv";
+	static const u32 CullGroupSize = 256;
+	static const u32 CullMaxSources = 256;
+	
+	// Must match local_size_x and local_size_y of handmade_depth_pyramid.comp
+	static const char* DepthPyramidShaderPath = "assets/handmade_depth_pyramid_comp.spv";
+	static const u32 DepthPyramidGroupSize = 8;
+	static const u32 DepthPyramidMaxSets = 128;
+	
+	// Uploaded buffers are read as vertex input and by the culling pass, which also writes the visibility buffers
+	static const VkPipelineStageFlags UploadReaderStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	static const VkAccessFlags UploadReaderAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 	
 	static bool VulkanCheckValidationLayerSupport() {
 		
@@ -63,21 +95,34 @@ namespace handmade {
 		createInfo.pApplicationInfo = &appInfo;
 		createInfo.enabledLayerCount = 0;
 		
+		// Headless rendering doesn't present, so it needs no surface extensions at all
+		const char* extensions[8]{};
+		u32 extensionCount = 0;
+		
+		if (!state->Headless) {
+			
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+			extensions[extensionCount++] = "VK_KHR_surface";
+			extensions[extensionCount++] = "VK_KHR_win32_surface";
+#else
+			u32 windowExtensionCount{};
+			const char** windowExtensions = glfwGetRequiredInstanceExtensions(&windowExtensionCount);
+			for (u32 i = 0; i < windowExtensionCount && extensionCount < ARRAY_SIZE(extensions) - 1; i++) {
+				
+				extensions[extensionCount++] = windowExtensions[i];
+			}
+#endif
+		}
+		
 		if (EnableValidationLayers) {
 			
-			const char* debugExtensions[] = { "VK_EXT_debug_utils", "VK_KHR_surface", "VK_KHR_win32_surface" };
-			createInfo.enabledExtensionCount = ARRAY_SIZE(debugExtensions);
-			createInfo.ppEnabledExtensionNames = debugExtensions;
+			extensions[extensionCount++] = "VK_EXT_debug_utils";
 			createInfo.enabledLayerCount = ARRAY_SIZE(ValidationLayers);
 			createInfo.ppEnabledLayerNames = ValidationLayers;
 		}
-		else {
-			
-			const char* extensions[] = { "VK_KHR_surface", "VK_KHR_win32_surface" };
-			createInfo.enabledExtensionCount = ARRAY_SIZE(extensions);
-			createInfo.ppEnabledExtensionNames = extensions;
-			createInfo.enabledLayerCount = 0;
-		}
+		
+		createInfo.enabledExtensionCount = extensionCount;
+		createInfo.ppEnabledExtensionNames = extensions;
 		
 		{
 			// Print the extensions
@@ -181,12 +226,21 @@ namespace handmade {
 	
 	static bool VulkanCreateSurface(VulkanState* state) {
 		
+		if (state->Headless) {
+			
+			return true;
+		}
+		
+#ifdef VK_USE_PLATFORM_WIN32_KHR
 		VkWin32SurfaceCreateInfoKHR createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 		createInfo.hwnd = glfwGetWin32Window(state->Window->NativeHandle);
 		createInfo.hinstance = GetModuleHandleA(nullptr);
 		
 		return vkCreateWin32SurfaceKHR(state->Instance, &createInfo, nullptr, &state->Surface) == VK_SUCCESS;
+#else
+		return glfwCreateWindowSurface(state->Instance, state->Window->NativeHandle, nullptr, &state->Surface) == VK_SUCCESS;
+#endif
 	}
 	
 	static VulkanQueueFamilyIndices VulkanFindQueueFamilies(VulkanState* state, VkPhysicalDevice* device) {
@@ -211,13 +265,22 @@ namespace handmade {
 					indices.GraphicsComplete = true;
 				}
 				
-				VkBool32 presentSupport{};
-				vkGetPhysicalDeviceSurfaceSupportKHR(*device, i, state->Surface, &presentSupport);
-				
-				if (presentSupport) {
+				// Without a surface there is nothing to present to, the graphics queue does all the work
+				if (state->Headless) {
+					
+					indices.PresentFamily = indices.GraphicsFamily;
+					indices.PresentComplete = indices.GraphicsComplete;
+				}
+				else {
 					
-					indices.PresentFamily = i;
-					indices.PresentComplete = true;
+					VkBool32 presentSupport{};
+					vkGetPhysicalDeviceSurfaceSupportKHR(*device, i, state->Surface, &presentSupport);
+					
+					if (presentSupport) {
+						
+						indices.PresentFamily = i;
+						indices.PresentComplete = true;
+					}
 				}
 				
 				if (indices.GraphicsComplete && indices.PresentComplete) {
@@ -225,12 +288,52 @@ namespace handmade {
 					break;
 				}
 			}
+			
+			// Prefer a family that can only transfer, those usually map to the copy engines
+			indices.TransferFamily = indices.GraphicsFamily;
+			indices.TransferDedicated = false;
+			
+			for (u32 i = 0; i < queueFamilyCount; i++) {
+				
+				VkQueueFlags flags = (queueFamilies + i)->queueFlags;
+				if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+					
+					if (!indices.TransferDedicated || !(flags & VK_QUEUE_COMPUTE_BIT)) {
+						
+						indices.TransferFamily = i;
+						indices.TransferDedicated = true;
+					}
+				}
+			}
 			free(queueFamilies);
 		}
 		
 		return indices;
 	}
 	
+	static bool VulkanHasDeviceExtension(VkPhysicalDevice* device, const char* name) {
+		
+		u32 extensionCount{};
+		vkEnumerateDeviceExtensionProperties(*device, nullptr, &extensionCount, nullptr);
+		
+		VkExtensionProperties* extensions = (VkExtensionProperties*)malloc(extensionCount * sizeof(VkExtensionProperties));
+		if (!extensions) {
+			
+			return false;
+		}
+		
+		vkEnumerateDeviceExtensionProperties(*device, nullptr, &extensionCount, extensions);
+		
+		bool found = false;
+		for (u32 i = 0; i < extensionCount && !found; i++) {
+			
+			found = strcmp((extensions + i)->extensionName, name) == 0;
+		}
+		free(extensions);
+		
+		return found;
+	}
+	
 	static bool VulkanCheckDeviceExtensionSupport(VkPhysicalDevice* device) {
 		
 		u32 extensionCount{};
@@ -294,6 +397,11 @@ namespace handmade {
 		
 		VulkanQueueFamilyIndices indices = VulkanFindQueueFamilies(state, device);
 		
+		if (state->Headless) {
+			
+			return indices.GraphicsComplete;
+		}
+		
 		bool extensions = VulkanCheckDeviceExtensionSupport(device);
 		bool swapChainAdequate{};
 		if (extensions) {
@@ -348,38 +456,95 @@ namespace handmade {
 		
 		VulkanQueueFamilyIndices indices = VulkanFindQueueFamilies(state, &state->PhysicalDevice);
 		
-		u32 createInfoCount = indices.GraphicsFamily != indices.PresentFamily ? 2 : 1;
+		u32 families[3] = { indices.GraphicsFamily, indices.PresentFamily, indices.TransferFamily };
+		u32 createInfoCount = 0;
 		VkDeviceQueueCreateInfo* createInfos{};
-		createInfos = (VkDeviceQueueCreateInfo*)malloc(createInfoCount * sizeof(VkDeviceQueueCreateInfo));
+		createInfos = (VkDeviceQueueCreateInfo*)malloc(ARRAY_SIZE(families) * sizeof(VkDeviceQueueCreateInfo));
 		
 		if (createInfos) {
 			
+			// One queue per distinct family
 			f32 queuePriority = 1.0f;
-			VkDeviceQueueCreateInfo queueCreateInfoGraphics{};
-			queueCreateInfoGraphics.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queueCreateInfoGraphics.queueFamilyIndex = indices.GraphicsFamily;
-			queueCreateInfoGraphics.queueCount = 1;
-			queueCreateInfoGraphics.pQueuePriorities = &queuePriority;
-			memcpy(&createInfos[0], &queueCreateInfoGraphics, sizeof(queueCreateInfoGraphics));
-			
-			if (createInfoCount == 2) {
+			for (u32 i = 0; i < ARRAY_SIZE(families); i++) {
+				
+				bool unique = true;
+				for (u32 j = 0; j < createInfoCount; j++) {
+					
+					unique &= createInfos[j].queueFamilyIndex != families[i];
+				}
 				
-				VkDeviceQueueCreateInfo queueCreateInfoPresent{};
-				queueCreateInfoGraphics.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-				queueCreateInfoGraphics.queueFamilyIndex = indices.PresentFamily;
-				queueCreateInfoGraphics.queueCount = 1;
-				queueCreateInfoGraphics.pQueuePriorities = &queuePriority;
-				memcpy(&createInfos[1], &queueCreateInfoPresent, sizeof(queueCreateInfoPresent));
+				if (unique) {
+					
+					VkDeviceQueueCreateInfo queueCreateInfo{};
+					queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+					queueCreateInfo.queueFamilyIndex = families[i];
+					queueCreateInfo.queueCount = 1;
+					queueCreateInfo.pQueuePriorities = &queuePriority;
+					memcpy(&createInfos[createInfoCount++], &queueCreateInfo, sizeof(queueCreateInfo));
+				}
 			}
 			
+			// Indirect draws need both features to take a whole batch with per draw firstInstance in one call
+			VkPhysicalDeviceFeatures supportedFeatures{};
+			vkGetPhysicalDeviceFeatures(state->PhysicalDevice, &supportedFeatures);
+			state->MultiDrawIndirect = supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance;
+			
 			VkPhysicalDeviceFeatures deviceFeatures{};
+			deviceFeatures.multiDrawIndirect = state->MultiDrawIndirect ? VK_TRUE : VK_FALSE;
+			deviceFeatures.drawIndirectFirstInstance = state->MultiDrawIndirect ? VK_TRUE : VK_FALSE;
+			
+			// Only frame stats use them, to count fragment shader invocations, in secondary command buffers as well
+			deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+			deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+			
+			const char* extensions[ARRAY_SIZE(DeviceExtensions) + 1 + ARRAY_SIZE(DynamicRenderingExtensions)]{};
+			u32 extensionCount = 0;
+			
+			if (!state->Headless) {
+				
+				for (u32 i = 0; i < ARRAY_SIZE(DeviceExtensions); i++) {
+					
+					extensions[extensionCount++] = DeviceExtensions[i];
+				}
+			}
+			
+			state->DrawIndirectCount = state->MultiDrawIndirect && VulkanHasDeviceExtension(&state->PhysicalDevice, DrawIndirectCountExtension);
+			if (state->DrawIndirectCount) {
+				
+				extensions[extensionCount++] = DrawIndirectCountExtension;
+			}
+			
+			VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+			dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+			
+			state->DynamicRendering = true;
+			for (u32 i = 0; i < ARRAY_SIZE(DynamicRenderingExtensions); i++) {
+				
+				state->DynamicRendering &= VulkanHasDeviceExtension(&state->PhysicalDevice, DynamicRenderingExtensions[i]);
+			}
+			
+			if (state->DynamicRendering) {
+				
+				VkPhysicalDeviceFeatures2 features2{};
+				features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+				features2.pNext = &dynamicRenderingFeatures;
+				vkGetPhysicalDeviceFeatures2(state->PhysicalDevice, &features2);
+				state->DynamicRendering = dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+			}
+			
+			for (u32 i = 0; state->DynamicRendering && i < ARRAY_SIZE(DynamicRenderingExtensions); i++) {
+				
+				extensions[extensionCount++] = DynamicRenderingExtensions[i];
+			}
+			
 			VkDeviceCreateInfo createInfo{};
 			createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 			createInfo.queueCreateInfoCount = createInfoCount;
 			createInfo.pQueueCreateInfos = createInfos;
 			createInfo.pEnabledFeatures = &deviceFeatures;
-			createInfo.enabledExtensionCount = ARRAY_SIZE(DeviceExtensions);
-			createInfo.ppEnabledExtensionNames = DeviceExtensions;
+			createInfo.enabledExtensionCount = extensionCount;
+			createInfo.ppEnabledExtensionNames = extensions;
+			createInfo.pNext = state->DynamicRendering ? &dynamicRenderingFeatures : nullptr;
 			
 			if (EnableValidationLayers) {
 				
@@ -397,6 +562,20 @@ namespace handmade {
 			
 			vkGetDeviceQueue(state->Device, indices.GraphicsFamily, 0, &state->GraphicsQueue);
 			vkGetDeviceQueue(state->Device, indices.PresentFamily, 0, &state->PresentQueue);
+			vkGetDeviceQueue(state->Device, indices.TransferFamily, 0, &state->TransferQueue);
+			
+			if (state->DrawIndirectCount) {
+				
+				state->CmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(state->Device, "vkCmdDrawIndexedIndirectCountKHR");
+				state->DrawIndirectCount = state->CmdDrawIndexedIndirectCount != nullptr;
+			}
+			
+			if (state->DynamicRendering) {
+				
+				state->CmdBeginRendering = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(state->Device, "vkCmdBeginRenderingKHR");
+				state->CmdEndRendering = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(state->Device, "vkCmdEndRenderingKHR");
+				state->DynamicRendering = state->CmdBeginRendering && state->CmdEndRendering;
+			}
 			
 			return true;
 		}
@@ -435,7 +614,7 @@ namespace handmade {
 		return VK_PRESENT_MODE_FIFO_KHR;
 	}
 	
-	static VkExtent2D VulkanChooseSwapExtent(VkSurfaceCapabilitiesKHR* capabilities, Window* window) {
+	static VkExtent2D VulkanChooseSwapExtent(VkSurfaceCapabilitiesKHR* capabilities, VulkanSwapChain* swapChain) {
 		
 		if (capabilities->currentExtent.width != UINT32_MAX) {
 			
@@ -443,13 +622,9 @@ namespace handmade {
 		}
 		else {
 			
-			i32 width{};
-			i32 height{};
-			glfwGetFramebufferSize(window->NativeHandle, &width, &height);
-			
 			VkExtent2D extent{};
-			extent.width = (u32)width;
-			extent.height = (u32)height;
+			extent.width = PlatformAtomicLoad(&swapChain->FramebufferWidth);
+			extent.height = PlatformAtomicLoad(&swapChain->FramebufferHeight);
 			
 			f32 minWidth = (f32)capabilities->minImageExtent.width;
 			f32 minHeight = (f32)capabilities->minImageExtent.height;
@@ -469,7 +644,7 @@ namespace handmade {
 		
 		VkSurfaceFormatKHR surfaceFormat = VulkanChooseSwapSurfaceFormat(swapChainSupport.Formats, swapChainSupport.FormatCount);
 		VkPresentModeKHR presentMode = VulkanChooseSwapPresentMode(swapChainSupport.PresentModes, swapChainSupport.PresentModeCount);
-		VkExtent2D extent = VulkanChooseSwapExtent(&swapChainSupport.Capabilities, state->Window);
+		VkExtent2D extent = VulkanChooseSwapExtent(&swapChainSupport.Capabilities, &state->SwapChain);
 		free(swapChainSupport.Formats);
 		free(swapChainSupport.PresentModes);
 		
@@ -507,7 +682,8 @@ namespace handmade {
 		createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE;
-		createInfo.oldSwapchain = VK_NULL_HANDLE;
+		// Still the previous swap chain while recreating, presentation carries on during the handoff
+		createInfo.oldSwapchain = state->SwapChain.SwapChain;
 		
 		VkResult result = vkCreateSwapchainKHR(state->Device, &createInfo, nullptr, &state->SwapChain.SwapChain);
 		if (result != VK_SUCCESS) {
@@ -533,6 +709,63 @@ namespace handmade {
 		}
 	}
 	
+	static bool VulkanCreateOffscreenImages(VulkanState* state) {
+		
+		// One image per frame in flight, so consecutive frames never render into the same target
+		u32 imageCount = state->FramesInFlight;
+		state->SwapChain.Images = (VkImage*)malloc(imageCount * sizeof(VkImage));
+		state->SwapChain.ImageAllocations = (VulkanAllocation*)calloc(imageCount, sizeof(VulkanAllocation));
+		state->SwapChain.ImageCount = imageCount;
+		state->SwapChain.ImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		
+		if (!state->SwapChain.Images || !state->SwapChain.ImageAllocations) {
+			
+			return false;
+		}
+		
+		bool complete = true;
+		for (u32 i = 0; i < imageCount; i++) {
+			
+			VkImage* image = (state->SwapChain.Images + i);
+			VulkanAllocation* imageAllocation = (state->SwapChain.ImageAllocations + i);
+			*image = VK_NULL_HANDLE;
+			
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = state->SwapChain.ImageFormat;
+			imageInfo.extent.width = state->SwapChain.Extent.width;
+			imageInfo.extent.height = state->SwapChain.Extent.height;
+			imageInfo.extent.depth = 1;
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			
+			if (vkCreateImage(state->Device, &imageInfo, nullptr, image) != VK_SUCCESS) {
+				
+				complete = false;
+				continue;
+			}
+			
+			VkMemoryRequirements memRequirements{};
+			vkGetImageMemoryRequirements(state->Device, *image, &memRequirements);
+			
+			if (!VulkanAllocate(&state->Allocator, &memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanMemoryPoolOptimal, imageAllocation)) {
+				
+				complete = false;
+				continue;
+			}
+			
+			vkBindImageMemory(state->Device, *image, imageAllocation->Memory, imageAllocation->Offset);
+		}
+		
+		return complete;
+	}
+	
 	static bool VulkanCreateImageViews(VulkanState* state) {
 		
 		state->SwapChain.ImageViews = (VkImageView*)malloc(state->SwapChain.ImageCount * sizeof(VkImageView));
@@ -582,104 +815,421 @@ namespace handmade {
 		return shaderModule;
 	}
 	
+	// Optimal tiling formats that can be rendered to and read back by the depth pyramid build
+	static bool VulkanPickDepthFormat(VulkanState* state) {
+		
+		VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+		VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		
+		for (u32 i = 0; i < ARRAY_SIZE(candidates); i++) {
+			
+			VkFormatProperties properties{};
+			vkGetPhysicalDeviceFormatProperties(state->PhysicalDevice, candidates[i], &properties);
+			
+			if ((properties.optimalTilingFeatures & features) == features) {
+				
+				state->SwapChain.DepthFormat = candidates[i];
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	static VkImageView VulkanCreateImageView(VulkanState* state, VkImage image, VkFormat format, VkImageAspectFlags aspect, u32 baseLevel, u32 levelCount) {
+		
+		VkImageViewCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		createInfo.image = image;
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		createInfo.format = format;
+		createInfo.subresourceRange.aspectMask = aspect;
+		createInfo.subresourceRange.baseMipLevel = baseLevel;
+		createInfo.subresourceRange.levelCount = levelCount;
+		createInfo.subresourceRange.baseArrayLayer = 0;
+		createInfo.subresourceRange.layerCount = 1;
+		
+		VkImageView view = VK_NULL_HANDLE;
+		if (vkCreateImageView(state->Device, &createInfo, nullptr, &view) != VK_SUCCESS) {
+			
+			return VK_NULL_HANDLE;
+		}
+		
+		return view;
+	}
+	
+	// Device local image with a view over all of its levels
+	static bool VulkanCreateImage(VulkanState* state, VulkanImage* image, VkExtent2D extent, u32 levelCount, VkSampleCountFlagBits samples, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect) {
+		
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = format;
+		imageInfo.extent.width = extent.width;
+		imageInfo.extent.height = extent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = samples;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		
+		if (vkCreateImage(state->Device, &imageInfo, nullptr, &image->Image) != VK_SUCCESS) {
+			
+			image->Image = VK_NULL_HANDLE;
+			return false;
+		}
+		
+		VkMemoryRequirements memRequirements{};
+		vkGetImageMemoryRequirements(state->Device, image->Image, &memRequirements);
+		
+		if (!VulkanAllocate(&state->Allocator, &memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanMemoryPoolOptimal, &image->Allocation)) {
+			
+			return false;
+		}
+		
+		vkBindImageMemory(state->Device, image->Image, image->Allocation.Memory, image->Allocation.Offset);
+		image->View = VulkanCreateImageView(state, image->Image, format, aspect, 0, levelCount);
+		
+		return image->View != VK_NULL_HANDLE;
+	}
+	
+	static void VulkanDestroyImage(VulkanState* state, VulkanImage* image) {
+		
+		vkDestroyImageView(state->Device, image->View, nullptr);
+		vkDestroyImage(state->Device, image->Image, nullptr);
+		VulkanFree(&state->Allocator, &image->Allocation);
+		memset(image, 0, sizeof(VulkanImage));
+	}
+	
+	// One depth buffer serves every swap chain image and is read by the depth pyramid build. Multisampled frames
+	// don't need one, their targets are transient images of the render graph.
+	static bool VulkanCreateDepthBuffer(VulkanState* state) {
+		
+		VulkanSwapChain* swapChain = &state->SwapChain;
+		if (swapChain->SampleCount != VK_SAMPLE_COUNT_1_BIT) {
+			
+			return true;
+		}
+		
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		return VulkanCreateImage(state, &swapChain->Depth, swapChain->Extent, 1, VK_SAMPLE_COUNT_1_BIT, swapChain->DepthFormat, usage, VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+	
+	// Only used to build pipelines, the render graph creates the render passes it begins. Those declare color, depth
+	// and resolve attachments in the same order and formats, which is all render pass compatibility asks for.
+	// Dynamic rendering needs none at all.
 	static bool VulkanCreateRenderPass(VulkanState* state) {
 		
+		if (state->DynamicRendering) {
+			
+			return true;
+		}
+		
+		VkSampleCountFlagBits samples = state->SwapChain.SampleCount;
+		bool multisampled = samples != VK_SAMPLE_COUNT_1_BIT;
+		
 		VkAttachmentDescription colorAttachment{};
 		colorAttachment.format = state->SwapChain.ImageFormat;
-		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.samples = samples;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		
+		VkAttachmentDescription depthAttachment = colorAttachment;
+		depthAttachment.format = state->SwapChain.DepthFormat;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		
+		VkAttachmentDescription resolveAttachment = colorAttachment;
+		resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		
+		VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment, resolveAttachment };
 		
 		VkAttachmentReference colorAttachmentRef{};
 		colorAttachmentRef.attachment = 0;
 		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 		
+		VkAttachmentReference depthAttachmentRef{};
+		depthAttachmentRef.attachment = 1;
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		
+		VkAttachmentReference resolveAttachmentRef{};
+		resolveAttachmentRef.attachment = 2;
+		resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		
 		VkSubpassDescription subpass{};
 		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 		subpass.colorAttachmentCount = 1;
 		subpass.pColorAttachments = &colorAttachmentRef;
-		
-		VkSubpassDependency dependency{};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		subpass.pResolveAttachments = multisampled ? &resolveAttachmentRef : nullptr;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
 		
 		VkRenderPassCreateInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.attachmentCount = 1;
-		renderPassInfo.pAttachments = &colorAttachment;
+		renderPassInfo.attachmentCount = multisampled ? 3 : 2;
+		renderPassInfo.pAttachments = attachments;
 		renderPassInfo.subpassCount = 1;
 		renderPassInfo.pSubpasses = &subpass;
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
 		
 		return vkCreateRenderPass(state->Device, &renderPassInfo, nullptr, &state->Pipeline.RenderPass) == VK_SUCCESS;
 	}
 	
-	static bool VulkanCreateGraphicsPipeline(VulkanState* state) {
+	static void VulkanDestroyRenderPass(VulkanState* state) {
+		
+		vkDestroyRenderPass(state->Device, state->Pipeline.RenderPass, nullptr);
+		state->Pipeline.RenderPass = VK_NULL_HANDLE;
+	}
+	
+	// FNV-1a
+	static u64 VulkanHashBytes(const void* data, u64 size, u64 hash = 14695981039346656037ull) {
+		
+		const u8* bytes = (const u8*)data;
+		for (u64 i = 0; i < size; i++) {
+			
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		
+		return hash;
+	}
+	
+	static u32 VulkanAcquireId(VulkanIdPool* pool) {
+		
+		PlatformMutexLock(&pool->Mutex);
+		u32 id = pool->FreeCount ? pool->Free[--pool->FreeCount] : pool->Next++;
+		PlatformMutexUnlock(&pool->Mutex);
+		
+		return id;
+	}
+	
+	// An id that doesn't fit on the free list is never handed out again, that only wastes one
+	static void VulkanReleaseId(VulkanIdPool* pool, u32 id) {
+		
+		PlatformMutexLock(&pool->Mutex);
+		if (pool->FreeCount == pool->FreeCapacity) {
+			
+			u32 capacity = pool->FreeCapacity ? pool->FreeCapacity * 2 : 64;
+			u32* ids = (u32*)realloc(pool->Free, capacity * sizeof(u32));
+			
+			if (ids) {
+				
+				pool->Free = ids;
+				pool->FreeCapacity = capacity;
+			}
+		}
+		
+		if (pool->FreeCount < pool->FreeCapacity) {
+			
+			pool->Free[pool->FreeCount++] = id;
+		}
+		PlatformMutexUnlock(&pool->Mutex);
+	}
+	
+	static void VulkanDestroyIdPool(VulkanIdPool* pool) {
+		
+		free(pool->Free);
+		pool->Free = nullptr;
+		pool->FreeCount = 0;
+		pool->FreeCapacity = 0;
+		PlatformMutexDestroy(&pool->Mutex);
+	}
+	
+	static void VulkanFillPipelineCacheHeader(VulkanState* state, VulkanPipelineCacheHeader* header) {
+		
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(state->PhysicalDevice, &properties);
+		
+		*header = {};
+		header->Magic = PipelineCacheMagic;
+		header->Version = PipelineCacheVersion;
+		header->VendorID = properties.vendorID;
+		header->DeviceID = properties.deviceID;
+		header->DriverVersion = properties.driverVersion;
+		memcpy(header->PipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+		
+		// The driver UUID needs a 1.1 device, on 1.0 the pipeline cache UUID has to do
+		if (properties.apiVersion >= VK_API_VERSION_1_1) {
+			
+			VkPhysicalDeviceIDProperties idProperties{};
+			idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+			
+			VkPhysicalDeviceProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties2.pNext = &idProperties;
+			
+			vkGetPhysicalDeviceProperties2(state->PhysicalDevice, &properties2);
+			memcpy(header->DriverUUID, idProperties.driverUUID, VK_UUID_SIZE);
+		}
+	}
+	
+	static bool VulkanCreatePipelineCache(VulkanState* state) {
+		
+		VulkanPipelineCacheHeader expected{};
+		VulkanFillPipelineCacheHeader(state, &expected);
+		
+		u8* fileData = nullptr;
+		u64 fileSize = 0;
+		
+		FILE* file = fopen(PipelineCachePath, "rb");
+		if (file) {
+			
+			fseek(file, 0, SEEK_END);
+			fileSize = (u64)ftell(file);
+			fseek(file, 0, SEEK_SET);
+			
+			fileData = (u8*)malloc(fileSize);
+			if (fileData && fread(fileData, 1, (size_t)fileSize, file) != fileSize) {
+				
+				free(fileData);
+				fileData = nullptr;
+			}
+			
+			fclose(file);
+		}
+		
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		state->PipelineCacheWarm = false;
+		
+		if (fileData && fileSize >= sizeof(VulkanPipelineCacheHeader)) {
+			
+			VulkanPipelineCacheHeader header{};
+			memcpy(&header, fileData, sizeof(header));
+			
+			u8* data = fileData + sizeof(header);
+			u64 dataSize = fileSize - sizeof(header);
+			
+			bool valid = header.Magic == expected.Magic && header.Version == expected.Version;
+			valid &= header.VendorID == expected.VendorID && header.DeviceID == expected.DeviceID && header.DriverVersion == expected.DriverVersion;
+			valid &= memcmp(header.PipelineCacheUUID, expected.PipelineCacheUUID, VK_UUID_SIZE) == 0;
+			valid &= memcmp(header.DriverUUID, expected.DriverUUID, VK_UUID_SIZE) == 0;
+			valid &= header.DataSize == dataSize && header.DataHash == VulkanHashBytes(data, dataSize);
+			
+			if (valid) {
+				
+				cacheInfo.initialDataSize = (size_t)dataSize;
+				cacheInfo.pInitialData = data;
+				state->PipelineCacheWarm = true;
+			}
+			else {
+				
+				fprintf(stderr, "[Vulkan] - Ignoring stale or corrupt %s\n", PipelineCachePath);
+			}
+		}
+		
+		VkResult result = vkCreatePipelineCache(state->Device, &cacheInfo, nullptr, &state->PipelineCache);
+		
+		// Drivers may still reject data that passed our checks, start empty then
+		if (result != VK_SUCCESS && state->PipelineCacheWarm) {
+			
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+			state->PipelineCacheWarm = false;
+			result = vkCreatePipelineCache(state->Device, &cacheInfo, nullptr, &state->PipelineCache);
+		}
+		
+		free(fileData);
+		
+		return result == VK_SUCCESS;
+	}
+	
+	static bool VulkanSavePipelineCache(VulkanState* state) {
+		
+		size_t dataSize = 0;
+		if (vkGetPipelineCacheData(state->Device, state->PipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		u8* fileData = (u8*)malloc(sizeof(VulkanPipelineCacheHeader) + dataSize);
+		if (!fileData) {
+			
+			return false;
+		}
+		
+		u8* data = fileData + sizeof(VulkanPipelineCacheHeader);
+		bool result = vkGetPipelineCacheData(state->Device, state->PipelineCache, &dataSize, data) == VK_SUCCESS;
+		
+		if (result) {
+			
+			VulkanPipelineCacheHeader header{};
+			VulkanFillPipelineCacheHeader(state, &header);
+			header.DataSize = dataSize;
+			header.DataHash = VulkanHashBytes(data, dataSize);
+			memcpy(fileData, &header, sizeof(header));
+			
+			result = PlatformWriteFileAtomic(PipelineCachePath, fileData, sizeof(header) + dataSize);
+		}
+		
+		free(fileData);
+		
+		return result;
+	}
+	
+	static bool VulkanCreateGraphicsPipeline(VulkanState* state, VulkanPipelineDescription* description, VkPipeline* pipeline) {
 		
 		VkPipelineShaderStageCreateInfo vertexShaderStageInfo{};
 		vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		vertexShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertexShaderStageInfo.module = state->Shader.VertexShader;
+		vertexShaderStageInfo.module = description->VertexShader;
 		vertexShaderStageInfo.pName = "main";
 		
 		VkPipelineShaderStageCreateInfo fragmentShaderStageInfo{};
 		fragmentShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		fragmentShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragmentShaderStageInfo.module = state->Shader.FragmentShader;
+		fragmentShaderStageInfo.module = description->FragmentShader;
 		fragmentShaderStageInfo.pName = "main";
 		
 		VkPipelineShaderStageCreateInfo shaderStages[2] = { vertexShaderStageInfo, fragmentShaderStageInfo };
 		
 		VertexDescription vertexDescription = VertexGetDescription();
+		InstancedVertexDescription instancedDescription = VertexGetInstancedDescription();
 		
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.vertexAttributeDescriptionCount = ARRAY_SIZE(vertexDescription.Attributes);
-		vertexInputInfo.pVertexBindingDescriptions = &vertexDescription.Binding;
-		vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.Attributes;
 		
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssembly.primitiveRestartEnable = VK_FALSE;
-		
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (f32)state->SwapChain.Extent.width;
-		viewport.height = (f32)state->SwapChain.Extent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
+		if (description->Instanced) {
+			
+			vertexInputInfo.vertexBindingDescriptionCount = ARRAY_SIZE(instancedDescription.Bindings);
+			vertexInputInfo.vertexAttributeDescriptionCount = ARRAY_SIZE(instancedDescription.Attributes);
+			vertexInputInfo.pVertexBindingDescriptions = instancedDescription.Bindings;
+			vertexInputInfo.pVertexAttributeDescriptions = instancedDescription.Attributes;
+		}
+		else {
+			
+			vertexInputInfo.vertexBindingDescriptionCount = 1;
+			vertexInputInfo.vertexAttributeDescriptionCount = ARRAY_SIZE(vertexDescription.Attributes);
+			vertexInputInfo.pVertexBindingDescriptions = &vertexDescription.Binding;
+			vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.Attributes;
+		}
 		
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = state->SwapChain.Extent;
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssembly.topology = description->Topology;
+		inputAssembly.primitiveRestartEnable = VK_FALSE;
 		
+		// Viewport and scissor are set while recording, so pipelines survive a resize
 		VkPipelineViewportStateCreateInfo viewportState{};
 		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
+		viewportState.pViewports = nullptr;
 		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
+		viewportState.pScissors = nullptr;
 		
 		VkPipelineRasterizationStateCreateInfo rasterizer{};
 		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 		rasterizer.depthClampEnable = VK_FALSE;
 		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.polygonMode = description->PolygonMode;
 		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		rasterizer.cullMode = description->CullMode;
+		rasterizer.frontFace = description->FrontFace;
 		rasterizer.depthBiasEnable = VK_FALSE;
 		rasterizer.depthBiasConstantFactor = 0.0f;
 		rasterizer.depthBiasClamp = 0.0f;
@@ -688,19 +1238,15 @@ namespace handmade {
 		VkPipelineMultisampleStateCreateInfo multisampling{};
 		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		multisampling.rasterizationSamples = description->Samples;
 		multisampling.minSampleShading = 1.0f;
 		multisampling.pSampleMask = nullptr;
 		multisampling.alphaToCoverageEnable = VK_FALSE;
 		multisampling.alphaToOneEnable = VK_FALSE;
 		
 		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = 
-			VK_COLOR_COMPONENT_R_BIT |
-			VK_COLOR_COMPONENT_G_BIT |
-			VK_COLOR_COMPONENT_B_BIT |
-			VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
+		colorBlendAttachment.colorWriteMask = description->ColorWriteMask;
+		colorBlendAttachment.blendEnable = description->BlendEnable;
 		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
 		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
 		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
@@ -719,13 +1265,55 @@ namespace handmade {
 		colorBlending.blendConstants[2] = 0.0f; // Optional
 		colorBlending.blendConstants[3] = 0.0f; // Optional
 		
-		VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_LINE_WIDTH };
+		// Equal depth passes, so coplanar draws keep the order they were recorded in
+		VkPipelineDepthStencilStateCreateInfo depthStencil{};
+		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthStencil.depthTestEnable = description->DepthTestEnable;
+		depthStencil.depthWriteEnable = description->DepthWriteEnable;
+		depthStencil.depthCompareOp = description->DepthCompareOp;
+		depthStencil.depthBoundsTestEnable = VK_FALSE;
+		depthStencil.stencilTestEnable = VK_FALSE;
+		
+		VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 		
 		VkPipelineDynamicStateCreateInfo dynamicState{};
 		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
 		dynamicState.dynamicStateCount = ARRAY_SIZE(dynamicStates);
 		dynamicState.pDynamicStates = dynamicStates;
 		
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = description->FragmentShader ? 2 : 1;
+		pipelineInfo.pStages = shaderStages;
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &inputAssembly;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pRasterizationState = &rasterizer;
+		pipelineInfo.pMultisampleState = &multisampling;
+		pipelineInfo.pDepthStencilState = &depthStencil;
+		pipelineInfo.pColorBlendState = &colorBlending;
+		pipelineInfo.pDynamicState = &dynamicState;
+		pipelineInfo.layout = state->Pipeline.PipeLineLayout;
+		pipelineInfo.renderPass = description->RenderPass;
+		pipelineInfo.subpass = 0;
+		
+		VkPipelineRenderingCreateInfoKHR renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachmentFormats = &description->ColorFormat;
+		renderingInfo.depthAttachmentFormat = description->DepthFormat;
+		renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+		pipelineInfo.pNext = description->RenderPass ? nullptr : &renderingInfo;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineInfo.basePipelineIndex = -1;
+		
+		VkResult pipelineResult = vkCreateGraphicsPipelines(state->Device, state->PipelineCache, 1, &pipelineInfo, nullptr, pipeline);
+		
+		return pipelineResult == VK_SUCCESS;
+	}
+	
+	static bool VulkanCreatePipelineLayout(VulkanState* state) {
+		
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = 0;
@@ -733,355 +1321,2785 @@ namespace handmade {
 		pipelineLayoutInfo.pushConstantRangeCount = 0;
 		pipelineLayoutInfo.pPushConstantRanges = nullptr;
 		
-		VkResult pipelineLayoutResult = vkCreatePipelineLayout(state->Device, &pipelineLayoutInfo, nullptr, &state->Pipeline.PipeLineLayout);
-		
-		if (pipelineLayoutResult == VK_SUCCESS) {
-			
-			VkGraphicsPipelineCreateInfo pipelineInfo{};
-			pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineInfo.stageCount = 2;
-			pipelineInfo.pStages = shaderStages;
-			pipelineInfo.pVertexInputState = &vertexInputInfo;
-			pipelineInfo.pInputAssemblyState = &inputAssembly;
-			pipelineInfo.pViewportState = &viewportState;
-			pipelineInfo.pRasterizationState = &rasterizer;
-			pipelineInfo.pMultisampleState = &multisampling;
-			pipelineInfo.pDepthStencilState = nullptr;
-			pipelineInfo.pColorBlendState = &colorBlending;
-			pipelineInfo.pDynamicState = nullptr;
-			pipelineInfo.layout = state->Pipeline.PipeLineLayout;
-			pipelineInfo.renderPass = state->Pipeline.RenderPass;
-			pipelineInfo.subpass = 0;
-			pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-			pipelineInfo.basePipelineIndex = -1;
-			
-			VkResult pipelineResult = vkCreateGraphicsPipelines(state->Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &state->Pipeline.GraphicsPipeline);
+		return vkCreatePipelineLayout(state->Device, &pipelineLayoutInfo, nullptr, &state->Pipeline.PipeLineLayout) == VK_SUCCESS;
+	}
+	
+	static void VulkanDescribePipeline(VulkanState* state, VulkanShader* shader, VulkanPipelineDescription* description) {
+		
+		// Padding takes part in the hash, so the whole struct is cleared first
+		memset(description, 0, sizeof(VulkanPipelineDescription));
+		description->VertexShader = shader->VertexShader;
+		description->FragmentShader = shader->FragmentShader;
+		description->RenderPass = state->Pipeline.RenderPass;
+		description->ColorFormat = state->SwapChain.ImageFormat;
+		description->DepthFormat = state->SwapChain.DepthFormat;
+		description->Topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		description->PolygonMode = VK_POLYGON_MODE_FILL;
+		description->CullMode = VK_CULL_MODE_BACK_BIT;
+		description->FrontFace = VK_FRONT_FACE_CLOCKWISE;
+		description->BlendEnable = VK_FALSE;
+		description->Instanced = shader->Instanced ? VK_TRUE : VK_FALSE;
+		description->DepthTestEnable = VK_TRUE;
+		description->DepthWriteEnable = VK_TRUE;
+		description->DepthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		description->ColorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		description->Samples = state->SwapChain.SampleCount;
+		
+		// The prepass already wrote the final depth, fragments that lost against it are rejected before shading
+		if (state->DepthPrepass) {
 			
-			return pipelineResult == VK_SUCCESS;
+			description->DepthWriteEnable = VK_FALSE;
+			description->DepthCompareOp = VK_COMPARE_OP_EQUAL;
+			description->DepthPrepass = VK_TRUE;
 		}
-		
-		return false;
 	}
 	
-	static bool VulkanCreateFramebuffers(VulkanState* state) {
+	// The depth pipeline has no fragment stage, the prepass writes depth without a single fragment shader invocation
+	static bool VulkanCreatePipelineVariant(VulkanState* state, VulkanPipelineVariant* variant) {
 		
-		state->SwapChain.Framebuffers = (VkFramebuffer*)malloc(state->SwapChain.ImageViewCount * sizeof(VkFramebuffer));
-		state->SwapChain.FramebufferCount = state->SwapChain.ImageViewCount;
-		
-		if (state->SwapChain.Framebuffers) {
-			
-			bool complete = true;
-			for (u32 i = 0; i < state->SwapChain.ImageViewCount; i++) {
-				
-				VkImageView* imageView = (state->SwapChain.ImageViews + i);
-				VkFramebufferCreateInfo framebufferInfo{};
-				framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-				framebufferInfo.renderPass = state->Pipeline.RenderPass;
-				framebufferInfo.attachmentCount = 1;
-				framebufferInfo.pAttachments = imageView;
-				framebufferInfo.width = state->SwapChain.Extent.width;
-				framebufferInfo.height = state->SwapChain.Extent.height;
-				framebufferInfo.layers = 1;
-				
-				if (vkCreateFramebuffer(state->Device, &framebufferInfo, nullptr, &state->SwapChain.Framebuffers[i]) != VK_SUCCESS) {
-					
-					complete = false;
-				}
-			}
-			
-			return complete;
-		}
-		else {
+		if (!VulkanCreateGraphicsPipeline(state, &variant->Description, &variant->Pipeline)) {
 			
 			return false;
 		}
-	}// NOTE(Elias): 
-	
-	static bool VulkanCreateCommandPool(VulkanState* state) {
 		
-		VulkanQueueFamilyIndices queueFamilyIndices = VulkanFindQueueFamilies(state, &state->PhysicalDevice);
+		if (!variant->Description.DepthPrepass) {
+			
+			return true;
+		}
 		
-		VkCommandPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		poolInfo.queueFamilyIndex = queueFamilyIndices.GraphicsFamily;
+		VulkanPipelineDescription depthDescription = variant->Description;
+		depthDescription.FragmentShader = VK_NULL_HANDLE;
+		depthDescription.DepthWriteEnable = VK_TRUE;
+		depthDescription.DepthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		depthDescription.ColorWriteMask = 0;
+		depthDescription.DepthPrepass = VK_FALSE;
 		
-		return vkCreateCommandPool(state->Device, &poolInfo, nullptr, &state->CommandPool) == VK_SUCCESS;
+		return VulkanCreateGraphicsPipeline(state, &depthDescription, &variant->DepthPipeline);
 	}
 	
-	static u32 VulkanFindMemoryType(VulkanState* state, u32 typeFilter, VkMemoryPropertyFlags properties) {
+	static void VulkanPipelineCompilerWorker(void* data) {
 		
-		VkPhysicalDeviceMemoryProperties memProperties{};
-		vkGetPhysicalDeviceMemoryProperties(state->PhysicalDevice, &memProperties);
+		VulkanState* state = (VulkanState*)data;
+		VulkanPipelineCompiler* compiler = &state->Pipeline.Compiler;
 		
-		for (u32 i = 0; i < memProperties.memoryTypeCount; i++) {
+		PlatformMutexLock(&compiler->Mutex);
+		while (true) {
+			
+			while (compiler->Running && compiler->QueueCount == 0) {
+				
+				PlatformConditionWait(&compiler->WorkAvailable, &compiler->Mutex);
+			}
 			
-			if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			if (!compiler->Running) {
 				
-				return i + 1;
+				break;
 			}
+			
+			VulkanPipelineVariant* variant = compiler->Queue[compiler->QueueHead];
+			compiler->QueueHead = (compiler->QueueHead + 1) % compiler->QueueCapacity;
+			compiler->QueueCount--;
+			compiler->ActiveCount++;
+			PlatformMutexUnlock(&compiler->Mutex);
+			
+			// The pipeline cache synchronizes internally, workers compile in parallel
+			bool created = VulkanCreatePipelineVariant(state, variant);
+			PlatformAtomicStore(&variant->Status, created ? VulkanPipelineReady : VulkanPipelineFailed);
+			
+			PlatformMutexLock(&compiler->Mutex);
+			compiler->ActiveCount--;
+			PlatformConditionBroadcast(&compiler->WorkDone);
 		}
-		
-		return 0;
+		PlatformMutexUnlock(&compiler->Mutex);
 	}
 	
-	static bool VulkanCreateBuffer(VulkanState* state, VulkanBuffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
-		
-		VkBufferCreateInfo bufferInfo{};
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size = size;
-		bufferInfo.usage = usage;
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		
-		if (vkCreateBuffer(state->Device, &bufferInfo, nullptr, &buffer->Buffer) != VK_SUCCESS) {
+	static bool VulkanCreatePipelineCompiler(VulkanState* state) {
+		
+		VulkanPipelineCompiler* compiler = &state->Pipeline.Compiler;
+		
+		// Leave one core to the frame loop
+		u32 processorCount = PlatformGetProcessorCount();
+		compiler->ThreadCount = processorCount > 1 ? processorCount - 1 : 1;
+		compiler->ThreadCount = compiler->ThreadCount < PipelineCompilerMaxThreads ? compiler->ThreadCount : PipelineCompilerMaxThreads;
+		compiler->Threads = (PlatformThread*)calloc(compiler->ThreadCount, sizeof(PlatformThread));
+		compiler->QueueCapacity = 64;
+		compiler->QueueHead = 0;
+		compiler->QueueCount = 0;
+		compiler->ActiveCount = 0;
+		compiler->Queue = (VulkanPipelineVariant**)malloc(compiler->QueueCapacity * sizeof(VulkanPipelineVariant*));
+		compiler->Running = true;
+		
+		if (!compiler->Threads || !compiler->Queue) {
 			
 			return false;
 		}
 		
-		VkMemoryRequirements memRequirements{};
-		vkGetBufferMemoryRequirements(state->Device, buffer->Buffer, &memRequirements);
-		
-		u32 memoryTypeIndex = VulkanFindMemoryType(state, memRequirements.memoryTypeBits, properties);
+		bool complete = PlatformMutexInit(&compiler->Mutex);
+		complete &= PlatformConditionInit(&compiler->WorkAvailable);
+		complete &= PlatformConditionInit(&compiler->WorkDone);
 		
-		if (memoryTypeIndex == 0) {
+		for (u32 i = 0; complete && i < compiler->ThreadCount; i++) {
 			
-			return false;
+			complete &= PlatformThreadCreate(compiler->Threads + i, VulkanPipelineCompilerWorker, state);
 		}
 		
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = memoryTypeIndex - 1;
+		return complete;
+	}
+	
+	static void VulkanDestroyPipelineCompiler(VulkanState* state) {
+		
+		VulkanPipelineCompiler* compiler = &state->Pipeline.Compiler;
 		
-		if (vkAllocateMemory(state->Device, &allocInfo, nullptr, &buffer->BufferMemory) != VK_SUCCESS) {
+		// Requests still queued are dropped, their variants stay pending and are destroyed with the table
+		PlatformMutexLock(&compiler->Mutex);
+		compiler->Running = false;
+		PlatformConditionBroadcast(&compiler->WorkAvailable);
+		PlatformMutexUnlock(&compiler->Mutex);
+		
+		for (u32 i = 0; i < compiler->ThreadCount; i++) {
 			
-			return false;
+			PlatformThreadJoin(compiler->Threads + i);
 		}
 		
-		vkBindBufferMemory(state->Device, buffer->Buffer, buffer->BufferMemory, 0);
-		
-		return true;
+		PlatformConditionDestroy(&compiler->WorkDone);
+		PlatformConditionDestroy(&compiler->WorkAvailable);
+		PlatformMutexDestroy(&compiler->Mutex);
+		free(compiler->Threads);
+		free(compiler->Queue);
+		compiler->Threads = nullptr;
+		compiler->Queue = nullptr;
+		compiler->ThreadCount = 0;
 	}
 	
-	static bool VulkanCopyBuffer(VulkanState* state, VkBuffer source, VkBuffer destination, VkDeviceSize size) {
-		
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = state->CommandPool;
-		allocInfo.commandBufferCount = 1;
+	static bool VulkanQueuePipelineVariant(VulkanState* state, VulkanPipelineVariant* variant) {
 		
-		VkCommandBuffer commandBuffer{};
-		vkAllocateCommandBuffers(state->Device, &allocInfo, &commandBuffer);
+		VulkanPipelineCompiler* compiler = &state->Pipeline.Compiler;
 		
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		PlatformMutexLock(&compiler->Mutex);
 		
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		if (compiler->QueueCount == compiler->QueueCapacity) {
+			
+			u32 capacity = compiler->QueueCapacity * 2;
+			VulkanPipelineVariant** queue = (VulkanPipelineVariant**)malloc(capacity * sizeof(VulkanPipelineVariant*));
+			
+			if (!queue) {
+				
+				PlatformMutexUnlock(&compiler->Mutex);
+				return false;
+			}
+			
+			for (u32 i = 0; i < compiler->QueueCount; i++) {
+				
+				queue[i] = compiler->Queue[(compiler->QueueHead + i) % compiler->QueueCapacity];
+			}
+			free(compiler->Queue);
+			
+			compiler->Queue = queue;
+			compiler->QueueHead = 0;
+			compiler->QueueCapacity = capacity;
+		}
 		
-		VkBufferCopy copyRegion{};
-		copyRegion.srcOffset = 0;
-		copyRegion.dstOffset = 0;
-		copyRegion.size = size;
-		vkCmdCopyBuffer(commandBuffer, source, destination, 1, &copyRegion);
+		compiler->Queue[(compiler->QueueHead + compiler->QueueCount) % compiler->QueueCapacity] = variant;
+		compiler->QueueCount++;
+		PlatformConditionSignal(&compiler->WorkAvailable);
 		
-		vkEndCommandBuffer(commandBuffer);
+		PlatformMutexUnlock(&compiler->Mutex);
 		
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
+		return true;
+	}
+	
+	// Blocks until every queued request has been compiled
+	static void VulkanWaitPipelineCompiler(VulkanState* state) {
 		
-		vkQueueSubmit(state->GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(state->GraphicsQueue);
+		VulkanPipelineCompiler* compiler = &state->Pipeline.Compiler;
 		
-		vkFreeCommandBuffers(state->Device, state->CommandPool, 1, &commandBuffer);
+		if (compiler->ThreadCount == 0) {
+			
+			return;
+		}
 		
-		return true;
+		PlatformMutexLock(&compiler->Mutex);
+		while (compiler->Running && (compiler->QueueCount > 0 || compiler->ActiveCount > 0)) {
+			
+			PlatformConditionWait(&compiler->WorkDone, &compiler->Mutex);
+		}
+		PlatformMutexUnlock(&compiler->Mutex);
 	}
 	
-	static bool VulkanCreateCommandBuffers(VulkanState* state) {
+	static bool VulkanInsertPipelineVariant(VulkanPipeline* pipeline, VulkanPipelineVariant* variant) {
 		
-		state->CommandBuffers = (VkCommandBuffer*)malloc(FramesInFlight * sizeof(VkCommandBuffer));
-		state->CommandBufferCount = FramesInFlight;
-		
-		if (state->CommandBuffers) {
+		// Keep the load below 3/4 so probe sequences stay short
+		if ((pipeline->VariantCount + 1) * 4 > pipeline->VariantCapacity * 3) {
 			
-			VkCommandBufferAllocateInfo allocInfo{};
-			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-			allocInfo.commandPool = state->CommandPool;
-			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-			allocInfo.commandBufferCount = state->CommandBufferCount;
+			u32 capacity = pipeline->VariantCapacity ? pipeline->VariantCapacity * 2 : 16;
+			VulkanPipelineVariant** variants = (VulkanPipelineVariant**)calloc(capacity, sizeof(VulkanPipelineVariant*));
 			
-			return vkAllocateCommandBuffers(state->Device, &allocInfo, state->CommandBuffers) == VK_SUCCESS;
+			if (!variants) {
+				
+				return false;
+			}
+			
+			VulkanPipelineVariant** oldVariants = pipeline->Variants;
+			u32 oldCapacity = pipeline->VariantCapacity;
+			
+			pipeline->Variants = variants;
+			pipeline->VariantCapacity = capacity;
+			pipeline->VariantCount = 0;
+			
+			for (u32 i = 0; i < oldCapacity; i++) {
+				
+				if (oldVariants[i]) {
+					
+					VulkanInsertPipelineVariant(pipeline, oldVariants[i]);
+				}
+			}
+			free(oldVariants);
 		}
-		else {
+		
+		u32 mask = pipeline->VariantCapacity - 1;
+		for (u32 i = (u32)variant->Hash & mask; ; i = (i + 1) & mask) {
 			
-			return false;
+			if (!pipeline->Variants[i]) {
+				
+				pipeline->Variants[i] = variant;
+				pipeline->VariantCount++;
+				return true;
+			}
 		}
 	}
 	
-	static bool VulkanRecordCommandBuffer(VulkanState* state, VkCommandBuffer commandBuffer, u32 imageIndex, VkBuffer vertexBuffer, VkBuffer indexBuffer, u32 indexCount) {
+	// Returns the variant for this description, creating it on first use. Variants are allocated one by one so handles stay valid when the table grows.
+	static VulkanPipelineVariant* VulkanGetPipeline(VulkanState* state, VulkanPipelineDescription* description, bool async) {
 		
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		VulkanPipeline* pipeline = &state->Pipeline;
+		u64 hash = VulkanHashBytes(description, sizeof(VulkanPipelineDescription));
 		
-		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		if (pipeline->VariantCapacity > 0) {
 			
-			return false;
+			u32 mask = pipeline->VariantCapacity - 1;
+			for (u32 i = (u32)hash & mask; pipeline->Variants[i]; i = (i + 1) & mask) {
+				
+				VulkanPipelineVariant* variant = pipeline->Variants[i];
+				if (variant->Hash == hash && memcmp(&variant->Description, description, sizeof(VulkanPipelineDescription)) == 0) {
+					
+					if (!async && PlatformAtomicLoad(&variant->Status) == VulkanPipelinePending) {
+						
+						VulkanWaitPipelineCompiler(state);
+					}
+					
+					return variant;
+				}
+			}
 		}
 		
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = state->Pipeline.RenderPass;
-		renderPassInfo.framebuffer = *(state->SwapChain.Framebuffers + imageIndex);
-		renderPassInfo.renderArea.offset = { 0 , 0 };
-		renderPassInfo.renderArea.extent = state->SwapChain.Extent;
+		VulkanPipelineVariant* variant = (VulkanPipelineVariant*)calloc(1, sizeof(VulkanPipelineVariant));
 		
-		VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-		renderPassInfo.clearValueCount = 1;
-		renderPassInfo.pClearValues = &clearColor;
+		if (!variant) {
+			
+			return nullptr;
+		}
 		
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		{
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state->Pipeline.GraphicsPipeline);
+		variant->Hash = hash;
+		variant->Description = *description;
+		variant->Status = VulkanPipelinePending;
+		variant->Id = VulkanAcquireId(&pipeline->VariantIds);
+		
+		if (!VulkanInsertPipelineVariant(pipeline, variant)) {
 			
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+			VulkanReleaseId(&pipeline->VariantIds, variant->Id);
+			free(variant);
+			return nullptr;
 		}
-		vkCmdEndRenderPass(commandBuffer);
 		
-		return vkEndCommandBuffer(commandBuffer) == VK_SUCCESS;
+		if (!async || !VulkanQueuePipelineVariant(state, variant)) {
+			
+			bool created = VulkanCreatePipelineVariant(state, variant);
+			PlatformAtomicStore(&variant->Status, created ? VulkanPipelineReady : VulkanPipelineFailed);
+		}
+		
+		return variant;
 	}
 	
-	static bool VulkanCreateSyncObjects(VulkanState* state) {
+	// Anything a recorded frame references by handle may come back with the same value, so destroying it invalidates every entry
+	static void VulkanInvalidateRecordedFrames(VulkanState* state) {
 		
-		state->ImageAvailableSemaphores = (VkSemaphore*)malloc(FramesInFlight * sizeof(VkSemaphore));
-		state->ImageAvailableSemaphoreCount = FramesInFlight;
+		state->DrawVersion++;
+	}
+	
+	// Destroys the variants built from module, or every variant when module is VK_NULL_HANDLE. The caller makes sure none are in use.
+	static void VulkanDestroyPipelineVariants(VulkanState* state, VkShaderModule module) {
 		
-		state->RenderFinishedSemaphores = (VkSemaphore*)malloc(FramesInFlight * sizeof(VkSemaphore));
-		state->RenderFinishedSemaphoreCount = FramesInFlight;
+		VulkanPipeline* pipeline = &state->Pipeline;
 		
-		state->InFlightFences = (VkFence*)malloc(FramesInFlight * sizeof(VkFence));
-		state->InFlightFenceCount = FramesInFlight;
+		// Workers may still be writing to variants in the table
+		VulkanWaitPipelineCompiler(state);
+		VulkanInvalidateRecordedFrames(state);
+		state->DrawList.LastVariant = nullptr;
 		
-		if (state->ImageAvailableSemaphores && state->RenderFinishedSemaphores && state->InFlightFences) {
-			
-			VkSemaphoreCreateInfo semaphoreInfo{};
-			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-			
-			VkFenceCreateInfo fenceInfo{};
-			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-			fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		VulkanPipelineVariant** variants = pipeline->Variants;
+		u32 capacity = pipeline->VariantCapacity;
+		
+		pipeline->Variants = nullptr;
+		pipeline->VariantCapacity = 0;
+		pipeline->VariantCount = 0;
+		
+		// Removing from an open addressing table breaks probe sequences, the survivors are simply inserted again
+		for (u32 i = 0; i < capacity; i++) {
 			
-			bool complete = true;
-			for (u32 i = 0; i < FramesInFlight; i++) {
-				
-				VkSemaphore* imageAvailableSemaphore = (state->ImageAvailableSemaphores + i);
-				VkSemaphore* renderFinishedSemaphore = (state->RenderFinishedSemaphores + i);
-				VkFence* inFlightFence = (state->InFlightFences + i);
+			VulkanPipelineVariant* variant = variants[i];
+			if (!variant) {
 				
-				VkResult imageAvailable = vkCreateSemaphore(state->Device, &semaphoreInfo, nullptr, imageAvailableSemaphore);
-				VkResult renderFinished = vkCreateSemaphore(state->Device, &semaphoreInfo, nullptr, renderFinishedSemaphore);
-				VkResult inFlight = vkCreateFence(state->Device, &fenceInfo, nullptr, inFlightFence);
+				continue;
+			}
+			
+			bool uses = module == VK_NULL_HANDLE || variant->Description.VertexShader == module || variant->Description.FragmentShader == module;
+			if (uses || !VulkanInsertPipelineVariant(pipeline, variant)) {
 				
-				if (imageAvailable != VK_SUCCESS || renderFinished != VK_SUCCESS || inFlight != VK_SUCCESS) {
+				if (pipeline->Bound == variant) {
 					
-					complete = false;
-					break;
+					pipeline->Bound = nullptr;
+				}
+				if (pipeline->Fallback == variant) {
+					
+					pipeline->Fallback = nullptr;
 				}
+				if (pipeline->InstancedFallback == variant) {
+					
+					pipeline->InstancedFallback = nullptr;
+				}
+				vkDestroyPipeline(state->Device, variant->Pipeline, nullptr);
+				vkDestroyPipeline(state->Device, variant->DepthPipeline, nullptr);
+				VulkanReleaseId(&pipeline->VariantIds, variant->Id);
+				free(variant);
 			}
-			
-			return complete;
 		}
-		else {
+		free(variants);
+	}
+	
+	// Builds every variant again after a change all of them depend on. The variants stay where they are, so handles from
+	// VulkanRequestPipeline remain valid and only report pending until their rebuild is done. The caller makes sure none are in use.
+	static bool VulkanRebuildPipelineVariants(VulkanState* state) {
+		
+		VulkanPipeline* pipeline = &state->Pipeline;
+		
+		// Workers may still be writing to variants in the table
+		VulkanWaitPipelineCompiler(state);
+		VulkanInvalidateRecordedFrames(state);
+		
+		// The hashes change, the variants go into a new table of the same size, which can't fill up while they are inserted
+		VulkanPipelineVariant** variants = pipeline->Variants;
+		u32 capacity = pipeline->VariantCapacity;
+		VulkanPipelineVariant** rebuilt = capacity ? (VulkanPipelineVariant**)calloc(capacity, sizeof(VulkanPipelineVariant*)) : nullptr;
+		
+		if (capacity && !rebuilt) {
 			
 			return false;
 		}
+		
+		pipeline->Variants = rebuilt;
+		pipeline->VariantCount = 0;
+		
+		for (u32 i = 0; i < capacity; i++) {
+			
+			VulkanPipelineVariant* variant = variants[i];
+			if (!variant) {
+				
+				continue;
+			}
+			
+			vkDestroyPipeline(state->Device, variant->Pipeline, nullptr);
+			vkDestroyPipeline(state->Device, variant->DepthPipeline, nullptr);
+			variant->Pipeline = VK_NULL_HANDLE;
+			variant->DepthPipeline = VK_NULL_HANDLE;
+			
+			// Only the shaders belong to the variant, everything else is described from the state again
+			VulkanShader shader{};
+			shader.VertexShader = variant->Description.VertexShader;
+			shader.FragmentShader = variant->Description.FragmentShader;
+			shader.Instanced = variant->Description.Instanced == VK_TRUE;
+			VulkanDescribePipeline(state, &shader, &variant->Description);
+			variant->Hash = VulkanHashBytes(&variant->Description, sizeof(VulkanPipelineDescription));
+			PlatformAtomicStore(&variant->Status, VulkanPipelinePending);
+			
+			VulkanInsertPipelineVariant(pipeline, variant);
+			
+			if (!VulkanQueuePipelineVariant(state, variant)) {
+				
+				bool created = VulkanCreatePipelineVariant(state, variant);
+				PlatformAtomicStore(&variant->Status, created ? VulkanPipelineReady : VulkanPipelineFailed);
+			}
+		}
+		free(variants);
+		
+		return true;
 	}
 	
-	static void VulkanFramebufferResizeCallback(GLFWwindow* window, i32 width, i32 height) {
+	static bool VulkanBindShaderPipeline(VulkanState* state, bool async) {
 		
-		VulkanState* state = (VulkanState*)glfwGetWindowUserPointer(window);
-		state->SwapChain.FramebufferResized;
+		VulkanPipelineDescription description;
+		
+		VulkanDescribePipeline(state, &state->DefaultShader, &description);
+		state->Pipeline.Fallback = VulkanGetPipeline(state, &description, false);
+		
+		VulkanDescribePipeline(state, &state->InstancedShader, &description);
+		state->Pipeline.InstancedFallback = VulkanGetPipeline(state, &description, false);
+		
+		VulkanDescribePipeline(state, &state->Shader, &description);
+		state->Pipeline.Bound = VulkanGetPipeline(state, &description, async);
+		
+		if (!state->Pipeline.Bound) {
+			
+			return false;
+		}
+		
+		return async || state->Pipeline.Bound->Status == VulkanPipelineReady;
 	}
 	
-	static bool VulkanCreateFramebufferResizeCallback(VulkanState* state) {
+	static bool VulkanCreateCommandPool(VulkanState* state) {
 		
-		glfwSetWindowUserPointer(state->Window->NativeHandle, state);
-		glfwSetFramebufferSizeCallback(state->Window->NativeHandle, VulkanFramebufferResizeCallback);
+		VulkanQueueFamilyIndices queueFamilyIndices = VulkanFindQueueFamilies(state, &state->PhysicalDevice);
+		
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.GraphicsFamily;
+		
+		return vkCreateCommandPool(state->Device, &poolInfo, nullptr, &state->CommandPool) == VK_SUCCESS;
 	}
 	
-	static void VulkanCleanupSwapChain(VulkanState* state) {
+	// Waiting for the device to go idle counts as accessing every queue
+	static void VulkanWaitIdle(VulkanState* state) {
 		
+		PlatformMutexLock(&state->QueueMutex);
 		vkDeviceWaitIdle(state->Device);
+		PlatformMutexUnlock(&state->QueueMutex);
+	}
+	
+	static bool VulkanCreateBuffer(VulkanState* state, VulkanBuffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+		
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		
-		// Framebuffers
-		for (u32 i = 0; i < state->SwapChain.FramebufferCount; i++) {
+		if (vkCreateBuffer(state->Device, &bufferInfo, nullptr, &buffer->Buffer) != VK_SUCCESS) {
 			
-			VkFramebuffer* framebuffer = (state->SwapChain.Framebuffers + i);
-			vkDestroyFramebuffer(state->Device, *framebuffer, nullptr);
+			return false;
 		}
-		free(state->SwapChain.Framebuffers);
 		
-		// Pipeline
-		vkDestroyPipeline(state->Device, state->Pipeline.GraphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(state->Device, state->Pipeline.PipeLineLayout, nullptr);
-		vkDestroyRenderPass(state->Device, state->Pipeline.RenderPass, nullptr);
+		VkMemoryRequirements memRequirements{};
+		vkGetBufferMemoryRequirements(state->Device, buffer->Buffer, &memRequirements);
 		
-		// Image Views
-		for (u32 i = 0; i < state->SwapChain.ImageViewCount; i++) {
+		// Buffers are sub-allocated from large per memory type blocks instead of one vkAllocateMemory each
+		if (!VulkanAllocate(&state->Allocator, &memRequirements, properties, VulkanMemoryPoolLinear, &buffer->Allocation)) {
 			
-			VkImageView* imageView = (state->SwapChain.ImageViews + i);
-			vkDestroyImageView(state->Device, *imageView, nullptr);
+			vkDestroyBuffer(state->Device, buffer->Buffer, nullptr);
+			buffer->Buffer = VK_NULL_HANDLE;
+			return false;
 		}
-		free(state->SwapChain.ImageViews);
 		
-		// SwapChain
-		vkDestroySwapchainKHR(state->Device, state->SwapChain.SwapChain, nullptr);
-		free(state->SwapChain.Images);
+		vkBindBufferMemory(state->Device, buffer->Buffer, buffer->Allocation.Memory, buffer->Allocation.Offset);
+		buffer->Id = VulkanAcquireId(&state->BufferIds);
+		
+		return true;
 	}
 	
-	static bool VulkanRecreateSwapChain(VulkanState* state) {
+	static void VulkanDestroyBuffer(VulkanState* state, VulkanBuffer* buffer) {
 		
-		// Wait while the window size is zero
-		i32 width{};
-		i32 height{};
-		glfwGetFramebufferSize(state->Window->NativeHandle, &width, &height);
-		while (width == 0 || height == 0) {
+		if (buffer->Buffer != VK_NULL_HANDLE) {
 			
-			glfwGetFramebufferSize(state->Window->NativeHandle, &width, &height);
-			glfwWaitEvents();
+			VulkanReleaseId(&state->BufferIds, buffer->Id);
 		}
-		
-		VulkanCleanupSwapChain(state);
-		
-		u32 result = 1;
-		
-		result &= (u32)VulkanCreateSwapChain(state);
-		result &= (u32)VulkanCreateImageViews(state);
-		result &= (u32)VulkanCreateRenderPass(state);
-		result &= (u32)VulkanCreateGraphicsPipeline(state);
-		result &= (u32)VulkanCreateFramebuffers(state);
-		
-		return result;
+		vkDestroyBuffer(state->Device, buffer->Buffer, nullptr);
+		VulkanFree(&state->Allocator, &buffer->Allocation);
+		buffer->Buffer = VK_NULL_HANDLE;
 	}
 	
-	bool VulkanStateInit(VulkanState* state, Window* window) {
+	static bool VulkanCreateStagingRing(VulkanState* state) {
 		
-		u32 result = 1;
-		state->Window = window;
+		VulkanStagingRing* ring = &state->StagingRing;
+		ring->FrameSize = StagingRingFrameSize;
+		ring->Head = 0;
+		ring->FrameOpen = false;
+		ring->CopyCount = 0;
+		ring->CopyCapacity = 64;
+		ring->Copies = (VulkanStagingCopy*)malloc(ring->CopyCapacity * sizeof(VulkanStagingCopy));
+		
+		if (!ring->Copies) {
+			
+			return false;
+		}
+		
+		return VulkanCreateBuffer(state, &ring->Buffer, ring->FrameSize * state->FramesInFlight, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+	
+	static void VulkanDestroyStagingRing(VulkanState* state) {
+		
+		VulkanStagingRing* ring = &state->StagingRing;
+		
+		VulkanDestroyBuffer(state, &ring->Buffer);
+		free(ring->Copies);
+		ring->Copies = nullptr;
+		ring->CopyCount = 0;
+		ring->CopyCapacity = 0;
+	}
+	
+	static bool VulkanPushStagingCopy(VulkanState* state, VkBuffer source, VkDeviceSize sourceOffset, VkBuffer destination, VkDeviceSize size) {
+		
+		VulkanStagingRing* ring = &state->StagingRing;
+		
+		if (ring->CopyCount == ring->CopyCapacity) {
+			
+			u32 capacity = ring->CopyCapacity * 2;
+			VulkanStagingCopy* copies = (VulkanStagingCopy*)realloc(ring->Copies, capacity * sizeof(VulkanStagingCopy));
+			
+			if (!copies) {
+				
+				return false;
+			}
+			
+			ring->Copies = copies;
+			ring->CopyCapacity = capacity;
+		}
+		
+		VulkanStagingCopy* copy = (ring->Copies + ring->CopyCount++);
+		copy->Source = source;
+		copy->Destination = destination;
+		copy->Region.srcOffset = sourceOffset;
+		copy->Region.dstOffset = 0;
+		copy->Region.size = size;
+		
+		return true;
+	}
+	
+	// Drops pending copies and ownership transfers of a buffer that is about to be destroyed
+	static void VulkanForgetUploads(VulkanState* state, VkBuffer destination) {
+		
+		VulkanStagingRing* ring = &state->StagingRing;
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		
+		u32 count = 0;
+		for (u32 i = 0; i < ring->CopyCount; i++) {
+			
+			if (ring->Copies[i].Destination != destination) {
+				
+				ring->Copies[count++] = ring->Copies[i];
+			}
+		}
+		ring->CopyCount = count;
+		
+		count = 0;
+		for (u32 i = 0; i < batch->AcquireCount; i++) {
+			
+			if (batch->Acquires[i] != destination) {
+				
+				batch->Acquires[count++] = batch->Acquires[i];
+			}
+			else if (i < batch->AcquireStart) {
+				
+				batch->AcquireStart--;
+			}
+		}
+		batch->AcquireCount = count;
+	}
+	
+	static void VulkanRecordStagingCopies(VulkanState* state, VkCommandBuffer commandBuffer) {
+		
+		VulkanStagingRing* ring = &state->StagingRing;
+		
+		if (ring->CopyCount == 0) {
+			
+			return;
+		}
+		
+		// Earlier frames may still be reading the destination buffers
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, UploadReaderStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		
+		for (u32 i = 0; i < ring->CopyCount; i++) {
+			
+			VulkanStagingCopy* copy = (ring->Copies + i);
+			vkCmdCopyBuffer(commandBuffer, copy->Source, copy->Destination, 1, &copy->Region);
+		}
+		
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = UploadReaderAccess;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, UploadReaderStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		
+		ring->CopyCount = 0;
+	}
+	
+	static void VulkanReleaseStaging(VulkanState* state, VulkanStagingChunks* staging) {
+		
+		for (u32 i = 0; i < staging->Count; i++) {
+			
+			VulkanDestroyBuffer(state, staging->Buffers + i);
+		}
+		staging->Count = 0;
+		staging->Head = 0;
+	}
+	
+	static void VulkanDestroyStaging(VulkanState* state, VulkanStagingChunks* staging) {
+		
+		VulkanReleaseStaging(state, staging);
+		free(staging->Buffers);
+		memset(staging, 0, sizeof(VulkanStagingChunks));
+	}
+	
+	// Copies data into the staging chunks and returns where it landed
+	static bool VulkanStage(VulkanState* state, VulkanStagingChunks* staging, void* data, VkDeviceSize size, VkBuffer* source, VkDeviceSize* sourceOffset) {
+		
+		VkDeviceSize offset = (staging->Head + (StagingRingAlignment - 1)) & ~(StagingRingAlignment - 1);
+		VulkanBuffer* stagingBuffer = staging->Count > 0 ? (staging->Buffers + staging->Count - 1) : nullptr;
+		
+		// Start a new chunk when the current one is full, uploads larger than a chunk get their own
+		if (!stagingBuffer || offset + size > stagingBuffer->Allocation.Size) {
+			
+			if (staging->Count == staging->Capacity) {
+				
+				u32 capacity = staging->Capacity ? staging->Capacity * 2 : 8;
+				VulkanBuffer* stagingBuffers = (VulkanBuffer*)realloc(staging->Buffers, capacity * sizeof(VulkanBuffer));
+				
+				if (!stagingBuffers) {
+					
+					return false;
+				}
+				
+				staging->Buffers = stagingBuffers;
+				staging->Capacity = capacity;
+			}
+			
+			stagingBuffer = (staging->Buffers + staging->Count);
+			VkDeviceSize chunkSize = size > UploadBatchChunkSize ? size : UploadBatchChunkSize;
+			
+			if (!VulkanCreateBuffer(state, stagingBuffer, chunkSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+				
+				return false;
+			}
+			
+			staging->Count++;
+			offset = 0;
+		}
+		
+		memcpy(stagingBuffer->Allocation.Mapped + offset, data, (size_t)size);
+		staging->Head = offset + size;
+		
+		*source = stagingBuffer->Buffer;
+		*sourceOffset = offset;
+		
+		return true;
+	}
+	
+	static bool VulkanCreateUploadBatch(VulkanState* state) {
+		
+		VulkanQueueFamilyIndices indices = VulkanFindQueueFamilies(state, &state->PhysicalDevice);
+		
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		batch->GraphicsFamily = indices.GraphicsFamily;
+		batch->TransferFamily = indices.TransferFamily;
+		batch->AcquireCount = 0;
+		batch->AcquireStart = 0;
+		batch->AcquireCapacity = 64;
+		batch->Acquires = (VkBuffer*)malloc(batch->AcquireCapacity * sizeof(VkBuffer));
+		batch->Recording = false;
+		batch->Pending = false;
+		batch->SemaphoreSignaled = false;
+		
+		if (!batch->Acquires) {
+			
+			return false;
+		}
+		
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = batch->TransferFamily;
+		
+		if (vkCreateCommandPool(state->Device, &poolInfo, nullptr, &batch->CommandPool) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = batch->CommandPool;
+		allocInfo.commandBufferCount = 1;
+		
+		VkCommandBufferAllocateInfo graphicsAllocInfo = allocInfo;
+		graphicsAllocInfo.commandPool = state->CommandPool;
+		
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		
+		VkResult commandBuffer = vkAllocateCommandBuffers(state->Device, &allocInfo, &batch->CommandBuffer);
+		VkResult graphicsCommandBuffer = vkAllocateCommandBuffers(state->Device, &graphicsAllocInfo, &batch->GraphicsCommandBuffer);
+		VkResult semaphore = vkCreateSemaphore(state->Device, &semaphoreInfo, nullptr, &batch->Semaphore);
+		VkResult graphicsSemaphore = vkCreateSemaphore(state->Device, &semaphoreInfo, nullptr, &batch->GraphicsSemaphore);
+		VkResult fence = vkCreateFence(state->Device, &fenceInfo, nullptr, &batch->Fence);
+		
+		return commandBuffer == VK_SUCCESS && graphicsCommandBuffer == VK_SUCCESS && semaphore == VK_SUCCESS && graphicsSemaphore == VK_SUCCESS && fence == VK_SUCCESS;
+	}
+	
+	// Frees the staging memory of a submitted batch once it has finished, optionally waiting for it
+	static void VulkanCollectUploads(VulkanState* state, bool wait) {
+		
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		
+		if (!batch->Pending) {
+			
+			return;
+		}
+		
+		if (wait) {
+			
+			vkWaitForFences(state->Device, 1, &batch->Fence, VK_TRUE, UINT64_MAX);
+		}
+		else if (vkGetFenceStatus(state->Device, batch->Fence) != VK_SUCCESS) {
+			
+			return;
+		}
+		
+		VulkanReleaseStaging(state, &batch->Staging);
+		batch->Pending = false;
+	}
+	
+	static void VulkanDestroyUploadBatch(VulkanState* state) {
+		
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		
+		VulkanCollectUploads(state, true);
+		VulkanDestroyStaging(state, &batch->Staging);
+		
+		vkDestroySemaphore(state->Device, batch->Semaphore, nullptr);
+		vkDestroySemaphore(state->Device, batch->GraphicsSemaphore, nullptr);
+		vkDestroyFence(state->Device, batch->Fence, nullptr);
+		vkDestroyCommandPool(state->Device, batch->CommandPool, nullptr);
+		free(batch->Acquires);
+		batch->Acquires = nullptr;
+	}
+	
+	static bool VulkanBatchUpload(VulkanState* state, VulkanBuffer* destination, void* data, VkDeviceSize size) {
+		
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		
+		VkBuffer source = VK_NULL_HANDLE;
+		VkBufferCopy copyRegion{};
+		if (!VulkanStage(state, &batch->Staging, data, size, &source, &copyRegion.srcOffset)) {
+			
+			return false;
+		}
+		
+		copyRegion.dstOffset = 0;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(batch->CommandBuffer, source, destination->Buffer, 1, &copyRegion);
+		
+		if (batch->TransferFamily == batch->GraphicsFamily) {
+			
+			return true;
+		}
+		
+		// The buffer changes hands at the end of the batch, once per batch is enough
+		for (u32 i = batch->AcquireStart; i < batch->AcquireCount; i++) {
+			
+			if (batch->Acquires[i] == destination->Buffer) {
+				
+				return true;
+			}
+		}
+		
+		if (batch->AcquireCount == batch->AcquireCapacity) {
+			
+			u32 capacity = batch->AcquireCapacity * 2;
+			VkBuffer* acquires = (VkBuffer*)realloc(batch->Acquires, capacity * sizeof(VkBuffer));
+			
+			if (!acquires) {
+				
+				return false;
+			}
+			
+			batch->Acquires = acquires;
+			batch->AcquireCapacity = capacity;
+		}
+		
+		batch->Acquires[batch->AcquireCount++] = destination->Buffer;
+		
+		return true;
+	}
+	
+	// Queue family ownership transfer of every buffer in [first, first + count), release on the transfer queue and acquire on the graphics queue
+	static void VulkanRecordOwnershipTransfer(VulkanState* state, VkCommandBuffer commandBuffer, u32 first, u32 count, bool release) {
+		
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		
+		if (count == 0) {
+			
+			return;
+		}
+		
+		VkBufferMemoryBarrier* barriers = (VkBufferMemoryBarrier*)malloc(count * sizeof(VkBufferMemoryBarrier));
+		
+		if (!barriers) {
+			
+			return;
+		}
+		
+		for (u32 i = 0; i < count; i++) {
+			
+			VkBufferMemoryBarrier* barrier = (barriers + i);
+			*barrier = {};
+			barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier->srcAccessMask = release ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+			barrier->dstAccessMask = release ? 0 : UploadReaderAccess | VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier->srcQueueFamilyIndex = batch->TransferFamily;
+			barrier->dstQueueFamilyIndex = batch->GraphicsFamily;
+			barrier->buffer = batch->Acquires[first + i];
+			barrier->offset = 0;
+			barrier->size = VK_WHOLE_SIZE;
+		}
+		
+		if (release) {
+			
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, count, barriers, 0, nullptr);
+		}
+		else {
+			
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | UploadReaderStages, 0, 0, nullptr, count, barriers, 0, nullptr);
+		}
+		
+		free(barriers);
+	}
+	
+	static bool VulkanUploadBuffer(VulkanState* state, VulkanBuffer* destination, void* data, VkDeviceSize size) {
+		
+		VulkanStagingRing* ring = &state->StagingRing;
+		
+		if (state->UploadBatch.Recording) {
+			
+			return VulkanBatchUpload(state, destination, data, size);
+		}
+		
+		// The first upload of a frame waits until the GPU is done with this frame's segment
+		if (!ring->FrameOpen) {
+			
+			vkWaitForFences(state->Device, 1, state->InFlightFences + state->CurrentFrame, VK_TRUE, UINT64_MAX);
+			ring->Head = 0;
+			ring->FrameOpen = true;
+		}
+		
+		VkDeviceSize offset = (ring->Head + (StagingRingAlignment - 1)) & ~(StagingRingAlignment - 1);
+		
+		if (offset + size <= ring->FrameSize) {
+			
+			VkDeviceSize ringOffset = state->CurrentFrame * ring->FrameSize + offset;
+			
+			if (VulkanPushStagingCopy(state, ring->Buffer.Buffer, ringOffset, destination->Buffer, size)) {
+				
+				memcpy(ring->Buffer.Allocation.Mapped + ringOffset, data, (size_t)size);
+				ring->Head = offset + size;
+				return true;
+			}
+		}
+		
+		// Doesn't fit the ring, send it as a batch of its own
+		return VulkanBeginUploads(state) && VulkanBatchUpload(state, destination, data, size) && VulkanEndUploads(state);
+	}
+	
+	static bool VulkanCreateCommandBuffers(VulkanState* state) {
+		
+		state->CommandBuffers = (VkCommandBuffer*)malloc(state->FramesInFlight * sizeof(VkCommandBuffer));
+		state->CommandBufferCount = state->FramesInFlight;
+		
+		if (state->CommandBuffers) {
+			
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = state->CommandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = state->CommandBufferCount;
+			
+			return vkAllocateCommandBuffers(state->Device, &allocInfo, state->CommandBuffers) == VK_SUCCESS;
+		}
+		else {
+			
+			return false;
+		}
+	}
+	
+	// The render graph makes survivors and their counts visible to the indirect draws and the instance binding
+	static void VulkanRecordCulling(VulkanState* state, VkCommandBuffer commandBuffer, u32 phase) {
+		
+		VulkanCulling* culling = &state->Culling;
+		VulkanDrawList* drawList = &state->DrawList;
+		VulkanIndirectBuffer* indirectBuffer = (state->IndirectBuffers + state->CurrentFrame);
+		
+		VkDescriptorSet sets[] = { indirectBuffer->CullSet, state->SwapChain.DepthPyramid.CullSet };
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling->Pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling->PipelineLayout, 1, ARRAY_SIZE(sets), sets, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, culling->PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(culling->Planes), culling->Planes);
+		vkCmdPushConstants(commandBuffer, culling->PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(culling->Planes), sizeof(u32), &phase);
+		
+		// The late phase writes behind everything the early phase may have written
+		VulkanCullJob* lastJob = (culling->Jobs + culling->JobCount - 1);
+		u32 lateFirstVisible = lastJob->Constants.FirstVisible + lastJob->Constants.InstanceCount;
+		
+		VkDescriptorSet boundSource = VK_NULL_HANDLE;
+		for (u32 i = 0; i < culling->JobCount; i++) {
+			
+			VulkanCullJob* job = (culling->Jobs + i);
+			if (job->Source != boundSource) {
+				
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling->PipelineLayout, 0, 1, &job->Source, 0, nullptr);
+				boundSource = job->Source;
+			}
+			
+			VulkanCullConstants constants = job->Constants;
+			if (phase == VulkanCullPhaseLate) {
+				
+				constants.Command += drawList->Count;
+				constants.FirstVisible += lateFirstVisible;
+			}
+			
+			vkCmdPushConstants(commandBuffer, culling->PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(culling->Planes) + sizeof(u32), sizeof(VulkanCullConstants), &constants);
+			vkCmdDispatch(commandBuffer, (constants.InstanceCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+		}
+	}
+	
+	// Rebuilt from the depth of the early phase, the late phase and the next frame's early phase test against it
+	static void VulkanRecordDepthPyramid(VulkanState* state, VkCommandBuffer commandBuffer) {
+		
+		VulkanCulling* culling = &state->Culling;
+		VulkanDepthPyramid* pyramid = &state->SwapChain.DepthPyramid;
+		
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling->BuildPipeline);
+		
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		
+		for (u32 i = 0; i < pyramid->LevelCount; i++) {
+			
+			u32 width = pyramid->Extent.width >> i;
+			u32 height = pyramid->Extent.height >> i;
+			width = width ? width : 1;
+			height = height ? height : 1;
+			
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling->BuildPipelineLayout, 0, 1, pyramid->BuildSets + i, 0, nullptr);
+			vkCmdDispatch(commandBuffer, (width + DepthPyramidGroupSize - 1) / DepthPyramidGroupSize, (height + DepthPyramidGroupSize - 1) / DepthPyramidGroupSize, 1);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+	}
+	
+	// What the draw list is split into for recording, every batch is one indirect draw but without
+	// multiDrawIndirect each draw is a command of its own
+	static u32 VulkanRecordUnitCount(VulkanState* state) {
+		
+		return state->MultiDrawIndirect ? state->DrawList.BatchCount : state->DrawList.Count;
+	}
+	
+	// Batches only start where pipeline or buffers change, so each one binds what differs from the previous batch.
+	// The late phase only draws batches of culled draws, from the second half of the slot's commands.
+	// The depth prepass draws the same batches with their depth only pipelines.
+	// Only the units in [first, end) are recorded, see VulkanRecordUnitCount.
+	static void VulkanRecordDrawBatches(VulkanState* state, VkCommandBuffer commandBuffer, bool late, bool depthOnly, u32 first, u32 end) {
+		
+		VulkanDrawList* drawList = &state->DrawList;
+		VulkanIndirectBuffer* indirectBuffer = (state->IndirectBuffers + state->CurrentFrame);
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+		VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+		VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+		VkBuffer boundInstanceBuffer = VK_NULL_HANDLE;
+		
+		bool indirect = state->MultiDrawIndirect;
+		u32 batchFirst = indirect ? first : 0;
+		u32 batchEnd = indirect && end < drawList->BatchCount ? end : drawList->BatchCount;
+		
+		for (u32 i = batchFirst; i < batchEnd; i++) {
+			
+			VulkanDrawBatch* batch = (drawList->Batches + i);
+			
+			// Draws recorded one by one are counted one by one, the range may start or end within a batch
+			u32 drawFirst = batch->First;
+			u32 drawEnd = batch->First + batch->Count;
+			if (!indirect) {
+				
+				if (drawFirst >= end) {
+					
+					break;
+				}
+				drawFirst = drawFirst > first ? drawFirst : first;
+				drawEnd = drawEnd < end ? drawEnd : end;
+			}
+			
+			VkPipeline pipeline = depthOnly ? batch->DepthPipeline : batch->Pipeline;
+			if (!pipeline || drawFirst >= drawEnd || (late && batch->InstanceBuffer != indirectBuffer->Instances.Buffer)) {
+				
+				continue;
+			}
+			
+			if (pipeline != boundPipeline) {
+				
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				boundPipeline = pipeline;
+			}
+			
+			if (batch->VertexBuffer != boundVertexBuffer) {
+				
+				VkDeviceSize offsets[] = { 0 };
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &batch->VertexBuffer, offsets);
+				boundVertexBuffer = batch->VertexBuffer;
+			}
+			
+			if (batch->IndexBuffer != boundIndexBuffer) {
+				
+				vkCmdBindIndexBuffer(commandBuffer, batch->IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+				boundIndexBuffer = batch->IndexBuffer;
+			}
+			
+			if (batch->InstanceBuffer && batch->InstanceBuffer != boundInstanceBuffer) {
+				
+				VkDeviceSize offsets[] = { 0 };
+				vkCmdBindVertexBuffers(commandBuffer, 1, 1, &batch->InstanceBuffer, offsets);
+				boundInstanceBuffer = batch->InstanceBuffer;
+			}
+			
+			u32 firstCommand = late ? drawList->Count + batch->First : batch->First;
+			VkDeviceSize commandOffset = firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+			
+			if (state->DrawIndirectCount) {
+				
+				state->CmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer->Commands.Buffer, commandOffset, indirectBuffer->Counts.Buffer, i * sizeof(u32), batch->Count, sizeof(VkDrawIndexedIndirectCommand));
+			}
+			else if (state->MultiDrawIndirect) {
+				
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer->Commands.Buffer, commandOffset, batch->Count, sizeof(VkDrawIndexedIndirectCommand));
+			}
+			else {
+				
+				for (u32 j = drawFirst; j < drawEnd; j++) {
+					
+					VulkanDrawCommand* command = (drawList->Commands + (drawList->Sorted + j)->Index);
+					vkCmdDrawIndexed(commandBuffer, command->IndexCount, command->InstanceCount, command->FirstIndex, command->VertexOffset, command->FirstInstance);
+				}
+			}
+		}
+	}
+	
+	// The pyramid has no contents before the first culled frame, far depth keeps every instance a candidate
+	static void VulkanInitializeDepthPyramid(VkCommandBuffer commandBuffer, VulkanGraphInheritance* inheritance, void* data) {
+		
+		VulkanState* state = (VulkanState*)data;
+		VulkanDepthPyramid* pyramid = &state->SwapChain.DepthPyramid;
+		
+		VkImageSubresourceRange range{};
+		range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		range.baseMipLevel = 0;
+		range.levelCount = pyramid->LevelCount;
+		range.baseArrayLayer = 0;
+		range.layerCount = 1;
+		
+		VkClearColorValue farDepth = { {1.0f, 1.0f, 1.0f, 1.0f} };
+		vkCmdClearColorImage(commandBuffer, pyramid->Image.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &farDepth, 1, &range);
+		pyramid->Initialized = true;
+	}
+	
+	// Records every phase of the current pass for its part of the units
+	static bool VulkanRecordSliceCommands(VulkanState* state, u32 slice) {
+		
+		VulkanRecorder* recorder = &state->Recorder;
+		VulkanGraphInheritance* inheritance = recorder->Inheritance;
+		u32 first = (u32)((u64)recorder->UnitCount * slice / recorder->SliceCount);
+		u32 end = (u32)((u64)recorder->UnitCount * (slice + 1) / recorder->SliceCount);
+		
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritance->Info;
+		
+		for (u32 i = 0; i < recorder->PhaseCount; i++) {
+			
+			VulkanRecordPhase* phase = (recorder->Phases + i);
+			VkCommandBuffer commandBuffer = recorder->Secondaries[i * recorder->SliceCount + slice];
+			
+			vkResetCommandBuffer(commandBuffer, 0);
+			if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+				
+				return false;
+			}
+			
+			vkCmdSetViewport(commandBuffer, 0, 1, &inheritance->Viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &inheritance->Scissor);
+			VulkanRecordDrawBatches(state, commandBuffer, phase->Late, phase->DepthOnly, first, end);
+			
+			if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+				
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	// Job over the slices, data is the VulkanState
+	static void VulkanRecordSlices(void* data, u32 first, u32 end) {
+		
+		VulkanState* state = (VulkanState*)data;
+		for (u32 i = first; i < end; i++) {
+			
+			if (!VulkanRecordSliceCommands(state, i)) {
+				
+				PlatformAtomicStore(&state->Recorder.Failed, 1);
+			}
+		}
+	}
+	
+	static bool VulkanCreateRecorder(VulkanState* state, u32 count) {
+		
+		VulkanRecorder* recorder = &state->Recorder;
+		
+		count = count ? count : PlatformGetProcessorCount();
+		count = count < VulkanMaxRecordThreads ? count : VulkanMaxRecordThreads;
+		count = count > 1 ? count : 1;
+		
+		// One slice per thread, the frame is split evenly and no thread waits on a slice left over
+		bool complete = JobSystemInit(&recorder->Jobs, count);
+		recorder->SliceCount = recorder->Jobs.WorkerCount;
+		recorder->Slices = (VulkanRecordSlice*)calloc(recorder->SliceCount, sizeof(VulkanRecordSlice));
+		recorder->Failed = 0;
+		
+		if (!complete || !recorder->Slices) {
+			
+			return false;
+		}
+		
+		// Secondaries are re-recorded one frame at a time, the pools can't be reset as a whole
+		VulkanQueueFamilyIndices queueFamilyIndices = VulkanFindQueueFamilies(state, &state->PhysicalDevice);
+		
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.GraphicsFamily;
+		
+		for (u32 i = 0; complete && i < recorder->SliceCount; i++) {
+			
+			VulkanRecordSlice* slice = (recorder->Slices + i);
+			for (u32 j = 0; complete && j < state->FramesInFlight; j++) {
+				
+				complete &= vkCreateCommandPool(state->Device, &poolInfo, nullptr, slice->CommandPools + j) == VK_SUCCESS;
+			}
+		}
+		
+		return complete;
+	}
+	
+	// The recorded frames have to go first, their secondaries come from the slices' pools
+	static void VulkanDestroyRecorder(VulkanState* state) {
+		
+		VulkanRecorder* recorder = &state->Recorder;
+		JobSystemDestroy(&recorder->Jobs);
+		
+		for (u32 i = 0; recorder->Slices && i < recorder->SliceCount; i++) {
+			
+			VulkanRecordSlice* slice = (recorder->Slices + i);
+			for (u32 j = 0; j < state->FramesInFlight; j++) {
+				
+				vkDestroyCommandPool(state->Device, slice->CommandPools[j], nullptr);
+			}
+		}
+		
+		free(recorder->Slices);
+		recorder->Slices = nullptr;
+		recorder->SliceCount = 0;
+	}
+	
+	static bool VulkanShouldRecordInParallel(VulkanState* state) {
+		
+		return state->Recorder.SliceCount > 1 && VulkanRecordUnitCount(state) >= VulkanParallelRecordMinimum;
+	}
+	
+	// Inline passes record the phases right away. Secondary passes record the slices on the job system, this thread
+	// joins in while it waits and executes the secondaries once every slice is done.
+	static void VulkanRecordPhases(VulkanState* state, VkCommandBuffer commandBuffer, VulkanGraphInheritance* inheritance, VulkanRecordPhase* phases, u32 phaseCount) {
+		
+		VulkanRecorder* recorder = &state->Recorder;
+		u32 unitCount = VulkanRecordUnitCount(state);
+		
+		if (!inheritance) {
+			
+			for (u32 i = 0; i < phaseCount; i++) {
+				
+				VulkanRecordDrawBatches(state, commandBuffer, phases[i].Late, phases[i].DepthOnly, 0, unitCount);
+			}
+			return;
+		}
+		
+		// The frame's statistics query is active while the secondaries execute
+		if (state->FrameTiming.StatisticsPool && state->FrameTiming.InheritedQueries) {
+			
+			inheritance->Info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+		}
+		
+		recorder->Inheritance = inheritance;
+		memcpy(recorder->Phases, phases, phaseCount * sizeof(VulkanRecordPhase));
+		recorder->PhaseCount = phaseCount;
+		recorder->Secondaries = recorder->Frame->Secondaries + recorder->FramePhases * recorder->SliceCount;
+		recorder->UnitCount = unitCount;
+		
+		// Frames may be recorded on another thread than the one that created the state, like the render thread
+		JobCounter counter{};
+		JobSystemAttach(&recorder->Jobs);
+		JobSystemParallelFor(&recorder->Jobs, VulkanRecordSlices, state, recorder->SliceCount, 1, &counter);
+		JobSystemWait(&recorder->Jobs, &counter);
+		
+		if (!PlatformAtomicLoad(&recorder->Failed)) {
+			
+			vkCmdExecuteCommands(commandBuffer, phaseCount * recorder->SliceCount, recorder->Secondaries);
+		}
+		recorder->FramePhases += phaseCount;
+	}
+	
+	// Passes of the frame graph, data is the VulkanState
+	static void VulkanRecordEarlyCulling(VkCommandBuffer commandBuffer, VulkanGraphInheritance* inheritance, void* data) {
+		
+		VulkanRecordCulling((VulkanState*)data, commandBuffer, VulkanCullPhaseEarly);
+	}
+	
+	static void VulkanRecordLateCulling(VkCommandBuffer commandBuffer, VulkanGraphInheritance* inheritance, void* data) {
+		
+		VulkanRecordCulling((VulkanState*)data, commandBuffer, VulkanCullPhaseLate);
+	}
+	
+	static void VulkanRecordDepthPyramidBuild(VkCommandBuffer commandBuffer, VulkanGraphInheritance* inheritance, void* data) {
+		
+		VulkanRecordDepthPyramid((VulkanState*)data, commandBuffer);
+	}
+	
+	// Without occlusion culling the late phase was culled up front and is drawn right away
+	static void VulkanRecordMainPass(VkCommandBuffer commandBuffer, VulkanGraphInheritance* inheritance, void* data) {
+		
+		VulkanState* state = (VulkanState*)data;
+		bool late = state->Culling.JobCount > 0 && state->SwapChain.SampleCount != VK_SAMPLE_COUNT_1_BIT;
+		
+		VulkanRecordPhase phases[4];
+		u32 phaseCount = 0;
+		if (state->DepthPrepass) {
+			
+			phases[phaseCount++] = { false, true };
+			if (late) {
+				
+				phases[phaseCount++] = { true, true };
+			}
+		}
+		phases[phaseCount++] = { false, false };
+		if (late) {
+			
+			phases[phaseCount++] = { true, false };
+		}
+		
+		VulkanRecordPhases(state, commandBuffer, inheritance, phases, phaseCount);
+	}
+	
+	static void VulkanRecordResumePass(VkCommandBuffer commandBuffer, VulkanGraphInheritance* inheritance, void* data) {
+		
+		VulkanState* state = (VulkanState*)data;
+		
+		VulkanRecordPhase phases[2];
+		u32 phaseCount = 0;
+		if (state->DepthPrepass) {
+			
+			phases[phaseCount++] = { true, true };
+		}
+		phases[phaseCount++] = { true, false };
+		
+		VulkanRecordPhases(state, commandBuffer, inheritance, phases, phaseCount);
+	}
+	
+	// Declares the frame to the render graph, which works out the barriers, layouts and render passes in between.
+	// Multisampled color and depth are transient, they are gone after the pass, so both culling phases run up front
+	// and are drawn in the one pass. Single sampled frames test what the early phase left out against this frame's
+	// depth and draw it in a second pass on top.
+	static bool VulkanBuildFrameGraph(VulkanState* state, u32 imageIndex) {
+		
+		VulkanRenderGraph* graph = &state->RenderGraph;
+		VulkanSwapChain* swapChain = &state->SwapChain;
+		VulkanDepthPyramid* pyramid = &swapChain->DepthPyramid;
+		bool cull = state->Culling.JobCount > 0;
+		bool occlusion = swapChain->SampleCount == VK_SAMPLE_COUNT_1_BIT;
+		
+		VulkanGraphBegin(graph, state->FrameNumber);
+		
+		VulkanGraphImageDescription colorDescription{};
+		colorDescription.Format = swapChain->ImageFormat;
+		colorDescription.Extent = swapChain->Extent;
+		colorDescription.Samples = VK_SAMPLE_COUNT_1_BIT;
+		colorDescription.Aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		
+		VulkanGraphImageDescription depthDescription = colorDescription;
+		depthDescription.Format = swapChain->DepthFormat;
+		depthDescription.Aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		
+		VkImageLayout presentLayout = state->Headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		u32 image = VulkanGraphImportImage(graph, &colorDescription, *(swapChain->Images + imageIndex), *(swapChain->ImageViews + imageIndex), VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, presentLayout);
+		
+		// The depth buffer is cleared every frame, but the previous frame's pyramid build may still read it
+		u32 color = image;
+		u32 depth = VulkanGraphInvalid;
+		if (occlusion) {
+			
+			VkPipelineStageFlags depthStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			depth = VulkanGraphImportImage(graph, &depthDescription, swapChain->Depth.Image, swapChain->Depth.View, VK_IMAGE_LAYOUT_UNDEFINED, depthStages, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+		}
+		else {
+			
+			colorDescription.Samples = swapChain->SampleCount;
+			depthDescription.Samples = swapChain->SampleCount;
+			color = VulkanGraphCreateImage(graph, &colorDescription);
+			depth = VulkanGraphCreateImage(graph, &depthDescription);
+		}
+		
+		// Earlier frames wrote the pyramid and the visibility this frame reads, uploads went through transfers
+		VkPipelineStageFlags bufferStages = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		VkAccessFlags bufferAccess = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		u32 visibility = VulkanGraphInvalid;
+		u32 arguments = VulkanGraphInvalid;
+		u32 pyramidImage = VulkanGraphInvalid;
+		
+		if (cull) {
+			
+			visibility = VulkanGraphImportBuffer(graph, bufferStages, bufferAccess);
+			arguments = VulkanGraphImportBuffer(graph, bufferStages, bufferAccess);
+			
+			VulkanGraphImageDescription pyramidDescription{};
+			pyramidDescription.Format = VK_FORMAT_R32_SFLOAT;
+			pyramidDescription.Extent = pyramid->Extent;
+			pyramidDescription.Samples = VK_SAMPLE_COUNT_1_BIT;
+			pyramidDescription.Aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+			
+			VkImageLayout pyramidLayout = pyramid->Initialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+			pyramidImage = VulkanGraphImportImage(graph, &pyramidDescription, pyramid->Image.Image, pyramid->Image.View, pyramidLayout, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+			
+			if (!pyramid->Initialized) {
+				
+				u32 initializePass = VulkanGraphAddPass(graph, false, VulkanInitializeDepthPyramid, state);
+				VulkanGraphUse(graph, initializePass, pyramidImage, VulkanGraphUsageTransferWrite);
+			}
+			
+			u32 earlyPass = VulkanGraphAddPass(graph, false, VulkanRecordEarlyCulling, state);
+			VulkanGraphUse(graph, earlyPass, pyramidImage, VulkanGraphUsageShaderRead);
+			VulkanGraphUse(graph, earlyPass, visibility, VulkanGraphUsageShaderWrite);
+			VulkanGraphUse(graph, earlyPass, arguments, VulkanGraphUsageShaderWrite);
+			
+			if (!occlusion) {
+				
+				u32 latePass = VulkanGraphAddPass(graph, false, VulkanRecordLateCulling, state);
+				VulkanGraphUse(graph, latePass, pyramidImage, VulkanGraphUsageShaderRead);
+				VulkanGraphUse(graph, latePass, visibility, VulkanGraphUsageShaderWrite);
+				VulkanGraphUse(graph, latePass, arguments, VulkanGraphUsageShaderWrite);
+			}
+		}
+		
+		VkClearValue clearColor{};
+		clearColor.color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+		VkClearValue clearDepth{};
+		clearDepth.depthStencil = { 1.0f, 0 };
+		
+		// Attachments in the order of the pipeline render pass
+		bool parallel = VulkanShouldRecordInParallel(state);
+		u32 mainPass = VulkanGraphAddPass(graph, true, VulkanRecordMainPass, state);
+		if (parallel) {
+			
+			VulkanGraphSetSecondary(graph, mainPass);
+		}
+		VulkanGraphUse(graph, mainPass, color, VulkanGraphUsageColorAttachment, &clearColor);
+		VulkanGraphUse(graph, mainPass, depth, VulkanGraphUsageDepthAttachment, &clearDepth);
+		if (!occlusion) {
+			
+			VulkanGraphUse(graph, mainPass, image, VulkanGraphUsageResolveAttachment);
+		}
+		VulkanGraphUse(graph, mainPass, arguments, VulkanGraphUsageIndirectRead);
+		VulkanGraphUse(graph, mainPass, arguments, VulkanGraphUsageVertexRead);
+		
+		if (cull && occlusion) {
+			
+			u32 buildPass = VulkanGraphAddPass(graph, false, VulkanRecordDepthPyramidBuild, state);
+			VulkanGraphUse(graph, buildPass, depth, VulkanGraphUsageDepthRead);
+			VulkanGraphUse(graph, buildPass, pyramidImage, VulkanGraphUsageShaderWrite);
+			
+			u32 latePass = VulkanGraphAddPass(graph, false, VulkanRecordLateCulling, state);
+			VulkanGraphUse(graph, latePass, pyramidImage, VulkanGraphUsageShaderRead);
+			VulkanGraphUse(graph, latePass, visibility, VulkanGraphUsageShaderWrite);
+			VulkanGraphUse(graph, latePass, arguments, VulkanGraphUsageShaderWrite);
+			
+			u32 resumePass = VulkanGraphAddPass(graph, true, VulkanRecordResumePass, state);
+			if (parallel) {
+				
+				VulkanGraphSetSecondary(graph, resumePass);
+			}
+			VulkanGraphUse(graph, resumePass, color, VulkanGraphUsageColorAttachment);
+			VulkanGraphUse(graph, resumePass, depth, VulkanGraphUsageDepthAttachment);
+			VulkanGraphUse(graph, resumePass, arguments, VulkanGraphUsageIndirectRead);
+			VulkanGraphUse(graph, resumePass, arguments, VulkanGraphUsageVertexRead);
+		}
+		
+		return VulkanGraphCompile(graph);
+	}
+	
+	static bool VulkanRecordCommandBuffer(VulkanState* state, VkCommandBuffer commandBuffer, u32 imageIndex) {
+		
+		if (!VulkanBuildFrameGraph(state, imageIndex)) {
+			
+			return false;
+		}
+		
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		// Query indices belong to the frame slot, so they stay valid when the buffer is resubmitted from the same slot
+		VkQueryPool queryPool = state->FrameTiming.QueryPool;
+		u32 firstQuery = state->CurrentFrame * 2;
+		if (queryPool) {
+			
+			vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery, 2);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery);
+		}
+		
+		// Spans the prepass and the main pass, a query begun outside a render pass may span several of them. Secondaries
+		// can only be executed inside it when they inherit it, otherwise the query stays unavailable and isn't counted.
+		VkQueryPool statisticsPool = state->FrameTiming.StatisticsPool;
+		bool countFragments = statisticsPool && (state->FrameTiming.InheritedQueries || !VulkanShouldRecordInParallel(state));
+		if (statisticsPool) {
+			
+			vkCmdResetQueryPool(commandBuffer, statisticsPool, state->CurrentFrame, 1);
+		}
+		
+		if (countFragments) {
+			
+			vkCmdBeginQuery(commandBuffer, statisticsPool, state->CurrentFrame, 0);
+		}
+		
+		VulkanGraphExecute(&state->RenderGraph, commandBuffer);
+		
+		if (countFragments) {
+			
+			vkCmdEndQuery(commandBuffer, statisticsPool, state->CurrentFrame);
+		}
+		
+		if (queryPool) {
+			
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery + 1);
+		}
+		
+		return vkEndCommandBuffer(commandBuffer) == VK_SUCCESS && !PlatformAtomicLoad(&state->Recorder.Failed);
+	}
+	
+	
+	// Uploads and ownership transfers differ every frame, they go into the slot's own command buffer ahead of the recorded frame
+	static bool VulkanRecordUploadCommands(VulkanState* state, VkCommandBuffer commandBuffer) {
+		
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		VulkanStagingRing* ring = &state->StagingRing;
+		
+		// The ring segment written since the last frame is released with this frame's fence
+		ring->FrameOpen = false;
+		
+		if (!batch->SemaphoreSignaled && ring->CopyCount == 0) {
+			
+			return false;
+		}
+		
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		
+		vkResetCommandBuffer(commandBuffer, 0);
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		// Take over buffers written on the transfer queue, this frame waits on the batch that released them
+		if (batch->SemaphoreSignaled) {
+			
+			VulkanRecordOwnershipTransfer(state, commandBuffer, 0, batch->AcquireStart, false);
+			memmove(batch->Acquires, batch->Acquires + batch->AcquireStart, (batch->AcquireCount - batch->AcquireStart) * sizeof(VkBuffer));
+			batch->AcquireCount -= batch->AcquireStart;
+			batch->AcquireStart = 0;
+		}
+		
+		VulkanRecordStagingCopies(state, commandBuffer);
+		
+		return vkEndCommandBuffer(commandBuffer) == VK_SUCCESS;
+	}
+	
+	static bool VulkanCreateRecordedFrames(VulkanState* state) {
+		
+		u32 count = state->FramesInFlight * state->SwapChain.ImageCount;
+		state->RecordedFrames = (VulkanRecordedFrame*)calloc(count, sizeof(VulkanRecordedFrame));
+		state->RecordedFrameImageCount = state->SwapChain.ImageCount;
+		
+		// Version 0 marks an entry that was never recorded
+		state->DrawVersion = 1;
+		
+		if (!state->RecordedFrames) {
+			
+			return false;
+		}
+		
+		VkCommandBuffer* commandBuffers = (VkCommandBuffer*)malloc(count * sizeof(VkCommandBuffer));
+		if (!commandBuffers) {
+			
+			return false;
+		}
+		
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = state->CommandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = count;
+		
+		bool allocated = vkAllocateCommandBuffers(state->Device, &allocInfo, commandBuffers) == VK_SUCCESS;
+		for (u32 i = 0; allocated && i < count; i++) {
+			
+			(state->RecordedFrames + i)->CommandBuffer = commandBuffers[i];
+		}
+		free(commandBuffers);
+		
+		// Each slice's secondaries come from its pool for the frame slot
+		VulkanRecorder* recorder = &state->Recorder;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = VulkanRecordMaxPhases;
+		
+		VkCommandBuffer secondaries[VulkanRecordMaxPhases];
+		for (u32 i = 0; allocated && i < count; i++) {
+			
+			VulkanRecordedFrame* frame = (state->RecordedFrames + i);
+			frame->Secondaries = (VkCommandBuffer*)calloc(VulkanRecordMaxPhases * recorder->SliceCount, sizeof(VkCommandBuffer));
+			allocated = frame->Secondaries != nullptr;
+			
+			for (u32 j = 0; allocated && j < recorder->SliceCount; j++) {
+				
+				allocInfo.commandPool = (recorder->Slices + j)->CommandPools[i / state->RecordedFrameImageCount];
+				allocated = vkAllocateCommandBuffers(state->Device, &allocInfo, secondaries) == VK_SUCCESS;
+				
+				for (u32 k = 0; allocated && k < VulkanRecordMaxPhases; k++) {
+					
+					frame->Secondaries[k * recorder->SliceCount + j] = secondaries[k];
+				}
+			}
+		}
+		
+		return allocated;
+	}
+	
+	static void VulkanDestroyRecordedFrames(VulkanState* state) {
+		
+		u32 count = state->FramesInFlight * state->RecordedFrameImageCount;
+		for (u32 i = 0; state->RecordedFrames && i < count; i++) {
+			
+			VulkanRecordedFrame* frame = (state->RecordedFrames + i);
+			if (frame->CommandBuffer) {
+				
+				vkFreeCommandBuffers(state->Device, state->CommandPool, 1, &frame->CommandBuffer);
+			}
+			
+			VulkanRecorder* recorder = &state->Recorder;
+			for (u32 j = 0; frame->Secondaries && j < VulkanRecordMaxPhases * recorder->SliceCount; j++) {
+				
+				VkCommandPool pool = (recorder->Slices + j % recorder->SliceCount)->CommandPools[i / state->RecordedFrameImageCount];
+				if (frame->Secondaries[j]) {
+					
+					vkFreeCommandBuffers(state->Device, pool, 1, frame->Secondaries + j);
+				}
+			}
+			free(frame->Secondaries);
+		}
+		free(state->RecordedFrames);
+		state->RecordedFrames = nullptr;
+		state->RecordedFrameImageCount = 0;
+	}
+	
+	// Returns the render pass for this slot and image, re-recorded only when the draw list changed since its last submit.
+	// VK_NULL_HANDLE when it couldn't be recorded, the command buffer may not have been begun then.
+	static VkCommandBuffer VulkanGetRecordedFrame(VulkanState* state, u32 imageIndex) {
+		
+		VulkanRecordedFrame* frame = state->RecordedFrames + state->CurrentFrame * state->RecordedFrameImageCount + imageIndex;
+		VulkanDrawList* drawList = &state->DrawList;
+		
+		// Indirect draws read their parameters from the slot's buffer, so only the batches shape the render pass
+		u64 hash = VulkanHashBytes(drawList->Batches, drawList->BatchCount * sizeof(VulkanDrawBatch));
+		hash = VulkanHashBytes(state->Culling.Jobs, state->Culling.JobCount * sizeof(VulkanCullJob), hash);
+		hash = VulkanHashBytes(state->Culling.Planes, sizeof(state->Culling.Planes), hash);
+		hash = VulkanHashBytes(&state->SwapChain.DepthPyramid.Initialized, sizeof(bool), hash);
+		hash = VulkanHashBytes(&state->RenderGraph.Version, sizeof(u64), hash);
+		for (u32 i = 0; !state->MultiDrawIndirect && i < drawList->Count; i++) {
+			
+			hash = VulkanHashBytes(drawList->Commands + (drawList->Sorted + i)->Index, sizeof(VulkanDrawCommand), hash);
+		}
+		
+		if (frame->Version == state->DrawVersion && frame->DrawListHash == hash && frame->DrawCount == drawList->Count) {
+			
+			state->FrameStats.RecordedFrameReuses++;
+			return frame->CommandBuffer;
+		}
+		
+		state->Recorder.Frame = frame;
+		state->Recorder.FramePhases = 0;
+		state->Recorder.Failed = 0;
+		
+		f64 recordStart = PlatformGetTime();
+		vkResetCommandBuffer(frame->CommandBuffer, 0);
+		bool recorded = VulkanRecordCommandBuffer(state, frame->CommandBuffer, imageIndex);
+		state->FrameStats.RecordTime += PlatformGetTime() - recordStart;
+		
+		if (!recorded) {
+			
+			frame->Version = 0;
+			return VK_NULL_HANDLE;
+		}
+		
+		frame->Version = state->DrawVersion;
+		frame->DrawListHash = hash;
+		frame->DrawCount = drawList->Count;
+		
+		return frame->CommandBuffer;
+	}
+	
+	static void VulkanDestroyDrawList(VulkanState* state) {
+		
+		VulkanDrawList* drawList = &state->DrawList;
+		
+		free(drawList->Commands);
+		free(drawList->Sorted);
+		free(drawList->Scratch);
+		free(drawList->Batches);
+		memset(drawList, 0, sizeof(VulkanDrawList));
+		
+		for (u32 i = 0; i < VulkanMaxDrawBuckets; i++) {
+			
+			free((state->DrawBuckets + i)->Draws);
+		}
+		memset(state->DrawBuckets, 0, sizeof(state->DrawBuckets));
+	}
+	
+	static bool VulkanCreateIndirectBuffers(VulkanState* state) {
+		
+		state->IndirectBuffers = (VulkanIndirectBuffer*)calloc(state->FramesInFlight, sizeof(VulkanIndirectBuffer));
+		
+		return state->IndirectBuffers != nullptr;
+	}
+	
+	static void VulkanDestroyIndirectBuffers(VulkanState* state) {
+		
+		for (u32 i = 0; state->IndirectBuffers && i < state->FramesInFlight; i++) {
+			
+			VulkanIndirectBuffer* indirectBuffer = (state->IndirectBuffers + i);
+			VulkanDestroyBuffer(state, &indirectBuffer->Commands);
+			VulkanDestroyBuffer(state, &indirectBuffer->Counts);
+			VulkanDestroyBuffer(state, &indirectBuffer->Instances);
+		}
+		free(state->IndirectBuffers);
+		state->IndirectBuffers = nullptr;
+	}
+	
+	static bool VulkanCreateComputePipeline(VulkanState* state, const char* path, VkPipelineLayout layout, VkPipeline* pipeline) {
+		
+		VulkanShaderCode code = VulkanLoadShaderCode(path);
+		if (!code.Data) {
+			
+			return false;
+		}
+		
+		VkShaderModule module = VulkanCreateShaderModule(state, &code);
+		free(code.Data);
+		
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = module;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = layout;
+		
+		VkResult result = vkCreateComputePipelines(state->Device, state->PipelineCache, 1, &pipelineInfo, nullptr, pipeline);
+		vkDestroyShaderModule(state->Device, module, nullptr);
+		
+		if (result != VK_SUCCESS) {
+			
+			*pipeline = VK_NULL_HANDLE;
+			return false;
+		}
+		
+		return true;
+	}
+	
+	static bool VulkanCreateDescriptorSetLayout(VulkanState* state, VkDescriptorType* types, u32 count, VkDescriptorSetLayout* layout) {
+		
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		for (u32 i = 0; i < count; i++) {
+			
+			bindings[i].binding = i;
+			bindings[i].descriptorType = types[i];
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = count;
+		layoutInfo.pBindings = bindings;
+		
+		return vkCreateDescriptorSetLayout(state->Device, &layoutInfo, nullptr, layout) == VK_SUCCESS;
+	}
+	
+	// Only devices that can draw a whole batch indirectly cull, elsewhere culled draws simply draw every instance
+	static bool VulkanCreateCulling(VulkanState* state) {
+		
+		VulkanCulling* culling = &state->Culling;
+		
+		Vector4 planes[6] = {
+			{ 1.0f, 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f, 1.0f },
+			{ 0.0f, 1.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f, 1.0f },
+			{ 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f, 1.0f },
+		};
+		memcpy(culling->Planes, planes, sizeof(planes));
+		
+		if (!state->MultiDrawIndirect) {
+			
+			return true;
+		}
+		
+		// Set 0 holds the instance buffer being culled and its visibility, set 1 the slot's survivors and draw commands,
+		// set 2 the depth pyramid. The pyramid build reads one level and writes the next.
+		VkDescriptorType bufferTypes[] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+		VkDescriptorType buildTypes[] = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE };
+		
+		bool complete = VulkanCreateDescriptorSetLayout(state, bufferTypes, 2, &culling->SourceLayout);
+		complete &= VulkanCreateDescriptorSetLayout(state, bufferTypes, 2, &culling->TargetLayout);
+		complete &= VulkanCreateDescriptorSetLayout(state, buildTypes, 1, &culling->PyramidLayout);
+		complete &= VulkanCreateDescriptorSetLayout(state, buildTypes, 2, &culling->BuildLayout);
+		
+		if (!complete) {
+			
+			return false;
+		}
+		
+		VkDescriptorSetLayout setLayouts[] = { culling->SourceLayout, culling->TargetLayout, culling->PyramidLayout };
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(culling->Planes) + sizeof(u32) + sizeof(VulkanCullConstants);
+		
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = ARRAY_SIZE(setLayouts);
+		pipelineLayoutInfo.pSetLayouts = setLayouts;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		
+		if (vkCreatePipelineLayout(state->Device, &pipelineLayoutInfo, nullptr, &culling->PipelineLayout) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &culling->BuildLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
+		
+		if (vkCreatePipelineLayout(state->Device, &pipelineLayoutInfo, nullptr, &culling->BuildPipelineLayout) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		if (!VulkanCreateComputePipeline(state, DepthPyramidShaderPath, culling->BuildPipelineLayout, &culling->BuildPipeline) ||
+			!VulkanCreateComputePipeline(state, CullShaderPath, culling->PipelineLayout, &culling->Pipeline)) {
+			
+			return false;
+		}
+		
+		// Sources and pyramids are freed one by one, pyramids of retired swap chains live on for a few frames
+		VkDescriptorPoolSize poolSizes[3]{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[0].descriptorCount = 2 * CullMaxSources + 2 * state->FramesInFlight;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		poolSizes[1].descriptorCount = DepthPyramidMaxSets;
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSizes[2].descriptorCount = DepthPyramidMaxSets;
+		
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		poolInfo.maxSets = CullMaxSources + state->FramesInFlight + DepthPyramidMaxSets;
+		poolInfo.poolSizeCount = ARRAY_SIZE(poolSizes);
+		poolInfo.pPoolSizes = poolSizes;
+		
+		if (vkCreateDescriptorPool(state->Device, &poolInfo, nullptr, &culling->DescriptorPool) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = culling->DescriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &culling->TargetLayout;
+		
+		for (u32 i = 0; i < state->FramesInFlight; i++) {
+			
+			if (vkAllocateDescriptorSets(state->Device, &allocateInfo, &(state->IndirectBuffers + i)->CullSet) != VK_SUCCESS) {
+				
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	static void VulkanDestroyCulling(VulkanState* state) {
+		
+		VulkanCulling* culling = &state->Culling;
+		
+		vkDestroyPipeline(state->Device, culling->Pipeline, nullptr);
+		vkDestroyPipeline(state->Device, culling->BuildPipeline, nullptr);
+		vkDestroyPipelineLayout(state->Device, culling->PipelineLayout, nullptr);
+		vkDestroyPipelineLayout(state->Device, culling->BuildPipelineLayout, nullptr);
+		vkDestroyDescriptorPool(state->Device, culling->DescriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(state->Device, culling->SourceLayout, nullptr);
+		vkDestroyDescriptorSetLayout(state->Device, culling->TargetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(state->Device, culling->PyramidLayout, nullptr);
+		vkDestroyDescriptorSetLayout(state->Device, culling->BuildLayout, nullptr);
+		free(culling->Jobs);
+		memset(culling, 0, sizeof(VulkanCulling));
+	}
+	
+	static VkDescriptorSet VulkanAllocateCullSet(VulkanState* state, VkDescriptorSetLayout layout) {
+		
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = state->Culling.DescriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &layout;
+		
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		if (vkAllocateDescriptorSets(state->Device, &allocateInfo, &set) != VK_SUCCESS) {
+			
+			return VK_NULL_HANDLE;
+		}
+		
+		return set;
+	}
+	
+	static void VulkanDestroyCullSource(VulkanState* state, VulkanCullSource* source) {
+		
+		if (source->Set) {
+			
+			vkFreeDescriptorSets(state->Device, state->Culling.DescriptorPool, 1, &source->Set);
+		}
+		VulkanDestroyBuffer(state, &source->Visibility);
+		free(source);
+	}
+	
+	// Allocated the first time the buffer is culled and kept until the buffer is destroyed.
+	// Every instance starts out hidden, so the first frame draws all of it in the late phase.
+	static VkDescriptorSet VulkanGetCullSource(VulkanState* state, VulkanBuffer* instanceBuffer) {
+		
+		if (instanceBuffer->CullSource || !state->Culling.Pipeline) {
+			
+			return instanceBuffer->CullSource ? instanceBuffer->CullSource->Set : VK_NULL_HANDLE;
+		}
+		
+		VulkanCullSource* source = (VulkanCullSource*)calloc(1, sizeof(VulkanCullSource));
+		if (!source) {
+			
+			return VK_NULL_HANDLE;
+		}
+		
+		VkDeviceSize visibilitySize = (instanceBuffer->Allocation.Size / sizeof(InstanceData)) * sizeof(u32);
+		void* zeros = calloc(1, (size_t)visibilitySize);
+		source->Set = VulkanAllocateCullSet(state, state->Culling.SourceLayout);
+		
+		bool complete = zeros && source->Set;
+		complete = complete && VulkanCreateBuffer(state, &source->Visibility, visibilitySize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		complete = complete && VulkanUploadBuffer(state, &source->Visibility, zeros, visibilitySize);
+		free(zeros);
+		
+		if (!complete) {
+			
+			VulkanDestroyCullSource(state, source);
+			return VK_NULL_HANDLE;
+		}
+		
+		VkDescriptorBufferInfo bufferInfos[2]{};
+		bufferInfos[0].buffer = instanceBuffer->Buffer;
+		bufferInfos[0].range = VK_WHOLE_SIZE;
+		bufferInfos[1].buffer = source->Visibility.Buffer;
+		bufferInfos[1].range = VK_WHOLE_SIZE;
+		
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = source->Set;
+		write.dstBinding = 0;
+		write.descriptorCount = 2;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos;
+		
+		vkUpdateDescriptorSets(state->Device, 1, &write, 0, nullptr);
+		
+		instanceBuffer->CullSource = source;
+		return source->Set;
+	}
+	
+	static void VulkanDestroyDepthPyramid(VulkanState* state, VulkanDepthPyramid* pyramid) {
+		
+		for (u32 i = 0; pyramid->LevelViews && i < pyramid->LevelCount; i++) {
+			
+			vkDestroyImageView(state->Device, pyramid->LevelViews[i], nullptr);
+		}
+		
+		for (u32 i = 0; pyramid->BuildSets && i < pyramid->LevelCount; i++) {
+			
+			if (pyramid->BuildSets[i]) {
+				
+				vkFreeDescriptorSets(state->Device, state->Culling.DescriptorPool, 1, pyramid->BuildSets + i);
+			}
+		}
+		
+		if (pyramid->CullSet) {
+			
+			vkFreeDescriptorSets(state->Device, state->Culling.DescriptorPool, 1, &pyramid->CullSet);
+		}
+		
+		free(pyramid->LevelViews);
+		free(pyramid->BuildSets);
+		VulkanDestroyImage(state, &pyramid->Image);
+		memset(pyramid, 0, sizeof(VulkanDepthPyramid));
+	}
+	
+	// Farthest depth of every 2x2 block, level 0 covers the depth buffer at half its size.
+	// Levels are built one after the other, each reading the one before it.
+	static bool VulkanCreateDepthPyramid(VulkanState* state) {
+		
+		VulkanCulling* culling = &state->Culling;
+		VulkanDepthPyramid* pyramid = &state->SwapChain.DepthPyramid;
+		if (!culling->Pipeline) {
+			
+			return true;
+		}
+		
+		pyramid->Extent.width = state->SwapChain.Extent.width > 1 ? state->SwapChain.Extent.width / 2 : 1;
+		pyramid->Extent.height = state->SwapChain.Extent.height > 1 ? state->SwapChain.Extent.height / 2 : 1;
+		
+		u32 size = pyramid->Extent.width > pyramid->Extent.height ? pyramid->Extent.width : pyramid->Extent.height;
+		pyramid->LevelCount = 1;
+		while (size >> pyramid->LevelCount) {
+			
+			pyramid->LevelCount++;
+		}
+		
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		pyramid->LevelViews = (VkImageView*)calloc(pyramid->LevelCount, sizeof(VkImageView));
+		pyramid->BuildSets = (VkDescriptorSet*)calloc(pyramid->LevelCount, sizeof(VkDescriptorSet));
+		
+		if (!pyramid->LevelViews || !pyramid->BuildSets || !VulkanCreateImage(state, &pyramid->Image, pyramid->Extent, pyramid->LevelCount, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT, usage, VK_IMAGE_ASPECT_COLOR_BIT)) {
+			
+			return false;
+		}
+		
+		for (u32 i = 0; i < pyramid->LevelCount; i++) {
+			
+			pyramid->LevelViews[i] = VulkanCreateImageView(state, pyramid->Image.Image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
+			pyramid->BuildSets[i] = VulkanAllocateCullSet(state, culling->BuildLayout);
+			
+			if (!pyramid->LevelViews[i] || !pyramid->BuildSets[i]) {
+				
+				return false;
+			}
+			
+			VkDescriptorImageInfo imageInfos[2]{};
+			imageInfos[0].imageView = i == 0 ? state->SwapChain.Depth.View : pyramid->LevelViews[i - 1];
+			imageInfos[0].imageLayout = i == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+			imageInfos[1].imageView = pyramid->LevelViews[i];
+			imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			
+			VkWriteDescriptorSet writes[2]{};
+			for (u32 j = 0; j < ARRAY_SIZE(writes); j++) {
+				
+				writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[j].dstSet = pyramid->BuildSets[i];
+				writes[j].dstBinding = j;
+				writes[j].descriptorCount = 1;
+				writes[j].descriptorType = j == 0 ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+				writes[j].pImageInfo = (imageInfos + j);
+			}
+			
+			// Multisampled depth is transient, the pyramid keeps its far clear and only the frustum test rejects
+			bool sourced = i > 0 || state->SwapChain.SampleCount == VK_SAMPLE_COUNT_1_BIT;
+			vkUpdateDescriptorSets(state->Device, sourced ? 2 : 1, sourced ? writes : writes + 1, 0, nullptr);
+		}
+		
+		pyramid->CullSet = VulkanAllocateCullSet(state, culling->PyramidLayout);
+		if (!pyramid->CullSet) {
+			
+			return false;
+		}
+		
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageView = pyramid->Image.View;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = pyramid->CullSet;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		write.pImageInfo = &imageInfo;
+		
+		vkUpdateDescriptorSets(state->Device, 1, &write, 0, nullptr);
+		
+		// Cleared to the far plane by the first frame that culls, until then nothing counts as occluded
+		pyramid->Initialized = false;
+		
+		return true;
+	}
+	
+	// Host visible so the CPU can fill it every frame, device local as well where the device has such memory
+	static bool VulkanCreateIndirectBuffer(VulkanState* state, VulkanBuffer* buffer, VkDeviceSize size) {
+		
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		
+		if (VulkanCreateBuffer(state, buffer, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+			
+			return true;
+		}
+		
+		return VulkanCreateBuffer(state, buffer, size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+	
+	// The slot's fence has been waited on, so its buffers are free to grow
+	static bool VulkanReserveIndirectBuffer(VulkanState* state, u32 commandCount, u32 batchCount) {
+		
+		VulkanIndirectBuffer* indirectBuffer = (state->IndirectBuffers + state->CurrentFrame);
+		bool complete = true;
+		
+		if (commandCount > indirectBuffer->CommandCapacity) {
+			
+			u32 capacity = indirectBuffer->CommandCapacity ? indirectBuffer->CommandCapacity : 1024;
+			while (capacity < commandCount) {
+				
+				capacity *= 2;
+			}
+			
+			VulkanDestroyBuffer(state, &indirectBuffer->Commands);
+			complete &= VulkanCreateIndirectBuffer(state, &indirectBuffer->Commands, capacity * sizeof(VkDrawIndexedIndirectCommand));
+			indirectBuffer->CommandCapacity = complete ? capacity : 0;
+			indirectBuffer->CullSetDirty = true;
+			VulkanInvalidateRecordedFrames(state);
+		}
+		
+		if (batchCount > indirectBuffer->CountCapacity) {
+			
+			u32 capacity = indirectBuffer->CountCapacity ? indirectBuffer->CountCapacity : 256;
+			while (capacity < batchCount) {
+				
+				capacity *= 2;
+			}
+			
+			VulkanDestroyBuffer(state, &indirectBuffer->Counts);
+			complete &= VulkanCreateIndirectBuffer(state, &indirectBuffer->Counts, capacity * sizeof(u32));
+			indirectBuffer->CountCapacity = complete ? capacity : 0;
+			VulkanInvalidateRecordedFrames(state);
+		}
+		
+		return complete;
+	}
+	
+	// Written only by the culling pass and read as the instance binding, so it never has to be host visible
+	static bool VulkanReserveCulledInstances(VulkanState* state, u32 instanceCount) {
+		
+		VulkanIndirectBuffer* indirectBuffer = (state->IndirectBuffers + state->CurrentFrame);
+		if (instanceCount <= indirectBuffer->InstanceCapacity) {
+			
+			return true;
+		}
+		
+		u32 capacity = indirectBuffer->InstanceCapacity ? indirectBuffer->InstanceCapacity : 4096;
+		while (capacity < instanceCount) {
+			
+			capacity *= 2;
+		}
+		
+		VulkanDestroyBuffer(state, &indirectBuffer->Instances);
+		VulkanInvalidateRecordedFrames(state);
+		indirectBuffer->InstanceCapacity = 0;
+		indirectBuffer->CullSetDirty = true;
+		
+		if (!VulkanCreateBuffer(state, &indirectBuffer->Instances, capacity * sizeof(InstanceData), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			
+			return false;
+		}
+		
+		indirectBuffer->InstanceCapacity = capacity;
+		return true;
+	}
+	
+	// Points the slot's target set at its current buffers, the fence of the slot has been waited on
+	static void VulkanUpdateCullTarget(VulkanState* state) {
+		
+		VulkanIndirectBuffer* indirectBuffer = (state->IndirectBuffers + state->CurrentFrame);
+		if (!indirectBuffer->CullSetDirty) {
+			
+			return;
+		}
+		
+		VkDescriptorBufferInfo bufferInfos[2]{};
+		bufferInfos[0].buffer = indirectBuffer->Instances.Buffer;
+		bufferInfos[0].range = VK_WHOLE_SIZE;
+		bufferInfos[1].buffer = indirectBuffer->Commands.Buffer;
+		bufferInfos[1].range = VK_WHOLE_SIZE;
+		
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = indirectBuffer->CullSet;
+		write.dstBinding = 0;
+		write.descriptorCount = 2;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos;
+		
+		vkUpdateDescriptorSets(state->Device, 1, &write, 0, nullptr);
+		indirectBuffer->CullSetDirty = false;
+	}
+	
+	// Splits the sorted draws into batches and writes their parameters to the slot's indirect buffer,
+	// culled draws start with no instances and get their count from the culling pass
+	static bool VulkanBuildDrawBatches(VulkanState* state) {
+		
+		VulkanDrawList* drawList = &state->DrawList;
+		VulkanCulling* culling = &state->Culling;
+		VulkanIndirectBuffer* indirectBuffer = (state->IndirectBuffers + state->CurrentFrame);
+		drawList->BatchCount = 0;
+		culling->JobCount = 0;
+		
+		u32 culledInstanceCount = 0;
+		u32 culledDrawCount = 0;
+		for (u32 i = 0; culling->Pipeline && i < drawList->Count; i++) {
+			
+			VulkanDrawCommand* command = (drawList->Commands + i);
+			if (command->CullSet) {
+				
+				culledInstanceCount += command->InstanceCount;
+				culledDrawCount++;
+			}
+		}
+		
+		if (culledDrawCount > culling->JobCapacity) {
+			
+			u32 capacity = culling->JobCapacity ? culling->JobCapacity : 64;
+			while (capacity < culledDrawCount) {
+				
+				capacity *= 2;
+			}
+			
+			VulkanCullJob* jobs = (VulkanCullJob*)realloc(culling->Jobs, capacity * sizeof(VulkanCullJob));
+			if (!jobs) {
+				
+				return false;
+			}
+			
+			culling->Jobs = jobs;
+			culling->JobCapacity = capacity;
+		}
+		
+		// The late phase compacts into a second region behind the early one
+		bool cull = culledDrawCount > 0 && VulkanReserveCulledInstances(state, 2 * culledInstanceCount);
+		
+		for (u32 i = 0; i < drawList->Count; i++) {
+			
+			VulkanDrawCommand* command = (drawList->Commands + (drawList->Sorted + i)->Index);
+			VulkanDrawBatch* batch = drawList->BatchCount ? (drawList->Batches + drawList->BatchCount - 1) : nullptr;
+			
+			// Every culled draw reads its survivors from the slot's instance buffer, so they batch together
+			VkBuffer instanceBuffer = cull && command->CullSet ? indirectBuffer->Instances.Buffer : command->InstanceBuffer;
+			
+			if (batch && batch->Pipeline == command->Pipeline && batch->VertexBuffer == command->VertexBuffer && batch->IndexBuffer == command->IndexBuffer && batch->InstanceBuffer == instanceBuffer) {
+				
+				batch->Count++;
+				continue;
+			}
+			
+			if (drawList->BatchCount == drawList->BatchCapacity) {
+				
+				u32 capacity = drawList->BatchCapacity ? drawList->BatchCapacity * 2 : 64;
+				VulkanDrawBatch* batches = (VulkanDrawBatch*)realloc(drawList->Batches, capacity * sizeof(VulkanDrawBatch));
+				
+				if (!batches) {
+					
+					return false;
+				}
+				
+				drawList->Batches = batches;
+				drawList->BatchCapacity = capacity;
+			}
+			
+			// Padding takes part in the recorded frame hash
+			batch = (drawList->Batches + drawList->BatchCount++);
+			memset(batch, 0, sizeof(VulkanDrawBatch));
+			batch->Pipeline = command->Pipeline;
+			batch->DepthPipeline = command->DepthPipeline;
+			batch->VertexBuffer = command->VertexBuffer;
+			batch->IndexBuffer = command->IndexBuffer;
+			batch->InstanceBuffer = instanceBuffer;
+			batch->First = i;
+			batch->Count = 1;
+		}
+		
+		if (!state->MultiDrawIndirect || drawList->Count == 0) {
+			
+			return true;
+		}
+		
+		if (!VulkanReserveIndirectBuffer(state, 2 * drawList->Count, drawList->BatchCount)) {
+			
+			return false;
+		}
+		
+		VkDrawIndexedIndirectCommand* indirectCommands = (VkDrawIndexedIndirectCommand*)indirectBuffer->Commands.Allocation.Mapped;
+		u32* counts = (u32*)indirectBuffer->Counts.Allocation.Mapped;
+		u32 firstVisible = 0;
+		
+		for (u32 i = 0; i < drawList->Count; i++) {
+			
+			VulkanDrawCommand* command = (drawList->Commands + (drawList->Sorted + i)->Index);
+			VkDrawIndexedIndirectCommand* indirectCommand = (indirectCommands + i);
+			indirectCommand->indexCount = command->IndexCount;
+			indirectCommand->instanceCount = command->InstanceCount;
+			indirectCommand->firstIndex = command->FirstIndex;
+			indirectCommand->vertexOffset = command->VertexOffset;
+			indirectCommand->firstInstance = command->FirstInstance;
+			
+			if (!cull || !command->CullSet) {
+				
+				continue;
+			}
+			
+			// Padding takes part in the recorded frame hash
+			VulkanCullJob* job = (culling->Jobs + culling->JobCount++);
+			memset(job, 0, sizeof(VulkanCullJob));
+			job->Source = command->CullSet;
+			job->Constants.FirstInstance = command->FirstInstance;
+			job->Constants.InstanceCount = command->InstanceCount;
+			job->Constants.Command = i;
+			job->Constants.FirstVisible = firstVisible;
+			job->Constants.Radius = command->BoundingRadius;
+			
+			indirectCommand->instanceCount = 0;
+			indirectCommand->firstInstance = firstVisible;
+			firstVisible += command->InstanceCount;
+		}
+		
+		// Commands of the late phase mirror the early ones, only culled draws ever get instances there
+		for (u32 i = 0; cull && i < drawList->Count; i++) {
+			
+			VkDrawIndexedIndirectCommand* lateCommand = (indirectCommands + drawList->Count + i);
+			*lateCommand = *(indirectCommands + i);
+			lateCommand->instanceCount = 0;
+			lateCommand->firstInstance += culledInstanceCount;
+		}
+		
+		for (u32 i = 0; i < drawList->BatchCount; i++) {
+			
+			counts[i] = (drawList->Batches + i)->Count;
+		}
+		
+		if (cull) {
+			
+			VulkanUpdateCullTarget(state);
+		}
+		
+		return true;
+	}
+	
+	static bool VulkanReserveDrawList(VulkanDrawList* drawList, u32 count) {
+		
+		if (count <= drawList->Capacity) {
+			
+			return true;
+		}
+		
+		u32 capacity = drawList->Capacity ? drawList->Capacity * 2 : 256;
+		capacity = capacity > count ? capacity : count;
+		
+		VulkanDrawCommand* commands = (VulkanDrawCommand*)realloc(drawList->Commands, capacity * sizeof(VulkanDrawCommand));
+		if (!commands) {
+			
+			return false;
+		}
+		drawList->Commands = commands;
+		
+		VulkanDrawSortEntry* sorted = (VulkanDrawSortEntry*)realloc(drawList->Sorted, capacity * sizeof(VulkanDrawSortEntry));
+		if (!sorted) {
+			
+			return false;
+		}
+		drawList->Sorted = sorted;
+		
+		VulkanDrawSortEntry* scratch = (VulkanDrawSortEntry*)realloc(drawList->Scratch, capacity * sizeof(VulkanDrawSortEntry));
+		if (!scratch) {
+			
+			return false;
+		}
+		drawList->Scratch = scratch;
+		
+		drawList->Capacity = capacity;
+		return true;
+	}
+	
+	// Stable LSD radix sort over the key bytes, bytes that are the same for every draw are skipped
+	static void VulkanSortDrawList(VulkanDrawList* drawList) {
+		
+		VulkanDrawSortEntry* source = drawList->Sorted;
+		VulkanDrawSortEntry* destination = drawList->Scratch;
+		u32 count = drawList->Count;
+		
+		// Nothing was ever submitted, Sorted may not even be allocated yet
+		if (count == 0) {
+			
+			return;
+		}
+		
+		for (u32 shift = 0; shift < 64; shift += 8) {
+			
+			u32 offsets[256]{};
+			for (u32 i = 0; i < count; i++) {
+				
+				offsets[((source + i)->Key >> shift) & 0xff]++;
+			}
+			
+			if (offsets[(source->Key >> shift) & 0xff] == count) {
+				
+				continue;
+			}
+			
+			u32 total = 0;
+			for (u32 i = 0; i < 256; i++) {
+				
+				u32 bucketCount = offsets[i];
+				offsets[i] = total;
+				total += bucketCount;
+			}
+			
+			for (u32 i = 0; i < count; i++) {
+				
+				VulkanDrawSortEntry* entry = (source + i);
+				destination[offsets[(entry->Key >> shift) & 0xff]++] = *entry;
+			}
+			
+			VulkanDrawSortEntry* swap = source;
+			source = destination;
+			destination = swap;
+		}
+		
+		drawList->Sorted = source;
+		drawList->Scratch = destination;
+	}
+	
+	static bool VulkanCreateSyncObjects(VulkanState* state) {
+		
+		state->ImageAvailableSemaphores = (VkSemaphore*)malloc(state->FramesInFlight * sizeof(VkSemaphore));
+		state->ImageAvailableSemaphoreCount = state->FramesInFlight;
+		
+		state->RenderFinishedSemaphores = (VkSemaphore*)malloc(state->FramesInFlight * sizeof(VkSemaphore));
+		state->RenderFinishedSemaphoreCount = state->FramesInFlight;
+		
+		state->InFlightFences = (VkFence*)malloc(state->FramesInFlight * sizeof(VkFence));
+		state->InFlightFenceCount = state->FramesInFlight;
+		
+		if (state->ImageAvailableSemaphores && state->RenderFinishedSemaphores && state->InFlightFences) {
+			
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+			
+			bool complete = true;
+			for (u32 i = 0; i < state->FramesInFlight; i++) {
+				
+				VkSemaphore* imageAvailableSemaphore = (state->ImageAvailableSemaphores + i);
+				VkSemaphore* renderFinishedSemaphore = (state->RenderFinishedSemaphores + i);
+				VkFence* inFlightFence = (state->InFlightFences + i);
+				
+				VkResult imageAvailable = vkCreateSemaphore(state->Device, &semaphoreInfo, nullptr, imageAvailableSemaphore);
+				VkResult renderFinished = vkCreateSemaphore(state->Device, &semaphoreInfo, nullptr, renderFinishedSemaphore);
+				VkResult inFlight = vkCreateFence(state->Device, &fenceInfo, nullptr, inFlightFence);
+				
+				if (imageAvailable != VK_SUCCESS || renderFinished != VK_SUCCESS || inFlight != VK_SUCCESS) {
+					
+					complete = false;
+					break;
+				}
+			}
+			
+			return complete;
+		}
+		else {
+			
+			return false;
+		}
+	}
+	
+	static bool VulkanCreateFrameTiming(VulkanState* state) {
+		
+		VulkanFrameTiming* timing = &state->FrameTiming;
+		VulkanQueueFamilyIndices indices = VulkanFindQueueFamilies(state, &state->PhysicalDevice);
+		
+		u32 queueFamilyCount{};
+		VkQueueFamilyProperties* queueFamilies{};
+		vkGetPhysicalDeviceQueueFamilyProperties(state->PhysicalDevice, &queueFamilyCount, nullptr);
+		queueFamilies = (VkQueueFamilyProperties*)malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+		
+		if (!queueFamilies) {
+			
+			return false;
+		}
+		
+		vkGetPhysicalDeviceQueueFamilyProperties(state->PhysicalDevice, &queueFamilyCount, queueFamilies);
+		u32 validBits = (queueFamilies + indices.GraphicsFamily)->timestampValidBits;
+		free(queueFamilies);
+		
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(state->PhysicalDevice, &properties);
+		
+		timing->QueryPool = VK_NULL_HANDLE;
+		timing->StatisticsPool = VK_NULL_HANDLE;
+		timing->InheritedQueries = false;
+		timing->TimestampPeriod = (f64)properties.limits.timestampPeriod * 1e-9;
+		timing->TimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		timing->ClockCalibrated = false;
+		
+		// The device enables pipeline statistics and inherited queries whenever it has them
+		VkPhysicalDeviceFeatures features{};
+		vkGetPhysicalDeviceFeatures(state->PhysicalDevice, &features);
+		timing->InheritedQueries = features.inheritedQueries == VK_TRUE;
+		
+		if (features.pipelineStatisticsQuery) {
+			
+			VkQueryPoolCreateInfo statisticsPoolInfo{};
+			statisticsPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			statisticsPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			statisticsPoolInfo.queryCount = state->FramesInFlight;
+			statisticsPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+			
+			if (vkCreateQueryPool(state->Device, &statisticsPoolInfo, nullptr, &timing->StatisticsPool) != VK_SUCCESS) {
+				
+				timing->StatisticsPool = VK_NULL_HANDLE;
+			}
+		}
+		
+		// Frame stats still count waits and latency without GPU timestamps
+		if (validBits == 0) {
+			
+			return true;
+		}
+		
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = state->FramesInFlight * 2;
+		
+		return vkCreateQueryPool(state->Device, &queryPoolInfo, nullptr, &timing->QueryPool) == VK_SUCCESS;
+	}
+	
+	// Called right after waiting on the current frame's fence, folds the frame that last used this slot into the stats
+	static void VulkanCollectFrameTiming(VulkanState* state, f64 inputTime) {
+		
+		VulkanFrameTiming* timing = &state->FrameTiming;
+		VulkanFrameStats* stats = &state->FrameStats;
+		u32 slot = state->CurrentFrame;
+		f64 now = PlatformGetTime();
+		
+		stats->WaitTime += now - inputTime;
+		
+		if (!timing->Pending[slot]) {
+			
+			return;
+		}
+		timing->Pending[slot] = false;
+		
+		// Without timestamps the frame is only known to be done by now
+		f64 completeTime = now;
+		
+		u64 timestamps[2]{};
+		if (timing->QueryPool && vkGetQueryPoolResults(state->Device, timing->QueryPool, slot * 2, 2, sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			
+			f64 start = (f64)(timestamps[0] & timing->TimestampMask) * timing->TimestampPeriod;
+			f64 end = (f64)(timestamps[1] & timing->TimestampMask) * timing->TimestampPeriod;
+			
+			// The smallest offset consistent with every frame starting after its submit, exact once a frame found the GPU idle
+			f64 offset = timing->SubmitTimes[slot] - start;
+			if (!timing->ClockCalibrated || offset > timing->ClockOffset) {
+				
+				timing->ClockOffset = offset;
+				timing->ClockCalibrated = true;
+			}
+			
+			stats->GpuTime += end - start;
+			completeTime = end + timing->ClockOffset;
+		}
+		
+		u64 fragmentInvocations = 0;
+		if (timing->StatisticsPool && vkGetQueryPoolResults(state->Device, timing->StatisticsPool, slot, 1, sizeof(fragmentInvocations), &fragmentInvocations, sizeof(u64), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			
+			stats->FragmentInvocations += fragmentInvocations;
+		}
+		
+		f64 latency = completeTime - timing->InputTimes[slot];
+		stats->Latency += latency;
+		stats->MaxLatency = latency > stats->MaxLatency ? latency : stats->MaxLatency;
+		stats->FrameCount++;
+	}
+	
+	// Called once the current frame is submitted, before CurrentFrame advances
+	static void VulkanMarkFrameSubmitted(VulkanState* state, f64 inputTime) {
+		
+		VulkanFrameTiming* timing = &state->FrameTiming;
+		u32 slot = state->CurrentFrame;
+		
+		timing->InputTimes[slot] = inputTime;
+		timing->SubmitTimes[slot] = PlatformGetTime();
+		timing->Pending[slot] = true;
+	}
+	
+	static void VulkanFramebufferResizeCallback(GLFWwindow* window, i32 width, i32 height) {
+		
+		VulkanState* state = (VulkanState*)glfwGetWindowUserPointer(window);
+		PlatformAtomicStore(&state->SwapChain.FramebufferWidth, (u32)width);
+		PlatformAtomicStore(&state->SwapChain.FramebufferHeight, (u32)height);
+		PlatformAtomicStore(&state->SwapChain.FramebufferResized, 1);
+	}
+	
+	static bool VulkanCreateFramebufferResizeCallback(VulkanState* state) {
+		
+		glfwSetWindowUserPointer(state->Window->NativeHandle, state);
+		glfwSetFramebufferSizeCallback(state->Window->NativeHandle, VulkanFramebufferResizeCallback);
+		
+		return true;
+	}
+	
+	static void VulkanDestroyRetiredSwapChain(VulkanState* state, VulkanRetiredSwapChain* retired) {
+		
+		// Image Views
+		for (u32 i = 0; i < retired->ImageViewCount; i++) {
+			
+			vkDestroyImageView(state->Device, retired->ImageViews[i], nullptr);
+		}
+		free(retired->ImageViews);
+		
+		// SwapChain
+		if (state->Headless) {
+			
+			for (u32 i = 0; i < retired->ImageCount; i++) {
+				
+				vkDestroyImage(state->Device, retired->Images[i], nullptr);
+				VulkanFree(&state->Allocator, retired->ImageAllocations + i);
+			}
+			free(retired->ImageAllocations);
+		}
+		else {
+			
+			vkDestroySwapchainKHR(state->Device, retired->SwapChain, nullptr);
+		}
+		free(retired->Images);
+		
+		// Depth
+		VulkanDestroyDepthPyramid(state, &retired->DepthPyramid);
+		VulkanDestroyImage(state, &retired->Depth);
+	}
+	
+	// Hands the size dependent objects over to the retired list, the swap chain handle stays set as oldSwapchain for its successor
+	static bool VulkanRetireSwapChain(VulkanState* state) {
+		
+		VulkanSwapChain* swapChain = &state->SwapChain;
 		
+		if (swapChain->RetiredCount == swapChain->RetiredCapacity) {
+			
+			u32 capacity = swapChain->RetiredCapacity ? swapChain->RetiredCapacity * 2 : 4;
+			VulkanRetiredSwapChain* retired = (VulkanRetiredSwapChain*)realloc(swapChain->Retired, capacity * sizeof(VulkanRetiredSwapChain));
+			
+			if (!retired) {
+				
+				return false;
+			}
+			
+			swapChain->Retired = retired;
+			swapChain->RetiredCapacity = capacity;
+		}
+		
+		VulkanRetiredSwapChain* retired = (swapChain->Retired + swapChain->RetiredCount++);
+		retired->SwapChain = swapChain->SwapChain;
+		retired->Images = swapChain->Images;
+		retired->ImageAllocations = swapChain->ImageAllocations;
+		retired->ImageCount = swapChain->ImageCount;
+		retired->ImageViews = swapChain->ImageViews;
+		retired->ImageViewCount = swapChain->ImageViewCount;
+		retired->Depth = swapChain->Depth;
+		retired->DepthPyramid = swapChain->DepthPyramid;
+		retired->RetiredFrame = state->FrameNumber;
+		
+		// The render graph's framebuffers reference the image views
+		VulkanGraphRetireFramebuffers(&state->RenderGraph, state->FrameNumber);
+		
+		swapChain->Images = nullptr;
+		swapChain->ImageAllocations = nullptr;
+		swapChain->ImageViews = nullptr;
+		memset(&swapChain->Depth, 0, sizeof(VulkanImage));
+		memset(&swapChain->DepthPyramid, 0, sizeof(VulkanDepthPyramid));
+		
+		return true;
+	}
+	
+	// Called after waiting on the current frame's fence, every frame submitted FramesInFlight frames ago has finished
+	static void VulkanCollectRetiredSwapChains(VulkanState* state, bool all) {
+		
+		VulkanSwapChain* swapChain = &state->SwapChain;
+		
+		u32 count = 0;
+		for (u32 i = 0; i < swapChain->RetiredCount; i++) {
+			
+			VulkanRetiredSwapChain* retired = (swapChain->Retired + i);
+			if (all || state->FrameNumber >= retired->RetiredFrame + state->FramesInFlight) {
+				
+				VulkanDestroyRetiredSwapChain(state, retired);
+			}
+			else {
+				
+				swapChain->Retired[count++] = *retired;
+			}
+		}
+		swapChain->RetiredCount = count;
+		
+		VulkanGraphCollectGarbage(&state->RenderGraph, state->FrameNumber, state->FramesInFlight, all);
+	}
+	
+	static void VulkanCleanupSwapChain(VulkanState* state) {
+		
+		VulkanWaitIdle(state);
+		
+		// Pipelines, every variant is built against the render pass
+		VulkanDestroyPipelineVariants(state, VK_NULL_HANDLE);
+		VulkanDestroyRenderPass(state);
+		
+		VulkanRetireSwapChain(state);
+		VulkanCollectRetiredSwapChains(state, true);
+		free(state->SwapChain.Retired);
+		state->SwapChain.Retired = nullptr;
+		state->SwapChain.RetiredCapacity = 0;
+	}
+	
+	static bool VulkanCreatePresentTargets(VulkanState* state) {
+		
+		if (state->Headless) {
+			
+			return VulkanCreateOffscreenImages(state);
+		}
+		
+		return VulkanCreateSwapChain(state);
+	}
+	
+	static bool VulkanRecreateSwapChain(VulkanState* state) {
+		
+		// Wait while the window size is zero
+		if (!state->Headless && !state->DrawsOffWindowThread) {
+			
+			i32 width{};
+			i32 height{};
+			glfwGetFramebufferSize(state->Window->NativeHandle, &width, &height);
+			while (width == 0 || height == 0) {
+				
+				glfwGetFramebufferSize(state->Window->NativeHandle, &width, &height);
+				glfwWaitEvents();
+			}
+			PlatformAtomicStore(&state->SwapChain.FramebufferWidth, (u32)width);
+			PlatformAtomicStore(&state->SwapChain.FramebufferHeight, (u32)height);
+		}
+		else if (!state->Headless && (PlatformAtomicLoad(&state->SwapChain.FramebufferWidth) == 0 || PlatformAtomicLoad(&state->SwapChain.FramebufferHeight) == 0)) {
+			
+			// Tried again on the next frame, until then acquires keep failing and frames are dropped
+			PlatformAtomicStore(&state->SwapChain.FramebufferResized, 1);
+			return true;
+		}
+		
+		VkFormat imageFormat = state->SwapChain.ImageFormat;
+		
+		if (!VulkanRetireSwapChain(state)) {
+			
+			return false;
+		}
+		
+		u32 result = 1;
+		
+		result &= (u32)VulkanCreatePresentTargets(state);
+		result &= (u32)VulkanCreateImageViews(state);
+		result &= (u32)VulkanCreateDepthBuffer(state);
+		
+		// Render pass and pipelines only depend on the format, which practically never changes
+		if (state->SwapChain.ImageFormat != imageFormat) {
+			
+			VulkanWaitIdle(state);
+			VulkanDestroyRenderPass(state);
+			
+			result &= (u32)VulkanCreateRenderPass(state);
+			result &= (u32)VulkanRebuildPipelineVariants(state);
+			result &= (u32)VulkanBindShaderPipeline(state, false);
+		}
+		
+		result &= (u32)VulkanCreateDepthPyramid(state);
+		
+		// Recorded frames point at the old images, a different image count also changes the table layout
+		if (state->SwapChain.ImageCount != state->RecordedFrameImageCount) {
+			
+			VulkanWaitIdle(state);
+			VulkanDestroyRecordedFrames(state);
+			result &= (u32)VulkanCreateRecordedFrames(state);
+		}
+		VulkanInvalidateRecordedFrames(state);
+		
+		return result;
+	}
+	
+	static bool VulkanStateCreate(VulkanState* state) {
+		
+		u32 result = 1;
+		
+		result &= (u32)PlatformMutexInit(&state->QueueMutex);
+		result &= (u32)PlatformMutexInit(&state->BufferIds.Mutex);
+		result &= (u32)PlatformMutexInit(&state->Pipeline.VariantIds.Mutex);
 		result &= (u32)VulkanCreateInstance(state);
 		result &= (u32)VulkanCreateDebugMessenger(state);
 		result &= (u32)VulkanCreateSurface(state);
 		result &= (u32)VulkanPickPhysicalDevice(state);
 		result &= (u32)VulkanCreateLogicalDevice(state);
-		result &= (u32)VulkanCreateSwapChain(state);
+		result &= (u32)VulkanAllocatorInit(&state->Allocator, state->PhysicalDevice, state->Device);
+		result &= (u32)VulkanGraphInit(&state->RenderGraph, state->Device, &state->Allocator, &state->QueueMutex, state->CmdBeginRendering, state->CmdEndRendering);
+		result &= (u32)VulkanCreatePresentTargets(state);
 		result &= (u32)VulkanCreateImageViews(state);
+		result &= (u32)VulkanPickDepthFormat(state);
+		state->SwapChain.SampleCount = VK_SAMPLE_COUNT_1_BIT;
+		result &= (u32)VulkanCreateDepthBuffer(state);
 		result &= (u32)VulkanCreateRenderPass(state);
 		
 		// At this point we want to load the default Shader
@@ -1095,247 +4113,932 @@ namespace handmade {
 		state->Shader = defaultShader;
 		state->DefaultShader = defaultShader;
 		
-		result &= (u32)VulkanCreateGraphicsPipeline(state);
-		result &= (u32)VulkanCreateFramebuffers(state);
+		// Draws with an instance buffer and no shader of their own use this one
+		result &= (u32)VulkanCreateInstancedShader(
+												   state,
+												   &state->InstancedShader,
+												   "assets/handmade_instanced_vert.spv",
+												   "assets/handmade_triangle_frag.spv");
+		
+		result &= (u32)VulkanCreatePipelineCache(state);
+		result &= (u32)VulkanCreatePipelineLayout(state);
+		result &= (u32)VulkanCreatePipelineCompiler(state);
+		
+		f64 pipelineStart = PlatformGetTime();
+		result &= (u32)VulkanBindShaderPipeline(state, false);
+		f64 pipelineTime = PlatformGetTime() - pipelineStart;
+		
+		fprintf(stdout, "[Vulkan] - Graphics pipeline created in %lf ms (%s pipeline cache)\n", pipelineTime * 1000.0, state->PipelineCacheWarm ? "warm" : "cold");
 		result &= (u32)VulkanCreateCommandPool(state);
 		result &= (u32)VulkanCreateCommandBuffers(state);
+		result &= (u32)VulkanCreateRecorder(state, 0);
+		result &= (u32)VulkanCreateRecordedFrames(state);
+		result &= (u32)VulkanCreateIndirectBuffers(state);
+		result &= (u32)VulkanCreateCulling(state);
+		result &= (u32)VulkanCreateDepthPyramid(state);
 		result &= (u32)VulkanCreateSyncObjects(state);
+		result &= (u32)VulkanCreateFrameTiming(state);
+		result &= (u32)VulkanCreateStagingRing(state);
+		result &= (u32)VulkanCreateUploadBatch(state);
+		
+		return result;
+	}
+	
+	static u32 VulkanClampFramesInFlight(u32 framesInFlight) {
+		
+		framesInFlight = framesInFlight > VulkanMinFramesInFlight ? framesInFlight : VulkanMinFramesInFlight;
+		return framesInFlight < VulkanMaxFramesInFlight ? framesInFlight : VulkanMaxFramesInFlight;
+	}
+	
+	bool VulkanStateInit(VulkanState* state, Window* window, u32 framesInFlight) {
+		
+		state->Window = window;
+		state->Headless = false;
+		state->FramesInFlight = VulkanClampFramesInFlight(framesInFlight);
+		
+		i32 width{};
+		i32 height{};
+		glfwGetFramebufferSize(window->NativeHandle, &width, &height);
+		state->SwapChain.FramebufferWidth = (u32)width;
+		state->SwapChain.FramebufferHeight = (u32)height;
+		
+		return VulkanStateCreate(state) && VulkanCreateFramebufferResizeCallback(state);
+	}
+	
+	bool VulkanStateInitHeadless(VulkanState* state, u32 width, u32 height, u32 framesInFlight) {
+		
+		state->Window = nullptr;
+		state->Headless = true;
+		state->FramesInFlight = VulkanClampFramesInFlight(framesInFlight);
+		state->SwapChain.Extent.width = width;
+		state->SwapChain.Extent.height = height;
+		
+		return VulkanStateCreate(state);
+	}
+	
+	bool VulkanStateDestroy(VulkanState* state) {
+		
+		// Pipeline Compiler, no worker may touch the device after this
+		VulkanDestroyPipelineCompiler(state);
+		
+		// Swap Chain
+		VulkanCleanupSwapChain(state);
+		
+		// Destroy the default shaders
+		VulkanDestroyShader(state, &state->DefaultShader);
+		VulkanDestroyShader(state, &state->InstancedShader);
+		
+		// Pipeline Cache
+		if (!VulkanSavePipelineCache(state)) {
+			
+			fprintf(stderr, "[Vulkan] - Couldn't write %s\n", PipelineCachePath);
+		}
+		vkDestroyPipelineCache(state->Device, state->PipelineCache, nullptr);
+		vkDestroyPipelineLayout(state->Device, state->Pipeline.PipeLineLayout, nullptr);
+		
+		// Sync Objects
+		for (u32 i = 0; i < state->FramesInFlight; i++) {
+			
+			VkSemaphore* imageAvailableSemaphore = (state->ImageAvailableSemaphores + i);
+			VkSemaphore* renderFinishedSemaphore = (state->RenderFinishedSemaphores + i);
+			VkFence* inFlightFence = (state->InFlightFences + i);
+			
+			vkDestroySemaphore(state->Device, *renderFinishedSemaphore, nullptr);
+			vkDestroySemaphore(state->Device, *imageAvailableSemaphore, nullptr);
+			vkDestroyFence(state->Device, *inFlightFence, nullptr);
+		}
+		free(state->ImageAvailableSemaphores);
+		free(state->RenderFinishedSemaphores);
+		free(state->InFlightFences);
+		
+		// Frame Timing
+		vkDestroyQueryPool(state->Device, state->FrameTiming.QueryPool, nullptr);
+		vkDestroyQueryPool(state->Device, state->FrameTiming.StatisticsPool, nullptr);
+		
+		// Uploads
+		VulkanDestroyUploadBatch(state);
+		VulkanDestroyStagingRing(state);
+		
+		VulkanDestroyRecordedFrames(state);
+		VulkanDestroyRecorder(state);
+		VulkanDestroyDrawList(state);
+		VulkanDestroyCulling(state);
+		VulkanDestroyIndirectBuffers(state);
+		vkDestroyCommandPool(state->Device, state->CommandPool, nullptr);
+		free(state->CommandBuffers);
+		
+		// Device Memory
+		VulkanGraphDestroy(&state->RenderGraph);
+		VulkanAllocatorDestroy(&state->Allocator);
+		
+		// Device
+		vkDestroyDevice(state->Device, nullptr);
+		
+		// Debug Messenger
+		if (EnableValidationLayers) {
+			
+			VulkanDestroyDebugUtilsMessengerEXT(state->Instance, state->DebugMessenger, nullptr);
+		}
+		
+		// Instance and Surface
+		if (!state->Headless) {
+			
+			vkDestroySurfaceKHR(state->Instance, state->Surface, nullptr);
+		}
+		vkDestroyInstance(state->Instance, nullptr);
+		VulkanDestroyIdPool(&state->Pipeline.VariantIds);
+		VulkanDestroyIdPool(&state->BufferIds);
+		PlatformMutexDestroy(&state->QueueMutex);
+		
+		return true;
+	}
+	
+	void VulkanResetFrameStats(VulkanState* state) {
+		
+		memset(&state->FrameStats, 0, sizeof(VulkanFrameStats));
+	}
+	
+	bool VulkanCreateVertexBuffer(VulkanState* state, VulkanBuffer* vertexBuffer, Vertex* vertices, u32 count) {
+		
+		VkDeviceSize bufferSize = count * sizeof(Vertex);
+		
+		// Create the vertex buffer
+		if (!VulkanCreateBuffer(state, vertexBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			
+			return false;
+		}
+		
+		return VulkanUploadBuffer(state, vertexBuffer, vertices, bufferSize);
+	}
+	
+	void VulkanDestroyVertexBuffer(VulkanState* state, VulkanBuffer* vertexBuffer) {
+		
+		VulkanWaitIdle(state);
+		VulkanForgetUploads(state, vertexBuffer->Buffer);
+		VulkanInvalidateRecordedFrames(state);
+		VulkanDestroyBuffer(state, vertexBuffer);
+	}
+	
+	bool VulkanVertexBufferSetData(VulkanState* state, VulkanBuffer* vertexBuffer, Vertex* vertices, u32 count) {
+		
+		VkDeviceSize bufferSize = count * sizeof(Vertex);
+		return VulkanUploadBuffer(state, vertexBuffer, vertices, bufferSize);
+	}
+	
+	bool VulkanCreateIndexBuffer(VulkanState* state, VulkanBuffer* indexBuffer, u32* indices, u32 count) {
+		
+		VkDeviceSize bufferSize = count * sizeof(u32);
+		
+		if (!VulkanCreateBuffer(state, indexBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			
+			return false;
+		}
+		
+		return VulkanUploadBuffer(state, indexBuffer, indices, bufferSize);
+	}
+	
+	void VulkanDestroyIndexBuffer(VulkanState* state, VulkanBuffer* indexBuffer) {
+		
+		VulkanWaitIdle(state);
+		VulkanForgetUploads(state, indexBuffer->Buffer);
+		VulkanInvalidateRecordedFrames(state);
+		VulkanDestroyBuffer(state, indexBuffer);
+	}
+	
+	bool VulkanIndexBufferSetData(VulkanState* state, VulkanBuffer* indexBuffer, u32* indices, u32 count) {
+		
+		VkDeviceSize bufferSize = count * sizeof(u32);
+		return VulkanUploadBuffer(state, indexBuffer, indices, bufferSize);
+	}
+	
+	bool VulkanCreateInstanceBuffer(VulkanState* state, VulkanBuffer* instanceBuffer, InstanceData* instances, u32 count) {
+		
+		VkDeviceSize bufferSize = count * sizeof(InstanceData);
+		
+		// Also read as a storage buffer by the culling pass
+		if (!VulkanCreateBuffer(state, instanceBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			
+			return false;
+		}
+		
+		return VulkanUploadBuffer(state, instanceBuffer, instances, bufferSize);
+	}
+	
+	void VulkanDestroyInstanceBuffer(VulkanState* state, VulkanBuffer* instanceBuffer) {
+		
+		VulkanWaitIdle(state);
+		VulkanForgetUploads(state, instanceBuffer->Buffer);
+		VulkanInvalidateRecordedFrames(state);
+		
+		if (instanceBuffer->CullSource) {
+			
+			VulkanForgetUploads(state, instanceBuffer->CullSource->Visibility.Buffer);
+			VulkanDestroyCullSource(state, instanceBuffer->CullSource);
+			instanceBuffer->CullSource = nullptr;
+		}
+		VulkanDestroyBuffer(state, instanceBuffer);
+	}
+	
+	void VulkanSetCullPlanes(VulkanState* state, Vector4* planes) {
+		
+		memcpy(state->Culling.Planes, planes, sizeof(state->Culling.Planes));
+	}
+	
+	bool VulkanSetDepthPrepass(VulkanState* state, bool enable) {
+		
+		if (state->DepthPrepass == enable) {
+			
+			return true;
+		}
+		
+		// Every variant changes its depth state, the ones not bound right now are rebuilt in the background
+		VulkanWaitIdle(state);
+		state->DepthPrepass = enable;
+		
+		return VulkanRebuildPipelineVariants(state) && VulkanBindShaderPipeline(state, false);
+	}
+	
+	bool VulkanSetSampleCount(VulkanState* state, u32 samples) {
+		
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(state->PhysicalDevice, &properties);
+		
+		VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+		VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
+		for (u32 count = VK_SAMPLE_COUNT_64_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1) {
+			
+			if (count <= samples && (supported & count)) {
+				
+				sampleCount = (VkSampleCountFlagBits)count;
+				break;
+			}
+		}
+		
+		if (state->SwapChain.SampleCount == sampleCount) {
+			
+			return true;
+		}
+		
+		// The render pass, attachments and every pipeline depend on the sample count
+		VulkanWaitIdle(state);
+		VulkanDestroyRenderPass(state);
+		state->SwapChain.SampleCount = sampleCount;
+		
+		u32 result = 1;
+		result &= (u32)VulkanCreateRenderPass(state);
+		result &= (u32)VulkanRecreateSwapChain(state);
+		result &= (u32)VulkanRebuildPipelineVariants(state);
+		result &= (u32)VulkanBindShaderPipeline(state, false);
+		
+		return result;
+	}
+	
+	bool VulkanSetRecordThreads(VulkanState* state, u32 count) {
+		
+		// Every recorded frame holds secondaries of every slice
+		VulkanWaitIdle(state);
+		VulkanDestroyRecordedFrames(state);
+		VulkanDestroyRecorder(state);
+		
+		u32 result = 1;
+		result &= (u32)VulkanCreateRecorder(state, count);
+		result &= (u32)VulkanCreateRecordedFrames(state);
+		
+		return result;
+	}
+	
+	bool VulkanInstanceBufferSetData(VulkanState* state, VulkanBuffer* instanceBuffer, InstanceData* instances, u32 count) {
+		
+		VkDeviceSize bufferSize = count * sizeof(InstanceData);
+		return VulkanUploadBuffer(state, instanceBuffer, instances, bufferSize);
+	}
+	
+	bool VulkanBeginUploads(VulkanState* state) {
+		
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		
+		if (batch->Recording) {
+			
+			return true;
+		}
+		
+		// Only one batch is in flight, the previous one has to finish before its staging memory is reused
+		VulkanCollectUploads(state, true);
+		
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		
+		vkResetCommandBuffer(batch->CommandBuffer, 0);
+		if (vkBeginCommandBuffer(batch->CommandBuffer, &beginInfo) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		// Sharing the graphics queue, frames submitted earlier may still read the buffers this batch writes.
+		// Ring copies queued before the batch have to land first, otherwise the next frame would overwrite newer data.
+		// A dedicated transfer queue gets both from the graphics submit in VulkanEndUploads instead.
+		if (batch->TransferFamily == batch->GraphicsFamily) {
+			
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(batch->CommandBuffer, UploadReaderStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+			
+			VulkanRecordStagingCopies(state, batch->CommandBuffer);
+		}
 		
-		return result;
+		batch->Recording = true;
+		
+		return true;
 	}
 	
-	bool VulkanStateDestroy(VulkanState* state) {
+	bool VulkanEndUploads(VulkanState* state) {
 		
-		// Swap Chain
-		VulkanCleanupSwapChain(state);
+		VulkanUploadBatch* batch = &state->UploadBatch;
 		
-		// Destroy the default shader
-		VulkanDestroyShader(state, &state->DefaultShader);
+		if (!batch->Recording) {
+			
+			return false;
+		}
 		
-		// Sync Objects
-		for (u32 i = 0; i < FramesInFlight; i++) {
+		batch->Recording = false;
+		
+		bool dedicated = batch->TransferFamily != batch->GraphicsFamily;
+		
+		// Hand everything written by this batch over to the graphics family
+		if (dedicated) {
 			
-			VkSemaphore* imageAvailableSemaphore = (state->ImageAvailableSemaphores + i);
-			VkSemaphore* renderFinishedSemaphore = (state->RenderFinishedSemaphores + i);
-			VkFence* inFlightFence = (state->InFlightFences + i);
+			VulkanRecordOwnershipTransfer(state, batch->CommandBuffer, batch->AcquireStart, batch->AcquireCount - batch->AcquireStart, true);
+			batch->AcquireStart = batch->AcquireCount;
+		}
+		
+		if (vkEndCommandBuffer(batch->CommandBuffer) != VK_SUCCESS) {
 			
-			vkDestroySemaphore(state->Device, *renderFinishedSemaphore, nullptr);
-			vkDestroySemaphore(state->Device, *imageAvailableSemaphore, nullptr);
-			vkDestroyFence(state->Device, *inFlightFence, nullptr);
+			return false;
 		}
-		free(state->ImageAvailableSemaphores);
-		free(state->RenderFinishedSemaphores);
 		
-		vkDestroyCommandPool(state->Device, state->CommandPool, nullptr);
-		free(state->CommandBuffers);
+		VkSemaphore waitSemaphores[2]{};
+		VkPipelineStageFlags waitStages[2]{};
+		u32 waitCount = 0;
 		
-		// Device
-		vkDestroyDevice(state->Device, nullptr);
+		// A signal no frame has waited on yet is consumed here, a binary semaphore can't be signaled twice
+		if (batch->SemaphoreSignaled) {
+			
+			waitSemaphores[waitCount] = batch->Semaphore;
+			waitStages[waitCount] = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			waitCount++;
+		}
 		
-		// Debug Messenger
-		if (EnableValidationLayers) {
+		// On its own queue the batch starts after the frames submitted so far and the ring copies queued before it
+		if (dedicated) {
 			
-			VulkanDestroyDebugUtilsMessengerEXT(state->Instance, state->DebugMessenger, nullptr);
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			
+			vkResetCommandBuffer(batch->GraphicsCommandBuffer, 0);
+			vkBeginCommandBuffer(batch->GraphicsCommandBuffer, &beginInfo);
+			VulkanRecordStagingCopies(state, batch->GraphicsCommandBuffer);
+			vkEndCommandBuffer(batch->GraphicsCommandBuffer);
+			
+			VkSubmitInfo graphicsSubmitInfo{};
+			graphicsSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			graphicsSubmitInfo.commandBufferCount = 1;
+			graphicsSubmitInfo.pCommandBuffers = &batch->GraphicsCommandBuffer;
+			graphicsSubmitInfo.signalSemaphoreCount = 1;
+			graphicsSubmitInfo.pSignalSemaphores = &batch->GraphicsSemaphore;
+			
+			PlatformMutexLock(&state->QueueMutex);
+			VkResult submitted = vkQueueSubmit(state->GraphicsQueue, 1, &graphicsSubmitInfo, VK_NULL_HANDLE);
+			PlatformMutexUnlock(&state->QueueMutex);
+			
+			if (submitted != VK_SUCCESS) {
+				
+				return false;
+			}
+			
+			waitSemaphores[waitCount] = batch->GraphicsSemaphore;
+			waitStages[waitCount] = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			waitCount++;
 		}
 		
-		// Instance and Surface
-		vkDestroySurfaceKHR(state->Instance, state->Surface, nullptr);
-		vkDestroyInstance(state->Instance, nullptr);
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.waitSemaphoreCount = waitCount;
+		submitInfo.pWaitSemaphores = waitSemaphores;
+		submitInfo.pWaitDstStageMask = waitStages;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch->CommandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &batch->Semaphore;
+		
+		vkResetFences(state->Device, 1, &batch->Fence);
+		
+		PlatformMutexLock(&state->QueueMutex);
+		VkResult submitted = vkQueueSubmit(state->TransferQueue, 1, &submitInfo, batch->Fence);
+		PlatformMutexUnlock(&state->QueueMutex);
+		
+		if (submitted != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		batch->Pending = true;
+		batch->SemaphoreSignaled = true;
 		
 		return true;
 	}
 	
-	bool VulkanCreateVertexBuffer(VulkanState* state, VulkanBuffer* vertexBuffer, Vertex* vertices, u32 count) {
+	bool VulkanCreateUploadContext(VulkanState* state, VulkanUploadContext* context) {
 		
-		VkDeviceSize bufferSize = count * sizeof(Vertex);
-		VulkanBuffer stagingBuffer{};
+		memset(context, 0, sizeof(VulkanUploadContext));
+		context->State = state;
+		
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = state->UploadBatch.GraphicsFamily;
 		
-		// Create the staging buffer
-		if (!VulkanCreateBuffer(state, &stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		if (vkCreateCommandPool(state->Device, &poolInfo, nullptr, &context->CommandPool) != VK_SUCCESS) {
 			
 			return false;
 		}
 		
-		void* data;
-		vkMapMemory(state->Device, stagingBuffer.BufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, vertices, (size_t)bufferSize);
-		vkUnmapMemory(state->Device, stagingBuffer.BufferMemory);
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = context->CommandPool;
+		allocInfo.commandBufferCount = 1;
+		
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 		
-		// Create the vertex buffer
-		if (!VulkanCreateBuffer(state, vertexBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+		VkResult commandBuffer = vkAllocateCommandBuffers(state->Device, &allocInfo, &context->CommandBuffer);
+		VkResult fence = vkCreateFence(state->Device, &fenceInfo, nullptr, &context->Fence);
+		
+		return commandBuffer == VK_SUCCESS && fence == VK_SUCCESS;
+	}
+	
+	// Frees the staging memory of the last submit once it has finished, optionally waiting for it
+	static void VulkanCollectUploadContext(VulkanUploadContext* context, bool wait) {
+		
+		VulkanState* state = context->State;
+		
+		if (!context->Pending) {
 			
-			return false;
+			return;
 		}
 		
-		if (!VulkanCopyBuffer(state, stagingBuffer.Buffer, vertexBuffer->Buffer, bufferSize)) {
+		if (wait) {
 			
-			return false;
+			vkWaitForFences(state->Device, 1, &context->Fence, VK_TRUE, UINT64_MAX);
+		}
+		else if (vkGetFenceStatus(state->Device, context->Fence) != VK_SUCCESS) {
+			
+			return;
 		}
 		
-		vkDestroyBuffer(state->Device, stagingBuffer.Buffer, nullptr);
-		vkFreeMemory(state->Device, stagingBuffer.BufferMemory, nullptr);
-		
-		return true;
+		VulkanReleaseStaging(state, &context->Staging);
+		context->Pending = false;
 	}
 	
-	void VulkanDestroyVertexBuffer(VulkanState* state, VulkanBuffer* vertexBuffer) {
+	void VulkanDestroyUploadContext(VulkanUploadContext* context) {
 		
-		vkDeviceWaitIdle(state->Device);
-		vkDestroyBuffer(state->Device, vertexBuffer->Buffer, nullptr);
-		vkFreeMemory(state->Device, vertexBuffer->BufferMemory, nullptr);
+		VulkanState* state = context->State;
+		
+		if (!state) {
+			
+			return;
+		}
+		
+		// Whatever was recorded and never submitted is dropped along with the command buffer
+		VulkanCollectUploadContext(context, true);
+		VulkanDestroyStaging(state, &context->Staging);
+		vkDestroyFence(state->Device, context->Fence, nullptr);
+		vkDestroyCommandPool(state->Device, context->CommandPool, nullptr);
+		memset(context, 0, sizeof(VulkanUploadContext));
 	}
 	
-	bool VulkanVertexBufferSetData(VulkanState* state, VulkanBuffer* vertexBuffer, Vertex* vertices, u32 count) {
+	static bool VulkanUploadContextUpload(VulkanUploadContext* context, VulkanBuffer* destination, void* data, VkDeviceSize size) {
 		
-		VkDeviceSize bufferSize = count * sizeof(Vertex);
-		VulkanBuffer stagingBuffer{};
+		VulkanState* state = context->State;
 		
-		// Create the staging buffer
-		if (!VulkanCreateBuffer(state, &stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		if (!context->Recording) {
 			
-			return false;
+			// Only one submit is in flight, the previous one has to finish before its staging memory is reused
+			VulkanCollectUploadContext(context, true);
+			
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			
+			vkResetCommandBuffer(context->CommandBuffer, 0);
+			if (vkBeginCommandBuffer(context->CommandBuffer, &beginInfo) != VK_SUCCESS) {
+				
+				return false;
+			}
+			
+			context->Recording = true;
 		}
 		
-		void* data;
-		vkMapMemory(state->Device, stagingBuffer.BufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, vertices, (size_t)bufferSize);
-		vkUnmapMemory(state->Device, stagingBuffer.BufferMemory);
-		
-		if (!VulkanCopyBuffer(state, stagingBuffer.Buffer, vertexBuffer->Buffer, bufferSize)) {
+		VkBuffer source = VK_NULL_HANDLE;
+		VkBufferCopy copyRegion{};
+		if (!VulkanStage(state, &context->Staging, data, size, &source, &copyRegion.srcOffset)) {
 			
 			return false;
 		}
 		
-		vkDestroyBuffer(state->Device, stagingBuffer.Buffer, nullptr);
-		vkFreeMemory(state->Device, stagingBuffer.BufferMemory, nullptr);
+		copyRegion.dstOffset = 0;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(context->CommandBuffer, source, destination->Buffer, 1, &copyRegion);
 		
 		return true;
 	}
 	
-	bool VulkanCreateIndexBuffer(VulkanState* state, VulkanBuffer* indexBuffer, u32* indices, u32 count) {
+	bool VulkanUploadContextCreateVertexBuffer(VulkanUploadContext* context, VulkanBuffer* vertexBuffer, Vertex* vertices, u32 count) {
+		
+		VkDeviceSize bufferSize = count * sizeof(Vertex);
+		
+		if (!VulkanCreateBuffer(context->State, vertexBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			
+			return false;
+		}
+		
+		return VulkanUploadContextUpload(context, vertexBuffer, vertices, bufferSize);
+	}
+	
+	bool VulkanUploadContextCreateIndexBuffer(VulkanUploadContext* context, VulkanBuffer* indexBuffer, u32* indices, u32 count) {
 		
 		VkDeviceSize bufferSize = count * sizeof(u32);
-		VulkanBuffer stagingBuffer{};
 		
-		if (!VulkanCreateBuffer(state, &stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		if (!VulkanCreateBuffer(context->State, indexBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
 			
 			return false;
 		}
 		
-		void* data;
-		vkMapMemory(state->Device, stagingBuffer.BufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, indices, (size_t)bufferSize);
-		vkUnmapMemory(state->Device, stagingBuffer.BufferMemory);
+		return VulkanUploadContextUpload(context, indexBuffer, indices, bufferSize);
+	}
+	
+	bool VulkanSubmitUploadContext(VulkanUploadContext* context) {
 		
-		if (!VulkanCreateBuffer(state, indexBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+		VulkanState* state = context->State;
+		
+		if (!context->Recording) {
+			
+			return true;
+		}
+		context->Recording = false;
+		
+		// The buffers are new, nothing submitted earlier reads them. Later submits on the queue fall into the second scope.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = UploadReaderAccess;
+		vkCmdPipelineBarrier(context->CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, UploadReaderStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		
+		if (vkEndCommandBuffer(context->CommandBuffer) != VK_SUCCESS) {
 			
 			return false;
 		}
 		
-		if (!VulkanCopyBuffer(state, stagingBuffer.Buffer, indexBuffer->Buffer, bufferSize)) {
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &context->CommandBuffer;
+		
+		vkResetFences(state->Device, 1, &context->Fence);
+		
+		PlatformMutexLock(&state->QueueMutex);
+		VkResult submitted = vkQueueSubmit(state->GraphicsQueue, 1, &submitInfo, context->Fence);
+		PlatformMutexUnlock(&state->QueueMutex);
+		
+		if (submitted != VK_SUCCESS) {
 			
 			return false;
 		}
 		
-		vkDestroyBuffer(state->Device, stagingBuffer.Buffer, nullptr);
-		vkFreeMemory(state->Device, stagingBuffer.BufferMemory, nullptr);
+		context->Pending = true;
 		
 		return true;
 	}
 	
-	void VulkanDestroyIndexBuffer(VulkanState* state, VulkanBuffer* indexBuffer) {
+	// Makes the frame wait for the last upload batch, only the stages touching the uploaded buffers are held back
+	static u32 VulkanAppendUploadWait(VulkanState* state, VkSemaphore* waitSemaphores, VkPipelineStageFlags* waitStages, u32 waitCount) {
 		
-		vkDeviceWaitIdle(state->Device);
-		vkDestroyBuffer(state->Device, indexBuffer->Buffer, nullptr);
-		vkFreeMemory(state->Device, indexBuffer->BufferMemory, nullptr);
+		VulkanUploadBatch* batch = &state->UploadBatch;
+		
+		if (batch->SemaphoreSignaled) {
+			
+			waitSemaphores[waitCount] = batch->Semaphore;
+			waitStages[waitCount] = VK_PIPELINE_STAGE_TRANSFER_BIT | UploadReaderStages;
+			batch->SemaphoreSignaled = false;
+			waitCount++;
+		}
+		
+		return waitCount;
 	}
 	
-	bool VulkanIndexBufferSetData(VulkanState* state, VulkanBuffer* indexBuffer, u32* indices, u32 count) {
+	// Fills commandBuffers with this frame's uploads, if any, followed by its recorded render pass and returns how many there are.
+	// rendered is false when the render pass couldn't be recorded and was left out.
+	static u32 VulkanPrepareFrameCommands(VulkanState* state, u32 imageIndex, VkCommandBuffer* commandBuffers, bool* rendered) {
 		
-		VkDeviceSize bufferSize = count * sizeof(u32);
-		VulkanBuffer stagingBuffer{};
+		u32 count = 0;
 		
-		if (!VulkanCreateBuffer(state, &stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		VkCommandBuffer uploadCommands = *(state->CommandBuffers + state->CurrentFrame);
+		if (VulkanRecordUploadCommands(state, uploadCommands)) {
 			
-			return false;
+			commandBuffers[count++] = uploadCommands;
 		}
 		
-		void* data;
-		vkMapMemory(state->Device, stagingBuffer.BufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, indices, (size_t)bufferSize);
-		vkUnmapMemory(state->Device, stagingBuffer.BufferMemory);
-		
-		if (!VulkanCopyBuffer(state, stagingBuffer.Buffer, indexBuffer->Buffer, bufferSize)) {
+		VulkanSortDrawList(&state->DrawList);
+		if (!VulkanBuildDrawBatches(state)) {
 			
-			return false;
+			state->DrawList.BatchCount = 0;
 		}
+		VkCommandBuffer renderCommands = VulkanGetRecordedFrame(state, imageIndex);
+		if (renderCommands) {
+			
+			commandBuffers[count++] = renderCommands;
+		}
+		*rendered = renderCommands != VK_NULL_HANDLE;
 		
-		vkDestroyBuffer(state->Device, stagingBuffer.Buffer, nullptr);
-		vkFreeMemory(state->Device, stagingBuffer.BufferMemory, nullptr);
-		
-		return true;
+		return count;
 	}
 	
-	bool VulkanDrawIndexed(VulkanState* state, VulkanBuffer* vertexBuffer, VulkanBuffer* indexBuffer, u32 indexCount) {
+	bool VulkanBeginFrame(VulkanState* state) {
 		
-		VkSemaphore* imageAvailableSemaphore = (state->ImageAvailableSemaphores + state->CurrentFrame);
-		VkSemaphore* renderFinishedSemaphore = (state->RenderFinishedSemaphores + state->CurrentFrame);
+		VulkanFrame* frame = &state->Frame;
 		VkFence* inFlightFence = (state->InFlightFences + state->CurrentFrame);
-		VkCommandBuffer* commandBuffer = (state->CommandBuffers + state->CurrentFrame);
+		VkSemaphore* imageAvailableSemaphore = (state->ImageAvailableSemaphores + state->CurrentFrame);
+		
+		state->DrawList.Count = 0;
+		frame->Active = false;
+		
+		// Callers sample input right before drawing, everything from here until the GPU is done counts as latency
+		frame->InputTime = PlatformGetTime();
 		
 		vkWaitForFences(state->Device, 1, inFlightFence, VK_TRUE, UINT64_MAX);
+		VulkanCollectFrameTiming(state, frame->InputTime);
+		VulkanCollectUploads(state, false);
+		VulkanCollectRetiredSwapChains(state, false);
 		
-		u32 imageIndex{};
-		VkResult result = vkAcquireNextImageKHR(state->Device, state->SwapChain.SwapChain, UINT64_MAX, *imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
-		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		if (state->Headless) {
 			
-			state->SwapChain.FramebufferResized = false;
-			VulkanRecreateSwapChain(state);
+			// There is no acquire/present, every frame in flight simply owns one offscreen image
+			frame->ImageIndex = state->CurrentFrame % state->SwapChain.ImageCount;
+			frame->Active = true;
 			return true;
 		}
+		
+		VkResult result = vkAcquireNextImageKHR(state->Device, state->SwapChain.SwapChain, UINT64_MAX, *imageAvailableSemaphore, VK_NULL_HANDLE, &frame->ImageIndex);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			
+			// The frame is dropped, Submit and End do nothing until the next VulkanBeginFrame
+			PlatformAtomicStore(&state->SwapChain.FramebufferResized, 0);
+			return VulkanRecreateSwapChain(state);
+		}
 		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
 			
 			return false;
 		}
 		
+		frame->Active = true;
+		return true;
+	}
+	
+	void VulkanSubmitDraw(VulkanState* state, VulkanDraw* draw) {
+		
+		VulkanDrawList* drawList = &state->DrawList;
+		
+		if (!state->Frame.Active || !VulkanReserveDrawList(drawList, drawList->Count + 1)) {
+			
+			return;
+		}
+		
+		// Draws with their own shader request its pipeline without waiting and use the fallback until it is built
+		VulkanPipelineVariant* fallback = draw->InstanceBuffer ? state->Pipeline.InstancedFallback : state->Pipeline.Fallback;
+		VulkanPipelineVariant* variant = draw->InstanceBuffer ? fallback : state->Pipeline.Bound;
+		if (draw->Shader) {
+			
+			VulkanShader* lastShader = &drawList->LastShader;
+			if (!drawList->LastVariant || lastShader->VertexShader != draw->Shader->VertexShader || lastShader->FragmentShader != draw->Shader->FragmentShader || lastShader->Instanced != draw->Shader->Instanced) {
+				
+				drawList->LastShader = *draw->Shader;
+				drawList->LastVariant = VulkanRequestPipeline(state, draw->Shader);
+			}
+			variant = drawList->LastVariant;
+		}
+		
+		if (!variant || PlatformAtomicLoad(&variant->Status) != VulkanPipelineReady) {
+			
+			variant = fallback;
+		}
+		
+		if (!variant || variant->Status != VulkanPipelineReady) {
+			
+			return;
+		}
+		
+		u32 index = drawList->Count++;
+		
+		// Padding takes part in the draw list hash
+		VulkanDrawCommand* command = (drawList->Commands + index);
+		memset(command, 0, sizeof(VulkanDrawCommand));
+		command->Pipeline = variant->Pipeline;
+		command->DepthPipeline = variant->DepthPipeline;
+		command->VertexBuffer = draw->VertexBuffer->Buffer;
+		command->IndexBuffer = draw->IndexBuffer->Buffer;
+		command->IndexCount = draw->IndexCount;
+		command->FirstIndex = draw->FirstIndex;
+		command->VertexOffset = draw->VertexOffset;
+		command->InstanceBuffer = draw->InstanceBuffer ? draw->InstanceBuffer->Buffer : VK_NULL_HANDLE;
+		command->InstanceCount = draw->InstanceBuffer ? draw->InstanceCount : 1;
+		command->FirstInstance = draw->InstanceBuffer ? draw->FirstInstance : 0;
+		
+		if (draw->InstanceBuffer && draw->InstanceCount && draw->BoundingRadius > 0.0f) {
+			
+			command->CullSet = VulkanGetCullSource(state, draw->InstanceBuffer);
+			command->BoundingRadius = draw->BoundingRadius;
+		}
+		
+		f32 depth = draw->Depth < 0.0f ? 0.0f : (draw->Depth > 1.0f ? 1.0f : draw->Depth);
+		u64 key = (u64)(variant->Id & ((1u << DrawKeyPipelineBits) - 1));
+		key = (key << DrawKeyVertexBufferBits) | (u64)(draw->VertexBuffer->Id & ((1u << DrawKeyVertexBufferBits) - 1));
+		key = (key << DrawKeyIndexBufferBits) | (u64)(draw->IndexBuffer->Id & ((1u << DrawKeyIndexBufferBits) - 1));
+		key = (key << DrawKeyDepthBits) | (u64)(depth * (f32)((1u << DrawKeyDepthBits) - 1));
+		
+		VulkanDrawSortEntry* entry = (drawList->Sorted + index);
+		entry->Key = key;
+		entry->Index = index;
+	}
+	
+	// Bucket after bucket in index order, the stable sort keeps that order among draws with equal keys.
+	// Dropped frames empty the buckets all the same.
+	static void VulkanMergeDrawBuckets(VulkanState* state) {
+		
+		for (u32 i = 0; i < VulkanMaxDrawBuckets; i++) {
+			
+			VulkanDrawBucket* bucket = (state->DrawBuckets + i);
+			for (u32 j = 0; j < bucket->Count; j++) {
+				
+				VulkanSubmitDraw(state, bucket->Draws + j);
+			}
+			bucket->Count = 0;
+		}
+	}
+	
+	bool VulkanEndFrame(VulkanState* state) {
+		
+		VulkanFrame* frame = &state->Frame;
+		VkSemaphore* imageAvailableSemaphore = (state->ImageAvailableSemaphores + state->CurrentFrame);
+		VkSemaphore* renderFinishedSemaphore = (state->RenderFinishedSemaphores + state->CurrentFrame);
+		VkFence* inFlightFence = (state->InFlightFences + state->CurrentFrame);
+		
+		VulkanMergeDrawBuckets(state);
+		
+		// The acquire failed or the swap chain was recreated, nothing to submit this time
+		if (!frame->Active) {
+			
+			return true;
+		}
+		frame->Active = false;
+		
 		vkResetFences(state->Device, 1, inFlightFence);
 		
-		vkResetCommandBuffer(*commandBuffer, 0);
-		VulkanRecordCommandBuffer(state, *commandBuffer, imageIndex, vertexBuffer->Buffer, indexBuffer->Buffer, indexCount);
+		VkCommandBuffer commandBuffers[2]{};
+		bool rendered = false;
+		u32 commandBufferCount = VulkanPrepareFrameCommands(state, frame->ImageIndex, commandBuffers, &rendered);
 		
-		VkPipelineStageFlags waitStages[1] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		VkSemaphore waitSemaphores[2]{};
+		VkPipelineStageFlags waitStages[2]{};
+		u32 waitCount = 0;
+		
+		if (!state->Headless) {
+			
+			waitSemaphores[waitCount] = *imageAvailableSemaphore;
+			waitStages[waitCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			waitCount++;
+		}
+		waitCount = VulkanAppendUploadWait(state, waitSemaphores, waitStages, waitCount);
 		
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = imageAvailableSemaphore;
+		submitInfo.waitSemaphoreCount = waitCount;
+		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = commandBuffer;
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.commandBufferCount = commandBufferCount;
+		submitInfo.pCommandBuffers = commandBuffers;
+		submitInfo.signalSemaphoreCount = state->Headless || !rendered ? 0 : 1;
 		submitInfo.pSignalSemaphores = renderFinishedSemaphore;
 		
-		if (vkQueueSubmit(state->GraphicsQueue, 1, &submitInfo, *inFlightFence) != VK_SUCCESS) {
+		// Submitted even without the render pass, the uploads still have to run, the acquire has to be waited for
+		// and the slot's fence signaled
+		PlatformMutexLock(&state->QueueMutex);
+		VkResult submitted = vkQueueSubmit(state->GraphicsQueue, 1, &submitInfo, *inFlightFence);
+		PlatformMutexUnlock(&state->QueueMutex);
+		
+		if (submitted != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		// The image never reached the present layout and no timestamps were written, the frame fails.
+		// Recreating the swap chain hands the acquired image back.
+		if (!rendered) {
+			
+			state->CurrentFrame = (state->CurrentFrame + 1) % state->FramesInFlight;
+			state->FrameNumber++;
+			
+			if (!state->Headless) {
+				
+				VulkanRecreateSwapChain(state);
+			}
 			
 			return false;
 		}
+		VulkanMarkFrameSubmitted(state, frame->InputTime);
 		
-		VkPresentInfoKHR presentInfo{};
-		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = renderFinishedSemaphore;
-		presentInfo.swapchainCount = 1;
-		presentInfo.pSwapchains = &state->SwapChain.SwapChain;
-		presentInfo.pImageIndices = &imageIndex;
-		presentInfo.pResults = nullptr;
+		VkResult result = VK_SUCCESS;
+		if (!state->Headless) {
+			
+			VkPresentInfoKHR presentInfo{};
+			presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+			presentInfo.waitSemaphoreCount = 1;
+			presentInfo.pWaitSemaphores = renderFinishedSemaphore;
+			presentInfo.swapchainCount = 1;
+			presentInfo.pSwapchains = &state->SwapChain.SwapChain;
+			presentInfo.pImageIndices = &frame->ImageIndex;
+			presentInfo.pResults = nullptr;
+			
+			// Locked on its own, a present blocking on the next vertical blank shouldn't keep loaders from submitting before that
+			PlatformMutexLock(&state->QueueMutex);
+			result = vkQueuePresentKHR(state->PresentQueue, &presentInfo);
+			PlatformMutexUnlock(&state->QueueMutex);
+		}
 		
-		vkQueuePresentKHR(state->PresentQueue, &presentInfo);
+		state->CurrentFrame = (state->CurrentFrame + 1) % state->FramesInFlight;
+		state->FrameNumber++;
 		
-		state->CurrentFrame = (state->CurrentFrame + 1) & FramesInFlight;
+		if (PlatformAtomicExchange(&state->SwapChain.FramebufferResized, 0) || result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+			
+			return VulkanRecreateSwapChain(state);
+		}
+		else if (result != VK_SUCCESS) {
+			
+			return false;
+		}
 		
 		return true;
 	}
 	
+	VulkanDrawBucket* VulkanAcquireDrawBucket(VulkanState* state, u32 index) {
+		
+		if (index >= VulkanMaxDrawBuckets) {
+			
+			return nullptr;
+		}
+		
+		return (state->DrawBuckets + index);
+	}
+	
+	void VulkanSubmitDrawToBucket(VulkanDrawBucket* bucket, VulkanDraw* draw) {
+		
+		if (bucket->Count == bucket->Capacity) {
+			
+			u32 capacity = bucket->Capacity ? bucket->Capacity * 2 : 256;
+			VulkanDraw* draws = (VulkanDraw*)realloc(bucket->Draws, capacity * sizeof(VulkanDraw));
+			
+			if (!draws) {
+				
+				return;
+			}
+			
+			bucket->Draws = draws;
+			bucket->Capacity = capacity;
+		}
+		
+		bucket->Draws[bucket->Count++] = *draw;
+	}
+	
+	bool VulkanDrawIndexed(VulkanState* state, VulkanBuffer* vertexBuffer, VulkanBuffer* indexBuffer, u32 indexCount) {
+		
+		if (!VulkanBeginFrame(state)) {
+			
+			return false;
+		}
+		
+		VulkanDraw draw{};
+		draw.VertexBuffer = vertexBuffer;
+		draw.IndexBuffer = indexBuffer;
+		draw.IndexCount = indexCount;
+		VulkanSubmitDraw(state, &draw);
+		
+		return VulkanEndFrame(state);
+	}
+	
 	bool VulkanCreateShader(VulkanState* state, VulkanShader* shader, const char* vertexPath, const char* fragmentPath) {
 		
 		VulkanShaderCode vertexCode = VulkanLoadShaderCode(vertexPath);
@@ -1347,17 +5050,51 @@ namespace handmade {
 		free(vertexCode.Data);
 		free(fragmentCode.Data);
 		
+		shader->Instanced = false;
+		
 		return true;
 	}
 	
+	bool VulkanCreateInstancedShader(VulkanState* state, VulkanShader* shader, const char* vertexPath, const char* fragmentPath) {
+		
+		bool created = VulkanCreateShader(state, shader, vertexPath, fragmentPath);
+		shader->Instanced = true;
+		
+		return created;
+	}
+	
 	bool VulkanUseShader(VulkanState* state, VulkanShader* shader) {
 		
+		// Only the next recorded frame binds the new pipeline, frames in flight keep theirs
+		state->Shader = *shader;
+		return VulkanBindShaderPipeline(state, false);
+	}
+	
+	VulkanPipelineVariant* VulkanRequestPipeline(VulkanState* state, VulkanShader* shader) {
+		
+		VulkanPipelineDescription description;
+		VulkanDescribePipeline(state, shader, &description);
+		
+		return VulkanGetPipeline(state, &description, true);
+	}
+	
+	bool VulkanIsPipelineReady(VulkanPipelineVariant* variant) {
+		
+		return variant && PlatformAtomicLoad(&variant->Status) == VulkanPipelineReady;
+	}
+	
+	bool VulkanUseShaderAsync(VulkanState* state, VulkanShader* shader) {
+		
 		state->Shader = *shader;
-		return VulkanRecreateSwapChain(state);
+		return VulkanBindShaderPipeline(state, true);
 	}
 	
 	void VulkanDestroyShader(VulkanState* state, VulkanShader* shader) {
 		
+		VulkanWaitIdle(state);
+		VulkanDestroyPipelineVariants(state, shader->VertexShader);
+		VulkanDestroyPipelineVariants(state, shader->FragmentShader);
+		
 		vkDestroyShaderModule(state->Device, shader->VertexShader, nullptr);
 		vkDestroyShaderModule(state->Device, shader->FragmentShader, nullptr);
 	}
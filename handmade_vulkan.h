@@ -6,10 +6,15 @@
 #include "handmade_types.h"
 #include "handmade_math.h"
 #include "handmade_window.h"
+#include "handmade_vulkan_allocator.h"
+#include "handmade_vulkan_graph.h"
+#include "handmade_platform.h"
+#include "handmade_jobs.h"
 
 #pragma warning(disable : 26812)
 #include <vulkan/vulkan.h>
 #include <cstdlib>
+#include <cstring>
 
 namespace handmade {
 	
@@ -23,6 +28,45 @@ namespace handmade {
 		
 		VkShaderModule VertexShader;
 		VkShaderModule FragmentShader;
+		
+		// The vertex shader also reads InstanceData from binding 1
+		bool Instanced;
+	};
+	
+	struct VulkanImage {
+		
+		VkImage Image;
+		VulkanAllocation Allocation;
+		VkImageView View;
+	};
+	
+	// Farthest depth of the depth buffer, halved per level. LevelViews and BuildSets hold one entry per level,
+	// CullSet reads all levels in the culling pass
+	struct VulkanDepthPyramid {
+		
+		VulkanImage Image;
+		VkImageView* LevelViews;
+		VkDescriptorSet* BuildSets;
+		VkDescriptorSet CullSet;
+		VkExtent2D Extent;
+		u32 LevelCount;
+		
+		// Cleared to the far plane before its first use, nothing is occluded until it has been built once
+		bool Initialized;
+	};
+	
+	// Size dependent objects of a replaced swap chain, destroyed once no frame in flight can still use them
+	struct VulkanRetiredSwapChain {
+		
+		VkSwapchainKHR SwapChain;
+		VkImage* Images;
+		VulkanAllocation* ImageAllocations;
+		u32 ImageCount;
+		VkImageView* ImageViews;
+		u32 ImageViewCount;
+		VulkanImage Depth;
+		VulkanDepthPyramid DepthPyramid;
+		u64 RetiredFrame;
 	};
 	
 	struct VulkanSwapChain {
@@ -35,22 +79,482 @@ namespace handmade {
 		VkImageView* ImageViews;
 		u32 ImageViewCount;
 		
-		VkFramebuffer* Framebuffers;
-		u32 FramebufferCount;
-		bool FramebufferResized;
+		// Headless mode owns its offscreen images, the swap chain owns them otherwise
+		VulkanAllocation* ImageAllocations;
+		
+		// Shared by every image, the render graph orders frames writing it. Only single sampled frames have it,
+		// multisampled color and depth are transient images of the render graph resolved into the image.
+		VkFormat DepthFormat;
+		VulkanImage Depth;
+		VulkanDepthPyramid DepthPyramid;
+		VkSampleCountFlagBits SampleCount;
+		
+		// Written by the resize callback on the thread polling window events, read by the thread presenting
+		volatile u32 FramebufferResized;
+		volatile u32 FramebufferWidth;
+		volatile u32 FramebufferHeight;
+		
+		VulkanRetiredSwapChain* Retired;
+		u32 RetiredCount;
+		u32 RetiredCapacity;
+	};
+	
+	// Everything a graphics pipeline is built from. It is hashed and compared bytewise, so always start from VulkanDescribePipeline.
+	struct VulkanPipelineDescription {
+		
+		VkShaderModule VertexShader;
+		VkShaderModule FragmentShader;
+		VkRenderPass RenderPass;
+		
+		// Pipelines for dynamic rendering have no render pass and are built from the attachment formats
+		VkFormat ColorFormat;
+		VkFormat DepthFormat;
+		
+		VkPrimitiveTopology Topology;
+		VkPolygonMode PolygonMode;
+		VkCullModeFlags CullMode;
+		VkFrontFace FrontFace;
+		VkBool32 BlendEnable;
+		VkBool32 Instanced;
+		VkBool32 DepthTestEnable;
+		VkBool32 DepthWriteEnable;
+		VkCompareOp DepthCompareOp;
+		VkColorComponentFlags ColorWriteMask;
+		VkSampleCountFlagBits Samples;
+		
+		// Also builds a depth only pipeline for the prepass, the color pipeline then only tests for equal depth
+		VkBool32 DepthPrepass;
+	};
+	
+	static const u32 VulkanPipelinePending = 0;
+	static const u32 VulkanPipelineReady = 1;
+	static const u32 VulkanPipelineFailed = 2;
+	
+	// Doubles as the handle of an asynchronous pipeline request, Pipeline is valid once Status is VulkanPipelineReady
+	struct VulkanPipelineVariant {
+		
+		u64 Hash;
+		VulkanPipelineDescription Description;
+		VkPipeline Pipeline;
+		VkPipeline DepthPipeline;
+		volatile u32 Status;
+		u32 Id;
+	};
+	
+	// Ids for the draw sort key. Released ids are handed out again before new ones, so they only outgrow the bits
+	// the key has for them once that many objects are alive at the same time.
+	struct VulkanIdPool {
+		
+		PlatformMutex Mutex;
+		u32* Free;
+		u32 FreeCount;
+		u32 FreeCapacity;
+		u32 Next;
+	};
+	
+	// Worker threads building requested pipeline variants, Queue is a ring of variants waiting for a worker
+	struct VulkanPipelineCompiler {
+		
+		PlatformThread* Threads;
+		u32 ThreadCount;
+		
+		PlatformMutex Mutex;
+		PlatformConditionVariable WorkAvailable;
+		PlatformConditionVariable WorkDone;
+		
+		VulkanPipelineVariant** Queue;
+		u32 QueueHead;
+		u32 QueueCount;
+		u32 QueueCapacity;
+		u32 ActiveCount;
+		bool Running;
 	};
 	
 	struct VulkanPipeline {
 		
+		// Pipelines are built against RenderPass, it is compatible with every render pass the render graph begins.
+		// Stays VK_NULL_HANDLE with dynamic rendering.
 		VkRenderPass RenderPass;
 		VkPipelineLayout PipeLineLayout;
-		VkPipeline GraphicsPipeline;
+		
+		// Draws use Bound once it is ready and the default shader's pipeline until then
+		VulkanPipelineVariant* Bound;
+		VulkanPipelineVariant* Fallback;
+		VulkanPipelineVariant* InstancedFallback;
+		
+		// Open addressing table of every pipeline built or requested so far, all of them share PipeLineLayout
+		VulkanPipelineVariant** Variants;
+		u32 VariantCount;
+		u32 VariantCapacity;
+		VulkanIdPool VariantIds;
+		
+		VulkanPipelineCompiler Compiler;
+	};
+	
+	// Prefixed to the VkPipelineCache data on disk, a cache from another device or driver is thrown away
+	struct VulkanPipelineCacheHeader {
+		
+		u32 Magic;
+		u32 Version;
+		u32 VendorID;
+		u32 DeviceID;
+		u32 DriverVersion;
+		u8 PipelineCacheUUID[VK_UUID_SIZE];
+		u8 DriverUUID[VK_UUID_SIZE];
+		u64 DataSize;
+		u64 DataHash;
 	};
 	
 	struct VulkanBuffer {
 		
 		VkBuffer Buffer;
-		VkDeviceMemory BufferMemory;
+		VulkanAllocation Allocation;
+		
+		// Small sequential id, draw sort keys use it instead of the handle
+		u32 Id;
+		
+		// Set only for instance buffers once the culling pass has read them
+		struct VulkanCullSource* CullSource;
+	};
+	
+	// Descriptor set of an instance buffer for the culling pass, Visibility keeps one u32 per instance across frames
+	struct VulkanCullSource {
+		
+		VkDescriptorSet Set;
+		VulkanBuffer Visibility;
+	};
+	
+	struct VulkanStagingCopy {
+		
+		VkBuffer Source;
+		VkBuffer Destination;
+		VkBufferCopy Region;
+	};
+	
+	// One persistently mapped host buffer, split into a segment per frame in flight.
+	// A segment is reused once the fence of the frame that consumed its copies has signaled.
+	struct VulkanStagingRing {
+		
+		VulkanBuffer Buffer;
+		VkDeviceSize FrameSize;
+		VkDeviceSize Head;
+		bool FrameOpen;
+		
+		VulkanStagingCopy* Copies;
+		u32 CopyCount;
+		u32 CopyCapacity;
+	};
+	
+	// Host visible buffers uploads are copied from, a new chunk is started whenever an upload doesn't fit the last one
+	struct VulkanStagingChunks {
+		
+		VulkanBuffer* Buffers;
+		u32 Count;
+		u32 Capacity;
+		VkDeviceSize Head;
+	};
+	
+	// Uploads recorded between VulkanBeginUploads and VulkanEndUploads go out in a single submit on the transfer queue.
+	// The next frame waits on Semaphore, the staging buffers are released once Fence has signaled.
+	struct VulkanUploadBatch {
+		
+		VkCommandPool CommandPool;
+		VkCommandBuffer CommandBuffer;
+		VkSemaphore Semaphore;
+		VkFence Fence;
+		
+		// Runs ring copies queued before the batch and orders the batch after earlier frames on a dedicated transfer queue
+		VkCommandBuffer GraphicsCommandBuffer;
+		VkSemaphore GraphicsSemaphore;
+		
+		u32 GraphicsFamily;
+		u32 TransferFamily;
+		
+		// Buffers released by the transfer queue that the next frame has to acquire, AcquireStart marks the current batch
+		VkBuffer* Acquires;
+		u32 AcquireCount;
+		u32 AcquireCapacity;
+		u32 AcquireStart;
+		
+		VulkanStagingChunks Staging;
+		
+		bool Recording;
+		bool Pending;
+		bool SemaphoreSignaled;
+	};
+	
+	// Lets a loader thread create buffers while another thread draws, every such thread needs a context of its own.
+	// Uploads are recorded into a command buffer from the context's pool and copied from its staging chunks,
+	// only the submit is serialized with the state's other queue accesses. Submits go to the graphics queue,
+	// which orders them before every frame submitted afterwards without any semaphore or ownership transfer.
+	struct VulkanUploadContext {
+		
+		struct VulkanState* State;
+		VkCommandPool CommandPool;
+		VkCommandBuffer CommandBuffer;
+		VkFence Fence;
+		VulkanStagingChunks Staging;
+		
+		bool Recording;
+		bool Pending;
+	};
+	
+	// One draw handed to VulkanSubmitDraw, Shader may be null to draw with the shader set by VulkanUseShader,
+	// or with the default instanced shader when InstanceBuffer is set
+	struct VulkanDraw {
+		
+		VulkanBuffer* VertexBuffer;
+		VulkanBuffer* IndexBuffer;
+		u32 IndexCount;
+		u32 FirstIndex;
+		i32 VertexOffset;
+		VulkanShader* Shader;
+		
+		// InstanceCount copies of the mesh, each reading one InstanceData, left null for a single copy
+		VulkanBuffer* InstanceBuffer;
+		u32 InstanceCount;
+		u32 FirstInstance;
+		
+		// Normalized to [0, 1], draws sharing state are ordered front to back
+		f32 Depth;
+		
+		// Radius of the mesh around its origin, instanced draws that set it have their instances frustum culled on the GPU
+		f32 BoundingRadius;
+	};
+	
+	struct VulkanDrawCommand {
+		
+		VkPipeline Pipeline;
+		VkPipeline DepthPipeline;
+		VkBuffer VertexBuffer;
+		VkBuffer IndexBuffer;
+		u32 IndexCount;
+		u32 FirstIndex;
+		i32 VertexOffset;
+		
+		VkBuffer InstanceBuffer;
+		u32 InstanceCount;
+		u32 FirstInstance;
+		
+		VkDescriptorSet CullSet;
+		f32 BoundingRadius;
+	};
+	
+	struct VulkanDrawSortEntry {
+		
+		u64 Key;
+		u32 Index;
+	};
+	
+	// Run of sorted draws sharing pipeline and buffers, issued as one indirect draw
+	struct VulkanDrawBatch {
+		
+		VkPipeline Pipeline;
+		VkPipeline DepthPipeline;
+		VkBuffer VertexBuffer;
+		VkBuffer IndexBuffer;
+		VkBuffer InstanceBuffer;
+		u32 First;
+		u32 Count;
+	};
+	
+	// Per frame slot, Commands holds one VkDrawIndexedIndirectCommand per draw and Counts one draw count per batch
+	struct VulkanIndirectBuffer {
+		
+		VulkanBuffer Commands;
+		VulkanBuffer Counts;
+		u32 CommandCapacity;
+		u32 CountCapacity;
+		
+		// Instances that survived culling, compacted by the culling pass and read as the instance binding.
+		// The late phase writes its commands after the early ones and its instances after the early ones.
+		VulkanBuffer Instances;
+		u32 InstanceCapacity;
+		VkDescriptorSet CullSet;
+		bool CullSetDirty;
+	};
+	
+	// Push constants of one culled draw, they follow the frustum planes and the phase
+	struct VulkanCullConstants {
+		
+		u32 FirstInstance;
+		u32 InstanceCount;
+		u32 Command;
+		u32 FirstVisible;
+		f32 Radius;
+	};
+	
+	struct VulkanCullJob {
+		
+		VkDescriptorSet Source;
+		VulkanCullConstants Constants;
+	};
+	
+	static const u32 VulkanCullPhaseEarly = 0;
+	static const u32 VulkanCullPhaseLate = 1;
+	
+	// Compute passes around the render pass. The early phase draws what was visible last frame and passes
+	// the frustum and the depth pyramid of the previous frame, the pyramid is then rebuilt from that depth and
+	// the late phase draws what the early phase left out but is not occluded. Survivors and their counts go
+	// straight into the slot's indirect buffer, so the CPU never touches a single instance.
+	struct VulkanCulling {
+		
+		VkDescriptorSetLayout SourceLayout;
+		VkDescriptorSetLayout TargetLayout;
+		VkDescriptorSetLayout PyramidLayout;
+		VkDescriptorPool DescriptorPool;
+		VkPipelineLayout PipelineLayout;
+		VkPipeline Pipeline;
+		
+		VkDescriptorSetLayout BuildLayout;
+		VkPipelineLayout BuildPipelineLayout;
+		VkPipeline BuildPipeline;
+		
+		Vector4 Planes[6];
+		
+		VulkanCullJob* Jobs;
+		u32 JobCount;
+		u32 JobCapacity;
+	};
+	
+	// Draws gathered between VulkanBeginFrame and VulkanEndFrame, recorded in key order
+	struct VulkanDrawList {
+		
+		VulkanDrawCommand* Commands;
+		VulkanDrawSortEntry* Sorted;
+		VulkanDrawSortEntry* Scratch;
+		u32 Count;
+		u32 Capacity;
+		
+		VulkanDrawBatch* Batches;
+		u32 BatchCount;
+		u32 BatchCapacity;
+		
+		// Pipeline of the last shader looked up, consecutive draws usually share it
+		VulkanShader LastShader;
+		VulkanPipelineVariant* LastVariant;
+	};
+	
+	// Draws one thread submitted since the last VulkanEndFrame. Only the thread that acquired it appends,
+	// VulkanEndFrame moves the draws into the draw list. Aligned to a cache line, neighbouring buckets belong to other threads.
+	struct alignas(64) VulkanDrawBucket {
+		
+		VulkanDraw* Draws;
+		u32 Count;
+		u32 Capacity;
+	};
+	
+	struct VulkanFrame {
+		
+		bool Active;
+		u32 ImageIndex;
+		f64 InputTime;
+	};
+	
+	// Render pass recorded once and resubmitted as long as Version and the draw list are unchanged.
+	// Secondaries holds VulkanRecordMaxPhases secondary command buffers per record slice, phase after phase.
+	struct VulkanRecordedFrame {
+		
+		VkCommandBuffer CommandBuffer;
+		VkCommandBuffer* Secondaries;
+		u64 Version;
+		u64 DrawListHash;
+		u32 DrawCount;
+	};
+	
+	static const u32 VulkanMinFramesInFlight = 1;
+	static const u32 VulkanMaxFramesInFlight = 4;
+	static const u32 VulkanDefaultFramesInFlight = 2;
+	
+	static const u32 VulkanMaxRecordThreads = 64;
+	// Depth and color of the early and late draws in the main pass, depth and color of the late draws in the resume pass
+	static const u32 VulkanRecordMaxPhases = 6;
+	// Fewer batches, or draws without multiDrawIndirect, are not worth waking the job system for
+	static const u32 VulkanParallelRecordMinimum = 256;
+	
+	static const u32 VulkanMaxDrawBuckets = 64;
+	
+	// One walk over the draw batches, every slice records its part of it
+	struct VulkanRecordPhase {
+		
+		bool Late;
+		bool DepthOnly;
+	};
+	
+	struct VulkanState;
+	
+	// A slice is recorded by one job at a time, so its command pools are never used from two threads at once.
+	// One pool per frame slot, a slot's secondaries come from a pool no other slot records into.
+	struct VulkanRecordSlice {
+		
+		VkCommandPool CommandPools[VulkanMaxFramesInFlight];
+	};
+	
+	// Splits the draws of a secondary graph pass into one slice per job system thread. The thread recording the
+	// frame is worker 0 and records slices as well while it waits. Each slice records every phase for its part of
+	// the batches, the recording thread then executes the secondaries phase by phase, so draws keep their order
+	// within each phase.
+	struct VulkanRecorder {
+		
+		JobSystem Jobs;
+		VulkanRecordSlice* Slices;
+		u32 SliceCount;
+		volatile u32 Failed;
+		
+		// The pass being recorded, Secondaries points into the recorded frame after the phases recorded so far
+		VulkanGraphInheritance* Inheritance;
+		VulkanRecordPhase Phases[VulkanRecordMaxPhases];
+		u32 PhaseCount;
+		VkCommandBuffer* Secondaries;
+		u32 UnitCount;
+		
+		// Set for the frame being recorded
+		VulkanRecordedFrame* Frame;
+		u32 FramePhases;
+	};
+	
+	// Accumulated since the last VulkanResetFrameStats, times are in seconds
+	struct VulkanFrameStats {
+		
+		u64 FrameCount;
+		
+		// CPU time blocked on the fence of the frame slot about to be reused
+		f64 WaitTime;
+		
+		// GPU execution time from timestamp queries, stays 0 when the graphics queue has no timestamps
+		f64 GpuTime;
+		
+		// From VulkanDrawIndexed being called, right after input is sampled, to the GPU finishing that frame
+		f64 Latency;
+		f64 MaxLatency;
+		
+		// Frames submitted with an already recorded render pass
+		u64 RecordedFrameReuses;
+		
+		// CPU time spent recording frames again
+		f64 RecordTime;
+		
+		// From pipeline statistics queries, stays 0 when the device has none. Frames recorded in parallel are
+		// left out when secondary command buffers can't inherit the query.
+		u64 FragmentInvocations;
+	};
+	
+	// Per frame slot bookkeeping behind VulkanFrameStats
+	struct VulkanFrameTiming {
+		
+		VkQueryPool QueryPool;
+		VkQueryPool StatisticsPool;
+		bool InheritedQueries;
+		f64 TimestampPeriod;
+		u64 TimestampMask;
+		
+		// Maps GPU timestamps onto PlatformGetTime, the GPU never starts a frame before it was submitted
+		f64 ClockOffset;
+		bool ClockCalibrated;
+		
+		f64 InputTimes[VulkanMaxFramesInFlight];
+		f64 SubmitTimes[VulkanMaxFramesInFlight];
+		bool Pending[VulkanMaxFramesInFlight];
 	};
 	
 	struct VulkanState {
@@ -64,26 +568,78 @@ namespace handmade {
 		
 		VkQueue GraphicsQueue;
 		VkQueue PresentQueue;
+		VkQueue TransferQueue;
+		
+		// Held for every submit, present and wait for the device to go idle, upload contexts submit from other threads
+		PlatformMutex QueueMutex;
+		
+		VulkanAllocator Allocator;
 		
 		VulkanSwapChain SwapChain;
+		VulkanRenderGraph RenderGraph;
 		VulkanPipeline Pipeline;
+		VkPipelineCache PipelineCache;
+		bool PipelineCacheWarm;
 		
 		VkCommandPool CommandPool;
 		VkCommandBuffer* CommandBuffers;
 		u32 CommandBufferCount;
 		
+		VulkanStagingRing StagingRing;
+		VulkanUploadBatch UploadBatch;
+		
 		VkSemaphore* ImageAvailableSemaphores;
 		u32 ImageAvailableSemaphoreCount;
 		VkSemaphore* RenderFinishedSemaphores;
 		u32 RenderFinishedSemaphoreCount;
 		VkFence* InFlightFences;
 		u32 InFlightFenceCount;
+		u32 FramesInFlight;
 		u32 CurrentFrame;
+		u64 FrameNumber;
+		
+		VulkanFrameTiming FrameTiming;
+		VulkanFrameStats FrameStats;
+		
+		// One entry per frame slot and swap chain image, a slot only reuses entries its own fence has released
+		VulkanRecordedFrame* RecordedFrames;
+		u32 RecordedFrameImageCount;
+		u64 DrawVersion;
+		VulkanRecorder Recorder;
+		
+		VulkanFrame Frame;
+		VulkanDrawList DrawList;
+		VulkanIdPool BufferIds;
+		
+		// Handed out by VulkanAcquireDrawBucket, merged in index order
+		VulkanDrawBucket DrawBuckets[VulkanMaxDrawBuckets];
+		
+		// Draw parameters live in GPU memory when the device has multiDrawIndirect, otherwise draws are recorded one by one
+		VulkanIndirectBuffer* IndirectBuffers;
+		bool MultiDrawIndirect;
+		bool DrawIndirectCount;
+		PFN_vkCmdDrawIndexedIndirectCountKHR CmdDrawIndexedIndirectCount;
+		VulkanCulling Culling;
+		
+		// Every frame first lays down depth without running fragment shaders, then shades only the visible fragments
+		bool DepthPrepass;
+		
+		// VK_KHR_dynamic_rendering, passes begin rendering on their image views directly. Without it the render graph
+		// falls back to render pass and framebuffer objects.
+		bool DynamicRendering;
+		PFN_vkCmdBeginRenderingKHR CmdBeginRendering;
+		PFN_vkCmdEndRenderingKHR CmdEndRendering;
 		
 		VulkanShader Shader;
 		VulkanShader DefaultShader;
+		VulkanShader InstancedShader;
 		
-		Window* Window;
+		struct Window* Window;
+		
+		// Set while another thread than the one polling window events draws, GLFW can't be called from there.
+		// A minimized window then drops frames instead of waiting for events.
+		bool DrawsOffWindowThread;
+		bool Headless;
 	};
 	
 	struct VulkanQueueFamilyIndices {
@@ -92,6 +648,10 @@ namespace handmade {
 		u32 PresentFamily;
 		bool GraphicsComplete;
 		bool PresentComplete;
+		
+		// Falls back to the graphics family when the device has no transfer only family
+		u32 TransferFamily;
+		bool TransferDedicated;
 	};
 	
 	struct VulkanSwapChainSupportDetails {
@@ -104,10 +664,28 @@ namespace handmade {
 	};
 	
 	// State Functions
-	bool VulkanStateInit(VulkanState* state, Window* window);
+	// framesInFlight is clamped to [VulkanMinFramesInFlight, VulkanMaxFramesInFlight], more frames trade latency for throughput
+	bool VulkanStateInit(VulkanState* state, Window* window, u32 framesInFlight);
+	bool VulkanStateInitHeadless(VulkanState* state, u32 width, u32 height, u32 framesInFlight);
 	bool VulkanStateDestroy(VulkanState* state);
 	
-	// Drawing
+	void VulkanResetFrameStats(VulkanState* state);
+	
+	// Drawing, every draw submitted between VulkanBeginFrame and VulkanEndFrame ends up in one render pass.
+	// VulkanBeginFrame only fails on errors, a frame dropped for a swap chain recreation turns Submit and End into no-ops.
+	bool VulkanBeginFrame(VulkanState* state);
+	void VulkanSubmitDraw(VulkanState* state, VulkanDraw* draw);
+	bool VulkanEndFrame(VulkanState* state);
+	
+	// Lets a thread submit draws while others do the same, without any locking. The caller picks an index below VulkanMaxDrawBuckets
+	// that no other thread uses at the same time. Buckets are merged in index order, so draws with equal sort keys keep an order
+	// that doesn't depend on which thread got to run first.
+	VulkanDrawBucket* VulkanAcquireDrawBucket(VulkanState* state, u32 index);
+	// Only from the thread that acquired the bucket. Draws are merged into the frame VulkanEndFrame ends,
+	// so every submit has to be done, and synchronized with, before it is called.
+	void VulkanSubmitDrawToBucket(VulkanDrawBucket* bucket, VulkanDraw* draw);
+	
+	// A frame with a single draw
 	bool VulkanDrawIndexed(VulkanState* state, VulkanBuffer* vertexBuffer, VulkanBuffer* indexBuffer, u32 indexCount);
 	
 	bool VulkanCreateVertexBuffer(VulkanState* state, VulkanBuffer* vertexBuffer, Vertex* vertices, u32 count);
@@ -118,8 +696,52 @@ namespace handmade {
 	void VulkanDestroyIndexBuffer(VulkanState* state, VulkanBuffer* indexBuffer);
 	bool VulkanIndexBufferSetData(VulkanState* state, VulkanBuffer* indexBuffer, u32* indices, u32 count);
 	
+	bool VulkanCreateInstanceBuffer(VulkanState* state, VulkanBuffer* instanceBuffer, InstanceData* instances, u32 count);
+	void VulkanDestroyInstanceBuffer(VulkanState* state, VulkanBuffer* instanceBuffer);
+	bool VulkanInstanceBufferSetData(VulkanState* state, VulkanBuffer* instanceBuffer, InstanceData* instances, u32 count);
+	
+	// Planes as normal and distance, instances whose bounding sphere lies behind any of them are culled,
+	// defaults to the clip space volume
+	void VulkanSetCullPlanes(VulkanState* state, Vector4* planes);
+	
+	// Rebuilds every pipeline, so it is meant for settings changes rather than per frame toggling. Handles from
+	// VulkanRequestPipeline stay valid and report not ready until their pipeline is rebuilt.
+	bool VulkanSetDepthPrepass(VulkanState* state, bool enable);
+	
+	// 1, 2, 4 or 8, lowered to what the device supports for both color and depth. Rebuilds the render targets,
+	// render passes and pipelines. Occlusion culling needs the depth buffer after the render pass, so with
+	// more than one sample culled draws are only tested against the frustum. Pipeline handles stay valid like with VulkanSetDepthPrepass.
+	bool VulkanSetSampleCount(VulkanState* state, u32 samples);
+	
+	// Threads of the job system recording the draws of large frames, including the one recording the frame. 0 picks
+	// one per processor. Capped at VulkanMaxRecordThreads, not to be called between VulkanBeginFrame and VulkanEndFrame.
+	bool VulkanSetRecordThreads(VulkanState* state, u32 count);
+	
+	// Batches every upload until VulkanEndUploads into one submit, only the GPU waits for it
+	bool VulkanBeginUploads(VulkanState* state);
+	bool VulkanEndUploads(VulkanState* state);
+	
+	// Created and used on the loader thread. Buffers it creates may be handed to the drawing thread once
+	// VulkanSubmitUploadContext returned, they are destroyed there with the usual functions.
+	bool VulkanCreateUploadContext(VulkanState* state, VulkanUploadContext* context);
+	// Waits for the last submit
+	void VulkanDestroyUploadContext(VulkanUploadContext* context);
+	bool VulkanUploadContextCreateVertexBuffer(VulkanUploadContext* context, VulkanBuffer* vertexBuffer, Vertex* vertices, u32 count);
+	bool VulkanUploadContextCreateIndexBuffer(VulkanUploadContext* context, VulkanBuffer* indexBuffer, u32* indices, u32 count);
+	// Submits the uploads recorded since the last submit, the next upload waits for them to finish before reusing the staging memory
+	bool VulkanSubmitUploadContext(VulkanUploadContext* context);
+	
 	bool VulkanCreateShader(VulkanState* state, VulkanShader* shader, const char* vertexPath, const char* fragmentPath);
+	// The vertex shader takes InstanceData at locations 2 and 3, see VertexGetInstancedDescription
+	bool VulkanCreateInstancedShader(VulkanState* state, VulkanShader* shader, const char* vertexPath, const char* fragmentPath);
 	bool VulkanUseShader(VulkanState* state, VulkanShader* shader);
+	
+	// Compiles the pipeline for shader on a worker thread and returns right away, the result can be polled with VulkanIsPipelineReady.
+	// The handle is valid until shader is destroyed.
+	VulkanPipelineVariant* VulkanRequestPipeline(VulkanState* state, VulkanShader* shader);
+	bool VulkanIsPipelineReady(VulkanPipelineVariant* variant);
+	// Like VulkanUseShader without blocking, frames are drawn with the default shader until the pipeline is ready
+	bool VulkanUseShaderAsync(VulkanState* state, VulkanShader* shader);
 	void VulkanDestroyShader(VulkanState* state, VulkanShader* shader);
 	
 	VulkanShaderCode VulkanLoadShaderCode(const char* path);
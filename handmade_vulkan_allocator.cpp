@@ -0,0 +1,416 @@
+#include "handmade_vulkan_allocator.h"
+
+namespace handmade {
+	
+	static const VkDeviceSize DefaultBlockSize = 64 * 1024 * 1024;
+	
+	static VkDeviceSize VulkanAlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+		
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+	
+	static bool VulkanBlockReserveRanges(VulkanMemoryBlock* block, u32 count) {
+		
+		if (count <= block->FreeRangeCapacity) {
+			
+			return true;
+		}
+		
+		u32 capacity = block->FreeRangeCapacity ? block->FreeRangeCapacity * 2 : 16;
+		while (capacity < count) {
+			
+			capacity *= 2;
+		}
+		
+		VulkanMemoryRange* ranges = (VulkanMemoryRange*)realloc(block->FreeRanges, capacity * sizeof(VulkanMemoryRange));
+		if (ranges) {
+			
+			block->FreeRanges = ranges;
+			block->FreeRangeCapacity = capacity;
+			return true;
+		}
+		
+		return false;
+	}
+	
+	static void VulkanBlockInsertRange(VulkanMemoryBlock* block, u32 index, VkDeviceSize offset, VkDeviceSize size) {
+		
+		memmove(block->FreeRanges + index + 1, block->FreeRanges + index, (block->FreeRangeCount - index) * sizeof(VulkanMemoryRange));
+		block->FreeRanges[index].Offset = offset;
+		block->FreeRanges[index].Size = size;
+		block->FreeRangeCount++;
+	}
+	
+	static void VulkanBlockRemoveRange(VulkanMemoryBlock* block, u32 index) {
+		
+		memmove(block->FreeRanges + index, block->FreeRanges + index + 1, (block->FreeRangeCount - index - 1) * sizeof(VulkanMemoryRange));
+		block->FreeRangeCount--;
+	}
+	
+	static bool VulkanBlockAllocate(VulkanMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset) {
+		
+		// Free ranges are always separated by allocations, so there are at most AllocationCount + 1 of them. Reserving
+		// for that after this allocation covers the range its split may add and every later free, which can't fail then.
+		if (!VulkanBlockReserveRanges(block, block->AllocationCount + 2)) {
+			
+			return false;
+		}
+		
+		// First fit, the ranges are sorted by offset so this also packs allocations towards the start of the block
+		for (u32 i = 0; i < block->FreeRangeCount; i++) {
+			
+			VulkanMemoryRange* range = (block->FreeRanges + i);
+			VkDeviceSize alignedOffset = VulkanAlignUp(range->Offset, alignment);
+			VkDeviceSize padding = alignedOffset - range->Offset;
+			
+			if (padding + size > range->Size) {
+				
+				continue;
+			}
+			
+			VkDeviceSize rangeEnd = range->Offset + range->Size;
+			VkDeviceSize allocationEnd = alignedOffset + size;
+			
+			if (padding > 0) {
+				
+				// Keep the alignment padding as a (small) free range in front of the allocation
+				range->Size = padding;
+				
+				if (allocationEnd < rangeEnd) {
+					
+					VulkanBlockInsertRange(block, i + 1, allocationEnd, rangeEnd - allocationEnd);
+				}
+			}
+			else if (allocationEnd < rangeEnd) {
+				
+				range->Offset = allocationEnd;
+				range->Size = rangeEnd - allocationEnd;
+			}
+			else {
+				
+				VulkanBlockRemoveRange(block, i);
+			}
+			
+			*offset = alignedOffset;
+			block->AllocationCount++;
+			return true;
+		}
+		
+		return false;
+	}
+	
+	static void VulkanBlockFree(VulkanMemoryBlock* block, VkDeviceSize offset, VkDeviceSize size) {
+		
+		// Binary search for the first free range behind the allocation
+		u32 low = 0;
+		u32 high = block->FreeRangeCount;
+		while (low < high) {
+			
+			u32 middle = (low + high) / 2;
+			if (block->FreeRanges[middle].Offset < offset) {
+				
+				low = middle + 1;
+			}
+			else {
+				
+				high = middle;
+			}
+		}
+		
+		u32 index = low;
+		bool mergePrevious = index > 0 && block->FreeRanges[index - 1].Offset + block->FreeRanges[index - 1].Size == offset;
+		bool mergeNext = index < block->FreeRangeCount && offset + size == block->FreeRanges[index].Offset;
+		
+		if (mergePrevious && mergeNext) {
+			
+			block->FreeRanges[index - 1].Size += size + block->FreeRanges[index].Size;
+			VulkanBlockRemoveRange(block, index);
+		}
+		else if (mergePrevious) {
+			
+			block->FreeRanges[index - 1].Size += size;
+		}
+		else if (mergeNext) {
+			
+			block->FreeRanges[index].Offset = offset;
+			block->FreeRanges[index].Size += size;
+		}
+		else {
+			
+			VulkanBlockInsertRange(block, index, offset, size);
+		}
+		
+		block->AllocationCount--;
+	}
+	
+	static bool VulkanCreateMemoryBlock(VulkanAllocator* allocator, u32 memoryTypeIndex, VkDeviceSize size, VulkanMemoryBlock* block) {
+		
+		if (allocator->DeviceMemoryCount >= allocator->MaxDeviceMemoryCount) {
+			
+			fprintf(stderr, "[Vulkan] - Reached maxMemoryAllocationCount (%u)\n", allocator->MaxDeviceMemoryCount);
+			return false;
+		}
+		
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+		
+		VkDeviceMemory memory{};
+		if (vkAllocateMemory(allocator->Device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+			
+			return false;
+		}
+		
+		// Host visible blocks stay mapped for their whole lifetime, sub-allocations just offset into the mapping
+		void* mapped = nullptr;
+		VkMemoryPropertyFlags flags = allocator->MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+		if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			
+			if (vkMapMemory(allocator->Device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+				
+				vkFreeMemory(allocator->Device, memory, nullptr);
+				return false;
+			}
+		}
+		
+		if (!VulkanBlockReserveRanges(block, 1)) {
+			
+			vkFreeMemory(allocator->Device, memory, nullptr);
+			return false;
+		}
+		
+		block->Memory = memory;
+		block->Size = size;
+		block->Mapped = (u8*)mapped;
+		block->FreeRanges[0].Offset = 0;
+		block->FreeRanges[0].Size = size;
+		block->FreeRangeCount = 1;
+		block->AllocationCount = 0;
+		block->Dedicated = false;
+		
+		allocator->DeviceMemoryCount++;
+		
+		return true;
+	}
+	
+	static void VulkanDestroyMemoryBlock(VulkanAllocator* allocator, VulkanMemoryBlock* block) {
+		
+		if (block->Memory != VK_NULL_HANDLE) {
+			
+			// Freeing mapped memory implicitly unmaps it
+			vkFreeMemory(allocator->Device, block->Memory, nullptr);
+			allocator->DeviceMemoryCount--;
+		}
+		
+		block->Memory = VK_NULL_HANDLE;
+		block->Mapped = nullptr;
+		block->FreeRangeCount = 0;
+		block->AllocationCount = 0;
+	}
+	
+	static u32 VulkanPoolAcquireBlockSlot(VulkanMemoryPool* pool) {
+		
+		// Reuse the slot of a released block first, so block indices stay small and stable
+		for (u32 i = 0; i < pool->BlockCount; i++) {
+			
+			if (pool->Blocks[i].Memory == VK_NULL_HANDLE) {
+				
+				return i;
+			}
+		}
+		
+		if (pool->BlockCount == pool->BlockCapacity) {
+			
+			u32 capacity = pool->BlockCapacity ? pool->BlockCapacity * 2 : 8;
+			VulkanMemoryBlock* blocks = (VulkanMemoryBlock*)realloc(pool->Blocks, capacity * sizeof(VulkanMemoryBlock));
+			
+			if (!blocks) {
+				
+				return UINT32_MAX;
+			}
+			
+			memset(blocks + pool->BlockCapacity, 0, (capacity - pool->BlockCapacity) * sizeof(VulkanMemoryBlock));
+			pool->Blocks = blocks;
+			pool->BlockCapacity = capacity;
+		}
+		
+		return pool->BlockCount++;
+	}
+	
+	static bool VulkanPoolAllocate(VulkanAllocator* allocator, u32 memoryTypeIndex, u32 poolKind, VkMemoryRequirements* requirements, VulkanAllocation* allocation) {
+		
+		VulkanMemoryPool* pool = &allocator->Pools[memoryTypeIndex][poolKind];
+		VkDeviceSize alignment = requirements->alignment ? requirements->alignment : 1;
+		VkDeviceSize offset{};
+		
+		// Large resources get their own VkDeviceMemory instead of fragmenting the shared blocks
+		bool dedicated = requirements->size > allocator->BlockSize / 2;
+		
+		u32 blockIndex = UINT32_MAX;
+		if (!dedicated) {
+			
+			for (u32 i = 0; i < pool->BlockCount; i++) {
+				
+				VulkanMemoryBlock* block = (pool->Blocks + i);
+				if (block->Memory != VK_NULL_HANDLE && !block->Dedicated && VulkanBlockAllocate(block, requirements->size, alignment, &offset)) {
+					
+					blockIndex = i;
+					break;
+				}
+			}
+		}
+		
+		if (blockIndex == UINT32_MAX) {
+			
+			blockIndex = VulkanPoolAcquireBlockSlot(pool);
+			if (blockIndex == UINT32_MAX) {
+				
+				return false;
+			}
+			
+			VulkanMemoryBlock* block = (pool->Blocks + blockIndex);
+			VkDeviceSize blockSize = dedicated ? requirements->size : allocator->BlockSize;
+			
+			if (!VulkanCreateMemoryBlock(allocator, memoryTypeIndex, blockSize, block)) {
+				
+				return false;
+			}
+			
+			block->Dedicated = dedicated;
+			VulkanBlockAllocate(block, requirements->size, alignment, &offset);
+		}
+		
+		VulkanMemoryBlock* block = (pool->Blocks + blockIndex);
+		allocation->Memory = block->Memory;
+		allocation->Offset = offset;
+		allocation->Size = requirements->size;
+		allocation->Mapped = block->Mapped ? block->Mapped + offset : nullptr;
+		allocation->MemoryTypeIndex = memoryTypeIndex;
+		allocation->PoolKind = poolKind;
+		allocation->BlockIndex = blockIndex;
+		
+		return true;
+	}
+	
+	bool VulkanAllocatorInit(VulkanAllocator* allocator, VkPhysicalDevice physicalDevice, VkDevice device) {
+		
+		allocator->Device = device;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &allocator->MemoryProperties);
+		
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		allocator->MaxDeviceMemoryCount = properties.limits.maxMemoryAllocationCount;
+		allocator->DeviceMemoryCount = 0;
+		
+		// Small heaps (e.g. the 256MB host visible device local heap) shouldn't be claimed by a single block
+		VkDeviceSize smallestHeap = UINT64_MAX;
+		for (u32 i = 0; i < allocator->MemoryProperties.memoryHeapCount; i++) {
+			
+			VkDeviceSize heapSize = allocator->MemoryProperties.memoryHeaps[i].size;
+			smallestHeap = heapSize < smallestHeap ? heapSize : smallestHeap;
+		}
+		
+		allocator->BlockSize = DefaultBlockSize;
+		while (allocator->BlockSize > smallestHeap / 8 && allocator->BlockSize > 1024 * 1024) {
+			
+			allocator->BlockSize /= 2;
+		}
+		
+		memset(allocator->Pools, 0, sizeof(allocator->Pools));
+		
+		return PlatformMutexInit(&allocator->Mutex);
+	}
+	
+	void VulkanAllocatorDestroy(VulkanAllocator* allocator) {
+		
+		for (u32 type = 0; type < VK_MAX_MEMORY_TYPES; type++) {
+			
+			for (u32 kind = 0; kind < VulkanMemoryPoolKindCount; kind++) {
+				
+				VulkanMemoryPool* pool = &allocator->Pools[type][kind];
+				for (u32 i = 0; i < pool->BlockCount; i++) {
+					
+					VulkanMemoryBlock* block = (pool->Blocks + i);
+					VulkanDestroyMemoryBlock(allocator, block);
+					free(block->FreeRanges);
+				}
+				
+				free(pool->Blocks);
+				pool->Blocks = nullptr;
+				pool->BlockCount = 0;
+				pool->BlockCapacity = 0;
+			}
+		}
+		
+		PlatformMutexDestroy(&allocator->Mutex);
+	}
+	
+	u32 VulkanAllocatorFindMemoryType(VulkanAllocator* allocator, u32 typeFilter, VkMemoryPropertyFlags properties, u32 startIndex) {
+		
+		for (u32 i = startIndex; i < allocator->MemoryProperties.memoryTypeCount; i++) {
+			
+			if ((typeFilter & (1 << i)) && (allocator->MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				
+				return i + 1;
+			}
+		}
+		
+		return 0;
+	}
+	
+	bool VulkanAllocate(VulkanAllocator* allocator, VkMemoryRequirements* requirements, VkMemoryPropertyFlags properties, u32 poolKind, VulkanAllocation* allocation) {
+		
+		PlatformMutexLock(&allocator->Mutex);
+		
+		// Walk every matching memory type, a later one might still have room when the preferred heap is full
+		bool allocated = false;
+		u32 memoryTypeIndex = VulkanAllocatorFindMemoryType(allocator, requirements->memoryTypeBits, properties, 0);
+		while (memoryTypeIndex != 0 && !allocated) {
+			
+			allocated = VulkanPoolAllocate(allocator, memoryTypeIndex - 1, poolKind, requirements, allocation);
+			memoryTypeIndex = VulkanAllocatorFindMemoryType(allocator, requirements->memoryTypeBits, properties, memoryTypeIndex);
+		}
+		
+		PlatformMutexUnlock(&allocator->Mutex);
+		
+		return allocated;
+	}
+	
+	void VulkanFree(VulkanAllocator* allocator, VulkanAllocation* allocation) {
+		
+		if (allocation->Memory == VK_NULL_HANDLE) {
+			
+			return;
+		}
+		
+		PlatformMutexLock(&allocator->Mutex);
+		
+		VulkanMemoryPool* pool = &allocator->Pools[allocation->MemoryTypeIndex][allocation->PoolKind];
+		VulkanMemoryBlock* block = (pool->Blocks + allocation->BlockIndex);
+		
+		VulkanBlockFree(block, allocation->Offset, allocation->Size);
+		
+		if (block->AllocationCount == 0) {
+			
+			// Keep one empty shared block around per pool, so alternating create/destroy doesn't hit vkAllocateMemory
+			bool keep = !block->Dedicated;
+			for (u32 i = 0; i < pool->BlockCount && keep; i++) {
+				
+				VulkanMemoryBlock* other = (pool->Blocks + i);
+				if (i != allocation->BlockIndex && other->Memory != VK_NULL_HANDLE && !other->Dedicated && other->AllocationCount == 0) {
+					
+					keep = false;
+				}
+			}
+			
+			if (!keep) {
+				
+				VulkanDestroyMemoryBlock(allocator, block);
+			}
+		}
+		
+		PlatformMutexUnlock(&allocator->Mutex);
+		memset(allocation, 0, sizeof(VulkanAllocation));
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef HANDMADE_VULKAN_ALLOCATOR_H
+#define HANDMADE_VULKAN_ALLOCATOR_H
+
+#include "handmade_types.h"
+#include "handmade_platform.h"
+
+#pragma warning(disable : 26812)
+#include <vulkan/vulkan.h>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+namespace handmade {
+	
+	// Linear resources (buffers) and optimal images never share a block, so bufferImageGranularity never applies
+	static const u32 VulkanMemoryPoolLinear = 0;
+	static const u32 VulkanMemoryPoolOptimal = 1;
+	static const u32 VulkanMemoryPoolKindCount = 2;
+	
+	struct VulkanMemoryRange {
+		
+		VkDeviceSize Offset;
+		VkDeviceSize Size;
+	};
+	
+	struct VulkanMemoryBlock {
+		
+		VkDeviceMemory Memory;
+		VkDeviceSize Size;
+		u8* Mapped;
+		
+		// Sorted by offset, neighbouring ranges are merged when an allocation is freed
+		VulkanMemoryRange* FreeRanges;
+		u32 FreeRangeCount;
+		u32 FreeRangeCapacity;
+		
+		u32 AllocationCount;
+		bool Dedicated;
+	};
+	
+	struct VulkanMemoryPool {
+		
+		VulkanMemoryBlock* Blocks;
+		u32 BlockCount;
+		u32 BlockCapacity;
+	};
+	
+	struct VulkanAllocation {
+		
+		VkDeviceMemory Memory;
+		VkDeviceSize Offset;
+		VkDeviceSize Size;
+		
+		// Persistently mapped pointer to Offset, only set for host visible memory
+		u8* Mapped;
+		
+		u32 MemoryTypeIndex;
+		u32 PoolKind;
+		u32 BlockIndex;
+	};
+	
+	struct VulkanAllocator {
+		
+		VkDevice Device;
+		VkPhysicalDeviceMemoryProperties MemoryProperties;
+		VkDeviceSize BlockSize;
+		
+		u32 DeviceMemoryCount;
+		u32 MaxDeviceMemoryCount;
+		
+		VulkanMemoryPool Pools[VK_MAX_MEMORY_TYPES][VulkanMemoryPoolKindCount];
+		
+		// Loader threads allocate alongside the drawing thread, the pools are only touched with it held
+		PlatformMutex Mutex;
+	};
+	
+	bool VulkanAllocatorInit(VulkanAllocator* allocator, VkPhysicalDevice physicalDevice, VkDevice device);
+	void VulkanAllocatorDestroy(VulkanAllocator* allocator);
+	
+	bool VulkanAllocate(VulkanAllocator* allocator, VkMemoryRequirements* requirements, VkMemoryPropertyFlags properties, u32 poolKind, VulkanAllocation* allocation);
+	void VulkanFree(VulkanAllocator* allocator, VulkanAllocation* allocation);
+	
+	// Returns the memory type index + 1, or 0 if no type matches
+	u32 VulkanAllocatorFindMemoryType(VulkanAllocator* allocator, u32 typeFilter, VkMemoryPropertyFlags properties, u32 startIndex);
+}
+
+#endif // HANDMADE_VULKAN_ALLOCATOR_H
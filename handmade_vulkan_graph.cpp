@@ -0,0 +1,1093 @@
+#include "handmade_vulkan_graph.h"
+
+namespace handmade {
+	
+	struct VulkanGraphUsageInfo {
+		
+		// Zero for shader usages, their stages depend on the kind of pass
+		VkPipelineStageFlags Stages;
+		VkAccessFlags ReadAccess;
+		VkAccessFlags WriteAccess;
+		VkImageLayout Layout;
+		VkImageUsageFlags ImageUsage;
+	};
+	
+	// Indexed by VulkanGraphUsage*
+	static const VulkanGraphUsageInfo VulkanGraphUsages[] = {
+		
+		{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT },
+		{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT },
+		{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT },
+		{ 0, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT },
+		{ 0, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT },
+		{ 0, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT },
+		{ 0, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT },
+		{ VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT },
+		{ VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0 },
+		{ VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0 },
+	};
+	
+	static bool VulkanGraphIsAttachment(u32 usage) {
+		
+		return usage == VulkanGraphUsageColorAttachment || usage == VulkanGraphUsageDepthAttachment || usage == VulkanGraphUsageResolveAttachment;
+	}
+	
+	static VkPipelineStageFlags VulkanGraphGetStages(VulkanGraphPass* pass, u32 usage) {
+		
+		VkPipelineStageFlags stages = VulkanGraphUsages[usage].Stages;
+		if (stages) {
+			
+			return stages;
+		}
+		
+		return pass->Graphics ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	}
+	
+	// Attachments that are loaded read what is already there, resolves and clears don't
+	static bool VulkanGraphReads(VulkanGraphAccess* access) {
+		
+		if (VulkanGraphIsAttachment(access->Usage)) {
+			
+			return access->Usage != VulkanGraphUsageResolveAttachment && !access->Clear;
+		}
+		
+		return VulkanGraphUsages[access->Usage].ReadAccess != 0;
+	}
+	
+	static bool VulkanGraphWrites(VulkanGraphAccess* access) {
+		
+		return VulkanGraphUsages[access->Usage].WriteAccess != 0;
+	}
+	
+	// Contents that are still wanted once the graph is done
+	static bool VulkanGraphIsKept(VulkanGraphResource* resource) {
+		
+		return resource->Imported && (!resource->IsImage || resource->FinalLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+	}
+	
+	static bool VulkanGraphReserve(void** items, u32* capacity, u32 count, u64 itemSize) {
+		
+		if (count <= *capacity) {
+			
+			return true;
+		}
+		
+		u32 newCapacity = *capacity ? *capacity * 2 : 16;
+		while (newCapacity < count) {
+			
+			newCapacity *= 2;
+		}
+		
+		void* newItems = realloc(*items, newCapacity * itemSize);
+		if (!newItems) {
+			
+			return false;
+		}
+		
+		*items = newItems;
+		*capacity = newCapacity;
+		return true;
+	}
+	
+	static void VulkanGraphRetire(VulkanRenderGraph* graph, VulkanGraphGarbage* garbage) {
+		
+		if (!VulkanGraphReserve((void**)&graph->Garbage, &graph->GarbageCapacity, graph->GarbageCount + 1, sizeof(VulkanGraphGarbage))) {
+			
+			// Better to wait once than to leak. The wait counts as using every queue, so it may not overlap a submit.
+			if (graph->QueueMutex) {
+				
+				PlatformMutexLock(graph->QueueMutex);
+			}
+			vkDeviceWaitIdle(graph->Device);
+			if (graph->QueueMutex) {
+				
+				PlatformMutexUnlock(graph->QueueMutex);
+			}
+			vkDestroyFramebuffer(graph->Device, garbage->Framebuffer, nullptr);
+			vkDestroyImageView(graph->Device, garbage->View, nullptr);
+			vkDestroyImage(graph->Device, garbage->Image, nullptr);
+			VulkanFree(graph->Allocator, &garbage->Allocation);
+			return;
+		}
+		
+		garbage->RetiredFrame = graph->FrameNumber;
+		graph->Garbage[graph->GarbageCount++] = *garbage;
+	}
+	
+	static u32 VulkanGraphAddResource(VulkanRenderGraph* graph) {
+		
+		if (!VulkanGraphReserve((void**)&graph->Resources, &graph->ResourceCapacity, graph->ResourceCount + 1, sizeof(VulkanGraphResource))) {
+			
+			graph->Failed = true;
+			return VulkanGraphInvalid;
+		}
+		
+		VulkanGraphResource* resource = (graph->Resources + graph->ResourceCount);
+		memset(resource, 0, sizeof(VulkanGraphResource));
+		resource->FirstPass = VulkanGraphInvalid;
+		
+		return graph->ResourceCount++;
+	}
+	
+	bool VulkanGraphInit(VulkanRenderGraph* graph, VkDevice device, VulkanAllocator* allocator, PlatformMutex* queueMutex, PFN_vkCmdBeginRenderingKHR beginRendering, PFN_vkCmdEndRenderingKHR endRendering) {
+		
+		memset(graph, 0, sizeof(VulkanRenderGraph));
+		graph->Device = device;
+		graph->Allocator = allocator;
+		graph->QueueMutex = queueMutex;
+		graph->CmdBeginRendering = endRendering ? beginRendering : nullptr;
+		graph->CmdEndRendering = beginRendering ? endRendering : nullptr;
+		
+		return true;
+	}
+	
+	// Framebuffers go with the images, a new view may get the handle of an old one
+	static void VulkanGraphDestroyImages(VulkanRenderGraph* graph) {
+		
+		VulkanGraphRetireFramebuffers(graph, graph->FrameNumber);
+		for (u32 i = 0; i < graph->ImageCount; i++) {
+			
+			VulkanGraphImage* image = (graph->Images + i);
+			VulkanGraphGarbage garbage{};
+			garbage.Image = image->Image;
+			garbage.View = image->View;
+			VulkanGraphRetire(graph, &garbage);
+		}
+		
+		for (u32 i = 0; i < graph->SlotCount; i++) {
+			
+			VulkanGraphGarbage garbage{};
+			garbage.Allocation = graph->Slots[i];
+			VulkanGraphRetire(graph, &garbage);
+		}
+		
+		free(graph->Slots);
+		graph->Slots = nullptr;
+		graph->SlotCount = 0;
+		graph->ImageCount = 0;
+	}
+	
+	void VulkanGraphDestroy(VulkanRenderGraph* graph) {
+		
+		VulkanGraphDestroyImages(graph);
+		VulkanGraphCollectGarbage(graph, graph->FrameNumber, 0, true);
+		
+		for (u32 i = 0; i < graph->RenderPassCount; i++) {
+			
+			vkDestroyRenderPass(graph->Device, graph->RenderPasses[i].RenderPass, nullptr);
+		}
+		
+		free(graph->Resources);
+		free(graph->Passes);
+		free(graph->ImageBarriers);
+		free(graph->RenderPasses);
+		free(graph->Framebuffers);
+		free(graph->Images);
+		free(graph->Garbage);
+		memset(graph, 0, sizeof(VulkanRenderGraph));
+	}
+	
+	void VulkanGraphBegin(VulkanRenderGraph* graph, u64 frameNumber) {
+		
+		graph->FrameNumber = frameNumber;
+		graph->Failed = false;
+		graph->ResourceCount = 0;
+		graph->PassCount = 0;
+		graph->ImageBarrierCount = 0;
+		memset(&graph->FinalBarrier, 0, sizeof(VulkanGraphBarrier));
+	}
+	
+	u32 VulkanGraphImportImage(VulkanRenderGraph* graph, VulkanGraphImageDescription* description, VkImage image, VkImageView view, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout finalLayout) {
+		
+		u32 handle = VulkanGraphAddResource(graph);
+		if (handle != VulkanGraphInvalid) {
+			
+			VulkanGraphResource* resource = (graph->Resources + handle);
+			resource->Description = *description;
+			resource->Image = image;
+			resource->View = view;
+			resource->IsImage = true;
+			resource->Imported = true;
+			resource->FinalLayout = finalLayout;
+			resource->Layout = layout;
+			resource->WriteStages = stages;
+			resource->WriteAccess = access;
+		}
+		
+		return handle;
+	}
+	
+	u32 VulkanGraphImportBuffer(VulkanRenderGraph* graph, VkPipelineStageFlags stages, VkAccessFlags access) {
+		
+		u32 handle = VulkanGraphAddResource(graph);
+		if (handle != VulkanGraphInvalid) {
+			
+			VulkanGraphResource* resource = (graph->Resources + handle);
+			resource->Imported = true;
+			resource->WriteStages = stages;
+			resource->WriteAccess = access;
+		}
+		
+		return handle;
+	}
+	
+	u32 VulkanGraphCreateImage(VulkanRenderGraph* graph, VulkanGraphImageDescription* description) {
+		
+		u32 handle = VulkanGraphAddResource(graph);
+		if (handle != VulkanGraphInvalid) {
+			
+			VulkanGraphResource* resource = (graph->Resources + handle);
+			resource->Description = *description;
+			resource->IsImage = true;
+		}
+		
+		return handle;
+	}
+	
+	u32 VulkanGraphAddPass(VulkanRenderGraph* graph, bool graphics, VulkanGraphRecordProc record, void* data) {
+		
+		if (!VulkanGraphReserve((void**)&graph->Passes, &graph->PassCapacity, graph->PassCount + 1, sizeof(VulkanGraphPass))) {
+			
+			graph->Failed = true;
+			return VulkanGraphInvalid;
+		}
+		
+		VulkanGraphPass* pass = (graph->Passes + graph->PassCount);
+		memset(pass, 0, sizeof(VulkanGraphPass));
+		pass->Record = record;
+		pass->Data = data;
+		pass->Graphics = graphics;
+		
+		return graph->PassCount++;
+	}
+	
+	void VulkanGraphSetSecondary(VulkanRenderGraph* graph, u32 pass) {
+		
+		if (pass != VulkanGraphInvalid) {
+			
+			(graph->Passes + pass)->Secondary = (graph->Passes + pass)->Graphics;
+		}
+	}
+	
+	void VulkanGraphUse(VulkanRenderGraph* graph, u32 pass, u32 resource, u32 usage, VkClearValue* clear) {
+		
+		if (pass == VulkanGraphInvalid || resource == VulkanGraphInvalid) {
+			
+			return;
+		}
+		
+		VulkanGraphPass* graphPass = (graph->Passes + pass);
+		if (graphPass->AccessCount == VulkanGraphMaxAccesses) {
+			
+			graph->Failed = true;
+			return;
+		}
+		
+		VulkanGraphAccess* access = (graphPass->Accesses + graphPass->AccessCount++);
+		access->Resource = resource;
+		access->Usage = usage;
+		access->Clear = clear != nullptr;
+		access->ClearValue = clear ? *clear : VkClearValue{};
+	}
+	
+	// Walks the passes backwards, a pass is live when it writes something kept after the graph or read by a later live pass
+	static void VulkanGraphCull(VulkanRenderGraph* graph) {
+		
+		for (u32 i = graph->PassCount; i > 0; i--) {
+			
+			VulkanGraphPass* pass = (graph->Passes + i - 1);
+			pass->Live = false;
+			
+			for (u32 j = 0; j < pass->AccessCount; j++) {
+				
+				VulkanGraphAccess* access = (pass->Accesses + j);
+				VulkanGraphResource* resource = (graph->Resources + access->Resource);
+				
+				if (VulkanGraphWrites(access) && (VulkanGraphIsKept(resource) || resource->Needed)) {
+					
+					pass->Live = true;
+				}
+			}
+			
+			for (u32 j = 0; pass->Live && j < pass->AccessCount; j++) {
+				
+				VulkanGraphAccess* access = (pass->Accesses + j);
+				if (VulkanGraphReads(access)) {
+					
+					(graph->Resources + access->Resource)->Needed = true;
+				}
+			}
+		}
+		
+		for (u32 i = 0; i < graph->PassCount; i++) {
+			
+			VulkanGraphPass* pass = (graph->Passes + i);
+			for (u32 j = 0; pass->Live && j < pass->AccessCount; j++) {
+				
+				VulkanGraphAccess* access = (pass->Accesses + j);
+				VulkanGraphResource* resource = (graph->Resources + access->Resource);
+				VkPipelineStageFlags stages = VulkanGraphGetStages(pass, access->Usage);
+				
+				resource->Usage |= VulkanGraphUsages[access->Usage].ImageUsage;
+				resource->UsedStages |= stages;
+				resource->UsedWriteAccess |= VulkanGraphUsages[access->Usage].WriteAccess;
+				resource->FirstPass = resource->FirstPass == VulkanGraphInvalid ? i : resource->FirstPass;
+				resource->LastPass = i;
+			}
+		}
+	}
+	
+	static bool VulkanGraphSameImage(VulkanGraphImage* image, VulkanGraphResource* resource) {
+		
+		VulkanGraphImageDescription* a = &image->Description;
+		VulkanGraphImageDescription* b = &resource->Description;
+		
+		return a->Format == b->Format && a->Extent.width == b->Extent.width && a->Extent.height == b->Extent.height &&
+			a->Samples == b->Samples && a->Aspect == b->Aspect && image->Usage == resource->Usage &&
+			image->FirstPass == resource->FirstPass && image->LastPass == resource->LastPass;
+	}
+	
+	// Images only used as attachments never leave the tile on tiled GPUs and can live in lazily allocated memory
+	static bool VulkanGraphIsTransientAttachment(VkImageUsageFlags usage) {
+		
+		return (usage & ~(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) == 0;
+	}
+	
+	// Largest images first, each one goes into the first slot it fits without overlapping the lifetime of an image already there
+	static bool VulkanGraphAssignSlots(VulkanRenderGraph* graph, VkMemoryRequirements* requirements) {
+		
+		u32 count = graph->ImageCount;
+		if (count == 0) {
+			
+			return true;
+		}
+		
+		u32* order = (u32*)malloc(count * sizeof(u32));
+		graph->Slots = (VulkanAllocation*)calloc(count, sizeof(VulkanAllocation));
+		VkMemoryRequirements* slotRequirements = (VkMemoryRequirements*)calloc(count, sizeof(VkMemoryRequirements));
+		bool* slotLazy = (bool*)calloc(count, sizeof(bool));
+		
+		bool complete = order && graph->Slots && slotRequirements && slotLazy;
+		for (u32 i = 0; complete && i < count; i++) {
+			
+			u32 j = i;
+			while (j > 0 && requirements[order[j - 1]].size < requirements[i].size) {
+				
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = i;
+		}
+		
+		for (u32 i = 0; complete && i < count; i++) {
+			
+			VulkanGraphImage* image = (graph->Images + order[i]);
+			VkMemoryRequirements* imageRequirements = (requirements + order[i]);
+			bool imageLazy = VulkanGraphIsTransientAttachment(image->Usage);
+			
+			u32 slot = 0;
+			for (; slot < graph->SlotCount; slot++) {
+				
+				bool fits = (slotRequirements[slot].memoryTypeBits & imageRequirements->memoryTypeBits) != 0 && slotLazy[slot] == imageLazy;
+				for (u32 j = 0; fits && j < i; j++) {
+					
+					VulkanGraphImage* other = (graph->Images + order[j]);
+					fits = other->Slot != slot || other->LastPass < image->FirstPass || image->LastPass < other->FirstPass;
+				}
+				
+				if (fits) {
+					
+					break;
+				}
+			}
+			
+			if (slot == graph->SlotCount) {
+				
+				slotRequirements[slot] = *imageRequirements;
+				slotLazy[slot] = imageLazy;
+				graph->SlotCount++;
+			}
+			else {
+				
+				VkMemoryRequirements* slotRequirement = (slotRequirements + slot);
+				slotRequirement->size = slotRequirement->size > imageRequirements->size ? slotRequirement->size : imageRequirements->size;
+				slotRequirement->alignment = slotRequirement->alignment > imageRequirements->alignment ? slotRequirement->alignment : imageRequirements->alignment;
+				slotRequirement->memoryTypeBits &= imageRequirements->memoryTypeBits;
+			}
+			
+			image->Slot = slot;
+		}
+		
+		for (u32 i = 0; complete && i < graph->SlotCount; i++) {
+			
+			VkMemoryRequirements* slotRequirement = (slotRequirements + i);
+			if (!(slotLazy[i] && VulkanAllocate(graph->Allocator, slotRequirement, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, VulkanMemoryPoolOptimal, graph->Slots + i)) &&
+				!VulkanAllocate(graph->Allocator, slotRequirement, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanMemoryPoolOptimal, graph->Slots + i)) {
+				
+				complete = false;
+			}
+		}
+		
+		free(order);
+		free(slotRequirements);
+		free(slotLazy);
+		
+		return complete;
+	}
+	
+	static bool VulkanGraphAllocateImages(VulkanRenderGraph* graph) {
+		
+		// Reused when every transient image matches, which is the case for all but the first compile of a graph
+		u32 count = 0;
+		bool same = true;
+		for (u32 i = 0; i < graph->ResourceCount; i++) {
+			
+			VulkanGraphResource* resource = (graph->Resources + i);
+			if (resource->Imported || resource->FirstPass == VulkanGraphInvalid) {
+				
+				continue;
+			}
+			
+			same &= count < graph->ImageCount && VulkanGraphSameImage(graph->Images + count, resource);
+			count++;
+		}
+		
+		if (!same || count != graph->ImageCount) {
+			
+			VulkanGraphDestroyImages(graph);
+			graph->Version++;
+			
+			if (!VulkanGraphReserve((void**)&graph->Images, &graph->ImageCapacity, count, sizeof(VulkanGraphImage))) {
+				
+				return false;
+			}
+			
+			VkMemoryRequirements* requirements = (VkMemoryRequirements*)calloc(count ? count : 1, sizeof(VkMemoryRequirements));
+			if (!requirements) {
+				
+				return false;
+			}
+			
+			bool complete = true;
+			for (u32 i = 0; i < graph->ResourceCount; i++) {
+				
+				VulkanGraphResource* resource = (graph->Resources + i);
+				if (resource->Imported || resource->FirstPass == VulkanGraphInvalid) {
+					
+					continue;
+				}
+				
+				VulkanGraphImage* image = (graph->Images + graph->ImageCount++);
+				memset(image, 0, sizeof(VulkanGraphImage));
+				image->Description = resource->Description;
+				image->Usage = resource->Usage;
+				image->FirstPass = resource->FirstPass;
+				image->LastPass = resource->LastPass;
+				
+				VkImageCreateInfo imageInfo{};
+				imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+				imageInfo.imageType = VK_IMAGE_TYPE_2D;
+				imageInfo.format = resource->Description.Format;
+				imageInfo.extent.width = resource->Description.Extent.width;
+				imageInfo.extent.height = resource->Description.Extent.height;
+				imageInfo.extent.depth = 1;
+				imageInfo.mipLevels = 1;
+				imageInfo.arrayLayers = 1;
+				imageInfo.samples = resource->Description.Samples;
+				imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+				imageInfo.usage = resource->Usage | (VulkanGraphIsTransientAttachment(resource->Usage) ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+				imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				
+				if (vkCreateImage(graph->Device, &imageInfo, nullptr, &image->Image) != VK_SUCCESS) {
+					
+					image->Image = VK_NULL_HANDLE;
+					complete = false;
+					break;
+				}
+				
+				vkGetImageMemoryRequirements(graph->Device, image->Image, requirements + graph->ImageCount - 1);
+			}
+			
+			complete = complete && VulkanGraphAssignSlots(graph, requirements);
+			free(requirements);
+			
+			for (u32 i = 0; complete && i < graph->ImageCount; i++) {
+				
+				VulkanGraphImage* image = (graph->Images + i);
+				VulkanAllocation* slot = (graph->Slots + image->Slot);
+				vkBindImageMemory(graph->Device, image->Image, slot->Memory, slot->Offset);
+				
+				VkImageViewCreateInfo viewInfo{};
+				viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+				viewInfo.image = image->Image;
+				viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				viewInfo.format = image->Description.Format;
+				viewInfo.subresourceRange.aspectMask = image->Description.Aspect;
+				viewInfo.subresourceRange.levelCount = 1;
+				viewInfo.subresourceRange.layerCount = 1;
+				
+				if (vkCreateImageView(graph->Device, &viewInfo, nullptr, &image->View) != VK_SUCCESS) {
+					
+					image->View = VK_NULL_HANDLE;
+					complete = false;
+				}
+			}
+			
+			if (!complete) {
+				
+				VulkanGraphDestroyImages(graph);
+				return false;
+			}
+		}
+		
+		count = 0;
+		for (u32 i = 0; i < graph->ResourceCount; i++) {
+			
+			VulkanGraphResource* resource = (graph->Resources + i);
+			if (resource->Imported || resource->FirstPass == VulkanGraphInvalid) {
+				
+				continue;
+			}
+			
+			VulkanGraphImage* image = (graph->Images + count++);
+			resource->Image = image->Image;
+			resource->View = image->View;
+			resource->Slot = image->Slot;
+		}
+		
+		// Nothing is known about the contents, but the earlier images sharing the slot, in this or an earlier frame,
+		// have to be done with it before the first use
+		for (u32 i = 0; i < graph->ResourceCount; i++) {
+			
+			VulkanGraphResource* resource = (graph->Resources + i);
+			if (resource->Imported || resource->FirstPass == VulkanGraphInvalid) {
+				
+				continue;
+			}
+			
+			resource->Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			for (u32 j = 0; j < graph->ResourceCount; j++) {
+				
+				VulkanGraphResource* other = (graph->Resources + j);
+				if (!other->Imported && other->FirstPass != VulkanGraphInvalid && other->Slot == resource->Slot) {
+					
+					resource->WriteStages |= other->UsedStages;
+					resource->WriteAccess |= other->UsedWriteAccess;
+				}
+			}
+		}
+		
+		return true;
+	}
+	
+	static bool VulkanGraphPushImageBarrier(VulkanRenderGraph* graph, VulkanGraphBarrier* barrier, VulkanGraphResource* resource, VkAccessFlags sourceAccess, VkAccessFlags destinationAccess, VkImageLayout oldLayout, VkImageLayout newLayout) {
+		
+		if (!VulkanGraphReserve((void**)&graph->ImageBarriers, &graph->ImageBarrierCapacity, graph->ImageBarrierCount + 1, sizeof(VkImageMemoryBarrier))) {
+			
+			return false;
+		}
+		
+		if (barrier->ImageBarrierCount == 0) {
+			
+			barrier->FirstImageBarrier = graph->ImageBarrierCount;
+		}
+		
+		VkImageMemoryBarrier* imageBarrier = (graph->ImageBarriers + graph->ImageBarrierCount++);
+		memset(imageBarrier, 0, sizeof(VkImageMemoryBarrier));
+		imageBarrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier->srcAccessMask = sourceAccess;
+		imageBarrier->dstAccessMask = destinationAccess;
+		imageBarrier->oldLayout = oldLayout;
+		imageBarrier->newLayout = newLayout;
+		imageBarrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier->image = resource->Image;
+		imageBarrier->subresourceRange.aspectMask = resource->Description.Aspect;
+		imageBarrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		imageBarrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+		barrier->ImageBarrierCount++;
+		
+		return true;
+	}
+	
+	// Adds what the access has to wait for to the pass barrier. Writes and layout transitions wait for every earlier
+	// access, reads only for the last write, and only once per stage.
+	static bool VulkanGraphSynchronize(VulkanRenderGraph* graph, VulkanGraphBarrier* barrier, VulkanGraphResource* resource, VkPipelineStageFlags stages, VkAccessFlags readAccess, VkAccessFlags writeAccess, VkImageLayout layout, bool discard) {
+		
+		bool transition = resource->IsImage && resource->Layout != layout;
+		bool write = writeAccess != 0 || transition;
+		
+		VkPipelineStageFlags sourceStages = 0;
+		if (write) {
+			
+			sourceStages = resource->WriteStages | resource->ReadStages;
+		}
+		else if ((stages & ~resource->VisibleStages) != 0) {
+			
+			sourceStages = resource->WriteStages;
+		}
+		
+		VkAccessFlags sourceAccess = sourceStages ? resource->WriteAccess : 0;
+		if (transition) {
+			
+			VkImageLayout oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : resource->Layout;
+			if (!VulkanGraphPushImageBarrier(graph, barrier, resource, sourceAccess, readAccess | writeAccess, oldLayout, layout)) {
+				
+				return false;
+			}
+		}
+		else if (sourceAccess) {
+			
+			barrier->SourceAccess |= sourceAccess;
+			barrier->DestinationAccess |= readAccess | writeAccess;
+		}
+		
+		if (sourceStages || transition) {
+			
+			barrier->SourceStages |= sourceStages;
+			barrier->DestinationStages |= stages;
+		}
+		
+		if (write) {
+			
+			resource->WriteStages = stages;
+			resource->WriteAccess = writeAccess;
+			resource->VisibleStages = stages;
+			resource->ReadStages = readAccess ? stages : 0;
+		}
+		else {
+			
+			resource->VisibleStages |= stages;
+			resource->ReadStages |= stages;
+		}
+		
+		resource->Layout = resource->IsImage ? layout : resource->Layout;
+		return true;
+	}
+	
+	static VkRenderPass VulkanGraphGetRenderPass(VulkanRenderGraph* graph, VulkanGraphRenderPassKey* key) {
+		
+		for (u32 i = 0; i < graph->RenderPassCount; i++) {
+			
+			if (memcmp(&graph->RenderPasses[i].Key, key, sizeof(VulkanGraphRenderPassKey)) == 0) {
+				
+				return graph->RenderPasses[i].RenderPass;
+			}
+		}
+		
+		VkAttachmentReference colorReferences[VulkanGraphMaxAttachments]{};
+		VkAttachmentReference resolveReferences[VulkanGraphMaxAttachments]{};
+		VkAttachmentReference depthReference{};
+		u32 colorCount = 0;
+		u32 resolveCount = 0;
+		bool depth = false;
+		
+		for (u32 i = 0; i < key->AttachmentCount; i++) {
+			
+			VkAttachmentReference reference{};
+			reference.attachment = i;
+			reference.layout = key->Attachments[i].initialLayout;
+			
+			if (key->Usages[i] == VulkanGraphUsageColorAttachment) {
+				
+				colorReferences[colorCount++] = reference;
+			}
+			else if (key->Usages[i] == VulkanGraphUsageResolveAttachment) {
+				
+				resolveReferences[resolveCount++] = reference;
+			}
+			else {
+				
+				depthReference = reference;
+				depth = true;
+			}
+		}
+		
+		// Layouts never change inside the render pass and the graph places all barriers, so it needs no dependencies
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = colorCount;
+		subpass.pColorAttachments = colorReferences;
+		subpass.pResolveAttachments = resolveCount ? resolveReferences : nullptr;
+		subpass.pDepthStencilAttachment = depth ? &depthReference : nullptr;
+		
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = key->AttachmentCount;
+		renderPassInfo.pAttachments = key->Attachments;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		if (!VulkanGraphReserve((void**)&graph->RenderPasses, &graph->RenderPassCapacity, graph->RenderPassCount + 1, sizeof(VulkanGraphRenderPass)) ||
+			vkCreateRenderPass(graph->Device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+			
+			return VK_NULL_HANDLE;
+		}
+		
+		VulkanGraphRenderPass* entry = (graph->RenderPasses + graph->RenderPassCount++);
+		entry->Key = *key;
+		entry->RenderPass = renderPass;
+		
+		return renderPass;
+	}
+	
+	static VkFramebuffer VulkanGraphGetFramebuffer(VulkanRenderGraph* graph, VulkanGraphFramebufferKey* key) {
+		
+		for (u32 i = 0; i < graph->FramebufferCount; i++) {
+			
+			if (memcmp(&graph->Framebuffers[i].Key, key, sizeof(VulkanGraphFramebufferKey)) == 0) {
+				
+				return graph->Framebuffers[i].Framebuffer;
+			}
+		}
+		
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = key->RenderPass;
+		framebufferInfo.attachmentCount = key->ViewCount;
+		framebufferInfo.pAttachments = key->Views;
+		framebufferInfo.width = key->Extent.width;
+		framebufferInfo.height = key->Extent.height;
+		framebufferInfo.layers = 1;
+		
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		if (!VulkanGraphReserve((void**)&graph->Framebuffers, &graph->FramebufferCapacity, graph->FramebufferCount + 1, sizeof(VulkanGraphFramebuffer)) ||
+			vkCreateFramebuffer(graph->Device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+			
+			return VK_NULL_HANDLE;
+		}
+		
+		VulkanGraphFramebuffer* entry = (graph->Framebuffers + graph->FramebufferCount++);
+		entry->Key = *key;
+		entry->Framebuffer = framebuffer;
+		
+		return framebuffer;
+	}
+	
+	// Same attachments as the render pass key would describe, for vkCmdBeginRenderingKHR
+	static void VulkanGraphDescribeRendering(VulkanGraphPass* pass, VulkanGraphRenderPassKey* key, VulkanGraphFramebufferKey* framebufferKey) {
+		
+		pass->ColorAttachmentCount = 0;
+		pass->HasDepth = false;
+		
+		u32 attachment = 0;
+		u32 resolveCount = 0;
+		for (u32 i = 0; i < pass->AccessCount; i++) {
+			
+			VulkanGraphAccess* access = (pass->Accesses + i);
+			if (!VulkanGraphIsAttachment(access->Usage)) {
+				
+				continue;
+			}
+			
+			VkAttachmentDescription* description = (key->Attachments + attachment);
+			VkImageView view = framebufferKey->Views[attachment];
+			attachment++;
+			
+			if (access->Usage == VulkanGraphUsageResolveAttachment) {
+				
+				VkRenderingAttachmentInfoKHR* color = (pass->ColorAttachments + resolveCount++);
+				color->resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT_KHR;
+				color->resolveImageView = view;
+				color->resolveImageLayout = description->initialLayout;
+				continue;
+			}
+			
+			bool depth = access->Usage == VulkanGraphUsageDepthAttachment;
+			VkRenderingAttachmentInfoKHR* info = depth ? &pass->DepthAttachment : (pass->ColorAttachments + pass->ColorAttachmentCount++);
+			memset(info, 0, sizeof(VkRenderingAttachmentInfoKHR));
+			info->sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+			info->imageView = view;
+			info->imageLayout = description->initialLayout;
+			info->resolveMode = VK_RESOLVE_MODE_NONE_KHR;
+			info->loadOp = description->loadOp;
+			info->storeOp = description->storeOp;
+			info->clearValue = access->ClearValue;
+			pass->HasDepth |= depth;
+		}
+	}
+	
+	// Load and store ops follow from the accesses around the pass, attachments are only stored when someone reads them later
+	static bool VulkanGraphCompilePass(VulkanRenderGraph* graph, u32 passIndex) {
+		
+		VulkanGraphPass* pass = (graph->Passes + passIndex);
+		
+		VulkanGraphRenderPassKey renderPassKey;
+		VulkanGraphFramebufferKey framebufferKey;
+		memset(&renderPassKey, 0, sizeof(VulkanGraphRenderPassKey));
+		memset(&framebufferKey, 0, sizeof(VulkanGraphFramebufferKey));
+		
+		u32 colorCount = 0;
+		for (u32 i = 0; i < pass->AccessCount; i++) {
+			
+			VulkanGraphAccess* access = (pass->Accesses + i);
+			VulkanGraphResource* resource = (graph->Resources + access->Resource);
+			const VulkanGraphUsageInfo* usage = (VulkanGraphUsages + access->Usage);
+			bool attachment = VulkanGraphIsAttachment(access->Usage);
+			
+			bool undefined = resource->IsImage && resource->Layout == VK_IMAGE_LAYOUT_UNDEFINED;
+			bool discard = access->Clear || access->Usage == VulkanGraphUsageResolveAttachment;
+			VkAccessFlags readAccess = VulkanGraphReads(access) ? usage->ReadAccess : 0;
+			
+			if (!VulkanGraphSynchronize(graph, &pass->Barrier, resource, VulkanGraphGetStages(pass, access->Usage), readAccess, usage->WriteAccess, usage->Layout, discard)) {
+				
+				return false;
+			}
+			
+			if (!pass->Graphics || !attachment) {
+				
+				continue;
+			}
+			
+			if (renderPassKey.AttachmentCount == VulkanGraphMaxAttachments) {
+				
+				return false;
+			}
+			
+			bool store = VulkanGraphIsKept(resource) || resource->LastPass > passIndex;
+			
+			VkAttachmentDescription* description = (renderPassKey.Attachments + renderPassKey.AttachmentCount);
+			description->format = resource->Description.Format;
+			description->samples = resource->Description.Samples;
+			description->loadOp = access->Clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : ((undefined || discard) ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD);
+			description->storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			description->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			description->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			description->initialLayout = usage->Layout;
+			description->finalLayout = usage->Layout;
+			renderPassKey.Usages[renderPassKey.AttachmentCount++] = access->Usage;
+			
+			if (access->Usage == VulkanGraphUsageColorAttachment) {
+				
+				pass->ColorFormats[colorCount++] = resource->Description.Format;
+				pass->Samples = resource->Description.Samples;
+			}
+			else if (access->Usage == VulkanGraphUsageDepthAttachment) {
+				
+				pass->DepthFormat = resource->Description.Format;
+				pass->Samples = resource->Description.Samples;
+			}
+			
+			framebufferKey.Views[framebufferKey.ViewCount++] = resource->View;
+			framebufferKey.Extent = resource->Description.Extent;
+		}
+		
+		if (pass->Graphics && graph->CmdBeginRendering) {
+			
+			VulkanGraphDescribeRendering(pass, &renderPassKey, &framebufferKey);
+			pass->Extent = framebufferKey.Extent;
+			
+			return true;
+		}
+		
+		if (pass->Graphics) {
+			
+			pass->RenderPass = VulkanGraphGetRenderPass(graph, &renderPassKey);
+			framebufferKey.RenderPass = pass->RenderPass;
+			pass->Framebuffer = pass->RenderPass ? VulkanGraphGetFramebuffer(graph, &framebufferKey) : VK_NULL_HANDLE;
+			pass->Extent = framebufferKey.Extent;
+			
+			return pass->Framebuffer != VK_NULL_HANDLE;
+		}
+		
+		return true;
+	}
+	
+	bool VulkanGraphCompile(VulkanRenderGraph* graph) {
+		
+		if (graph->Failed) {
+			
+			return false;
+		}
+		
+		VulkanGraphCull(graph);
+		
+		if (!VulkanGraphAllocateImages(graph)) {
+			
+			return false;
+		}
+		
+		for (u32 i = 0; i < graph->PassCount; i++) {
+			
+			VulkanGraphPass* pass = (graph->Passes + i);
+			memset(&pass->Barrier, 0, sizeof(VulkanGraphBarrier));
+			
+			if (pass->Live && !VulkanGraphCompilePass(graph, i)) {
+				
+				return false;
+			}
+		}
+		
+		// Imports that are kept end up in the layout the caller asked for
+		for (u32 i = 0; i < graph->ResourceCount; i++) {
+			
+			VulkanGraphResource* resource = (graph->Resources + i);
+			if (!resource->IsImage || !VulkanGraphIsKept(resource) || resource->Layout == resource->FinalLayout) {
+				
+				continue;
+			}
+			
+			if (!VulkanGraphSynchronize(graph, &graph->FinalBarrier, resource, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, resource->FinalLayout, false)) {
+				
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	static void VulkanGraphRecordBarrier(VulkanRenderGraph* graph, VkCommandBuffer commandBuffer, VulkanGraphBarrier* barrier) {
+		
+		if (!barrier->DestinationStages) {
+			
+			return;
+		}
+		
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = barrier->SourceAccess;
+		memoryBarrier.dstAccessMask = barrier->DestinationAccess;
+		
+		VkPipelineStageFlags sourceStages = barrier->SourceStages ? barrier->SourceStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		u32 memoryBarrierCount = barrier->SourceAccess ? 1 : 0;
+		
+		vkCmdPipelineBarrier(commandBuffer, sourceStages, barrier->DestinationStages, 0, memoryBarrierCount, &memoryBarrier, 0, nullptr, barrier->ImageBarrierCount, graph->ImageBarriers + barrier->FirstImageBarrier);
+	}
+	
+	void VulkanGraphExecute(VulkanRenderGraph* graph, VkCommandBuffer commandBuffer) {
+		
+		for (u32 i = 0; i < graph->PassCount; i++) {
+			
+			VulkanGraphPass* pass = (graph->Passes + i);
+			if (!pass->Live) {
+				
+				continue;
+			}
+			
+			VulkanGraphRecordBarrier(graph, commandBuffer, &pass->Barrier);
+			
+			if (!pass->Graphics) {
+				
+				pass->Record(commandBuffer, nullptr, pass->Data);
+				continue;
+			}
+			
+			VkViewport viewport{};
+			viewport.width = (f32)pass->Extent.width;
+			viewport.height = (f32)pass->Extent.height;
+			viewport.maxDepth = 1.0f;
+			
+			VkRect2D scissor{};
+			scissor.extent = pass->Extent;
+			
+			// Secondary command buffers can't see the primary's dynamic state
+			VulkanGraphInheritance inheritance{};
+			VulkanGraphInheritance* secondary = pass->Secondary ? &inheritance : nullptr;
+			inheritance.Info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritance.Viewport = viewport;
+			inheritance.Scissor = scissor;
+			
+			if (graph->CmdBeginRendering) {
+				
+				VkRenderingInfoKHR renderingInfo{};
+				renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+				renderingInfo.flags = pass->Secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR : 0;
+				renderingInfo.renderArea.extent = pass->Extent;
+				renderingInfo.layerCount = 1;
+				renderingInfo.colorAttachmentCount = pass->ColorAttachmentCount;
+				renderingInfo.pColorAttachments = pass->ColorAttachments;
+				renderingInfo.pDepthAttachment = pass->HasDepth ? &pass->DepthAttachment : nullptr;
+				
+				inheritance.Info.pNext = &inheritance.Rendering;
+				inheritance.Rendering.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+				inheritance.Rendering.colorAttachmentCount = pass->ColorAttachmentCount;
+				inheritance.Rendering.pColorAttachmentFormats = pass->ColorFormats;
+				inheritance.Rendering.depthAttachmentFormat = pass->HasDepth ? pass->DepthFormat : VK_FORMAT_UNDEFINED;
+				inheritance.Rendering.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+				inheritance.Rendering.rasterizationSamples = pass->Samples;
+				
+				graph->CmdBeginRendering(commandBuffer, &renderingInfo);
+				if (!pass->Secondary) {
+					
+					vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+					vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				}
+				pass->Record(commandBuffer, secondary, pass->Data);
+				graph->CmdEndRendering(commandBuffer);
+				continue;
+			}
+			
+			VkClearValue clearValues[VulkanGraphMaxAttachments]{};
+			u32 clearValueCount = 0;
+			for (u32 j = 0; j < pass->AccessCount; j++) {
+				
+				VulkanGraphAccess* access = (pass->Accesses + j);
+				if (VulkanGraphIsAttachment(access->Usage)) {
+					
+					clearValues[clearValueCount++] = access->ClearValue;
+				}
+			}
+			
+			VkRenderPassBeginInfo renderPassInfo{};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderPassInfo.renderPass = pass->RenderPass;
+			renderPassInfo.framebuffer = pass->Framebuffer;
+			renderPassInfo.renderArea.extent = pass->Extent;
+			renderPassInfo.clearValueCount = clearValueCount;
+			renderPassInfo.pClearValues = clearValues;
+			
+			inheritance.Info.renderPass = pass->RenderPass;
+			inheritance.Info.subpass = 0;
+			inheritance.Info.framebuffer = pass->Framebuffer;
+			
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass->Secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+			if (!pass->Secondary) {
+				
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+			}
+			pass->Record(commandBuffer, secondary, pass->Data);
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		
+		VulkanGraphRecordBarrier(graph, commandBuffer, &graph->FinalBarrier);
+	}
+	
+	void VulkanGraphRetireFramebuffers(VulkanRenderGraph* graph, u64 frameNumber) {
+		
+		u64 currentFrame = graph->FrameNumber;
+		graph->FrameNumber = frameNumber;
+		
+		for (u32 i = 0; i < graph->FramebufferCount; i++) {
+			
+			VulkanGraphGarbage garbage{};
+			garbage.Framebuffer = graph->Framebuffers[i].Framebuffer;
+			VulkanGraphRetire(graph, &garbage);
+		}
+		graph->FramebufferCount = 0;
+		graph->FrameNumber = currentFrame;
+	}
+	
+	void VulkanGraphCollectGarbage(VulkanRenderGraph* graph, u64 frameNumber, u32 framesInFlight, bool all) {
+		
+		u32 count = 0;
+		for (u32 i = 0; i < graph->GarbageCount; i++) {
+			
+			VulkanGraphGarbage* garbage = (graph->Garbage + i);
+			if (all || frameNumber >= garbage->RetiredFrame + framesInFlight) {
+				
+				vkDestroyFramebuffer(graph->Device, garbage->Framebuffer, nullptr);
+				vkDestroyImageView(graph->Device, garbage->View, nullptr);
+				vkDestroyImage(graph->Device, garbage->Image, nullptr);
+				VulkanFree(graph->Allocator, &garbage->Allocation);
+			}
+			else {
+				
+				graph->Garbage[count++] = *garbage;
+			}
+		}
+		graph->GarbageCount = count;
+	}
+}
@@ -0,0 +1,266 @@
+#ifndef HANDMADE_VULKAN_GRAPH_H
+#define HANDMADE_VULKAN_GRAPH_H
+
+#include "handmade_types.h"
+#include "handmade_platform.h"
+#include "handmade_vulkan_allocator.h"
+
+#pragma warning(disable : 26812)
+#include <vulkan/vulkan.h>
+#include <cstdlib>
+#include <cstring>
+
+namespace handmade {
+	
+	// How a pass uses a resource, each usage stands for the stages, access and image layout the graph synchronizes.
+	// Shader usages run in the compute stage of compute passes and in the vertex and fragment stages of graphics passes.
+	static const u32 VulkanGraphUsageColorAttachment = 0;
+	static const u32 VulkanGraphUsageDepthAttachment = 1;
+	static const u32 VulkanGraphUsageResolveAttachment = 2;
+	static const u32 VulkanGraphUsageDepthRead = 3;
+	static const u32 VulkanGraphUsageSampled = 4;
+	static const u32 VulkanGraphUsageShaderRead = 5;
+	static const u32 VulkanGraphUsageShaderWrite = 6;
+	static const u32 VulkanGraphUsageTransferWrite = 7;
+	static const u32 VulkanGraphUsageIndirectRead = 8;
+	static const u32 VulkanGraphUsageVertexRead = 9;
+	
+	static const u32 VulkanGraphMaxAccesses = 8;
+	static const u32 VulkanGraphMaxAttachments = 4;
+	static const u32 VulkanGraphInvalid = 0xffffffff;
+	
+	// What secondary command buffers recorded for a pass need to continue it, see VulkanGraphSetSecondary.
+	// Info is passed to vkBeginCommandBuffer with VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, it chains
+	// Rendering when the pass uses dynamic rendering. Viewport and scissor are not inherited and have to be set again.
+	struct VulkanGraphInheritance {
+		
+		VkCommandBufferInheritanceInfo Info;
+		VkCommandBufferInheritanceRenderingInfoKHR Rendering;
+		VkViewport Viewport;
+		VkRect2D Scissor;
+	};
+	
+	// inheritance is null unless the pass was made secondary, its commands then have to go through vkCmdExecuteCommands
+	typedef void (*VulkanGraphRecordProc)(VkCommandBuffer commandBuffer, VulkanGraphInheritance* inheritance, void* data);
+	
+	struct VulkanGraphImageDescription {
+		
+		VkFormat Format;
+		VkExtent2D Extent;
+		VkSampleCountFlagBits Samples;
+		VkImageAspectFlags Aspect;
+	};
+	
+	// Images and buffers are tracked alike, buffers only ever need memory barriers so the graph doesn't keep their handle
+	struct VulkanGraphResource {
+		
+		VulkanGraphImageDescription Description;
+		VkImage Image;
+		VkImageView View;
+		bool IsImage;
+		
+		// Imported resources belong to the caller, transient images are created by the graph and only live within it.
+		// FinalLayout is VK_IMAGE_LAYOUT_UNDEFINED when nothing after the graph needs the contents.
+		bool Imported;
+		VkImageLayout FinalLayout;
+		
+		// Gathered over the live passes by VulkanGraphCompile
+		VkImageUsageFlags Usage;
+		VkPipelineStageFlags UsedStages;
+		VkAccessFlags UsedWriteAccess;
+		u32 FirstPass;
+		u32 LastPass;
+		u32 Slot;
+		bool Needed;
+		
+		// Where the last write happened and which stages have seen it since, imports start with the state the caller left them in
+		VkImageLayout Layout;
+		VkPipelineStageFlags WriteStages;
+		VkAccessFlags WriteAccess;
+		VkPipelineStageFlags VisibleStages;
+		VkPipelineStageFlags ReadStages;
+	};
+	
+	struct VulkanGraphAccess {
+		
+		u32 Resource;
+		u32 Usage;
+		bool Clear;
+		VkClearValue ClearValue;
+	};
+	
+	// Recorded right before a pass, the image barriers are a range of the graph's ImageBarriers
+	struct VulkanGraphBarrier {
+		
+		VkPipelineStageFlags SourceStages;
+		VkPipelineStageFlags DestinationStages;
+		VkAccessFlags SourceAccess;
+		VkAccessFlags DestinationAccess;
+		u32 FirstImageBarrier;
+		u32 ImageBarrierCount;
+	};
+	
+	struct VulkanGraphPass {
+		
+		VulkanGraphRecordProc Record;
+		void* Data;
+		bool Graphics;
+		bool Secondary;
+		
+		VulkanGraphAccess Accesses[VulkanGraphMaxAccesses];
+		u32 AccessCount;
+		
+		// Filled in by VulkanGraphCompile, passes whose results nobody reads are not live and never recorded
+		bool Live;
+		VulkanGraphBarrier Barrier;
+		VkRenderPass RenderPass;
+		VkFramebuffer Framebuffer;
+		VkExtent2D Extent;
+		
+		// Begun directly with dynamic rendering, a resolve sits on the color attachment it resolves
+		VkRenderingAttachmentInfoKHR ColorAttachments[VulkanGraphMaxAttachments];
+		u32 ColorAttachmentCount;
+		VkRenderingAttachmentInfoKHR DepthAttachment;
+		bool HasDepth;
+		
+		// Inherited by secondary command buffers recorded for the pass
+		VkFormat ColorFormats[VulkanGraphMaxAttachments];
+		VkFormat DepthFormat;
+		VkSampleCountFlagBits Samples;
+	};
+	
+	// Attachments of a graphics pass in the order the pass declared them, compared bytewise
+	struct VulkanGraphRenderPassKey {
+		
+		VkAttachmentDescription Attachments[VulkanGraphMaxAttachments];
+		u32 Usages[VulkanGraphMaxAttachments];
+		u32 AttachmentCount;
+	};
+	
+	struct VulkanGraphRenderPass {
+		
+		VulkanGraphRenderPassKey Key;
+		VkRenderPass RenderPass;
+	};
+	
+	struct VulkanGraphFramebufferKey {
+		
+		VkRenderPass RenderPass;
+		VkImageView Views[VulkanGraphMaxAttachments];
+		u32 ViewCount;
+		VkExtent2D Extent;
+	};
+	
+	struct VulkanGraphFramebuffer {
+		
+		VulkanGraphFramebufferKey Key;
+		VkFramebuffer Framebuffer;
+	};
+	
+	// Transient images are kept across compiles as long as the graph asks for the same ones with the same lifetimes.
+	// Images whose lifetimes don't overlap share the memory of one slot.
+	struct VulkanGraphImage {
+		
+		VulkanGraphImageDescription Description;
+		VkImageUsageFlags Usage;
+		u32 FirstPass;
+		u32 LastPass;
+		
+		VkImage Image;
+		VkImageView View;
+		u32 Slot;
+	};
+	
+	// Destroyed once no frame in flight can still use it
+	struct VulkanGraphGarbage {
+		
+		VkFramebuffer Framebuffer;
+		VkImage Image;
+		VkImageView View;
+		VulkanAllocation Allocation;
+		u64 RetiredFrame;
+	};
+	
+	// Passes declare what they read and write between VulkanGraphBegin and VulkanGraphCompile, the graph then drops
+	// passes nobody depends on, places transient images in shared memory and works out barriers, layout transitions
+	// and render passes. VulkanGraphExecute records the result, the same graph can be executed any number of times.
+	struct VulkanRenderGraph {
+		
+		VkDevice Device;
+		VulkanAllocator* Allocator;
+		// Guards the device's queues, held around waiting for the device. Null when no other thread submits.
+		PlatformMutex* QueueMutex;
+		u64 FrameNumber;
+		bool Failed;
+		
+		// Set when the device has VK_KHR_dynamic_rendering, graphics passes then need no render pass or framebuffer objects
+		PFN_vkCmdBeginRenderingKHR CmdBeginRendering;
+		PFN_vkCmdEndRenderingKHR CmdEndRendering;
+		
+		VulkanGraphResource* Resources;
+		u32 ResourceCount;
+		u32 ResourceCapacity;
+		
+		VulkanGraphPass* Passes;
+		u32 PassCount;
+		u32 PassCapacity;
+		
+		VkImageMemoryBarrier* ImageBarriers;
+		u32 ImageBarrierCount;
+		u32 ImageBarrierCapacity;
+		
+		// Brings imports into their final layout after the last pass
+		VulkanGraphBarrier FinalBarrier;
+		
+		VulkanGraphRenderPass* RenderPasses;
+		u32 RenderPassCount;
+		u32 RenderPassCapacity;
+		
+		VulkanGraphFramebuffer* Framebuffers;
+		u32 FramebufferCount;
+		u32 FramebufferCapacity;
+		
+		VulkanGraphImage* Images;
+		u32 ImageCount;
+		u32 ImageCapacity;
+		VulkanAllocation* Slots;
+		u32 SlotCount;
+		
+		VulkanGraphGarbage* Garbage;
+		u32 GarbageCount;
+		u32 GarbageCapacity;
+		
+		// Bumped whenever the transient images are created again, work recorded before references the old ones
+		u64 Version;
+	};
+	
+	// Without the rendering commands graphics passes fall back to render passes and framebuffers
+	bool VulkanGraphInit(VulkanRenderGraph* graph, VkDevice device, VulkanAllocator* allocator, PlatformMutex* queueMutex, PFN_vkCmdBeginRenderingKHR beginRendering = nullptr, PFN_vkCmdEndRenderingKHR endRendering = nullptr);
+	// The device has to be idle
+	void VulkanGraphDestroy(VulkanRenderGraph* graph);
+	
+	// Starts over with no passes and resources, frameNumber stamps whatever the graph retires from now on
+	void VulkanGraphBegin(VulkanRenderGraph* graph, u64 frameNumber);
+	
+	// stages and access describe the last use before the graph, layout is VK_IMAGE_LAYOUT_UNDEFINED when the contents can be discarded
+	u32 VulkanGraphImportImage(VulkanRenderGraph* graph, VulkanGraphImageDescription* description, VkImage image, VkImageView view, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout finalLayout);
+	u32 VulkanGraphImportBuffer(VulkanRenderGraph* graph, VkPipelineStageFlags stages, VkAccessFlags access);
+	u32 VulkanGraphCreateImage(VulkanRenderGraph* graph, VulkanGraphImageDescription* description);
+	
+	// Graphics passes render to their attachments, with viewport and scissor set to cover them
+	u32 VulkanGraphAddPass(VulkanRenderGraph* graph, bool graphics, VulkanGraphRecordProc record, void* data);
+	// The graphics pass is begun for secondary command buffers, its record proc gets the inheritance to record them with
+	void VulkanGraphSetSecondary(VulkanRenderGraph* graph, u32 pass);
+	// Attachments are bound in the order they are used, resolves follow the color attachments they resolve.
+	// clear is only meaningful for attachments.
+	void VulkanGraphUse(VulkanRenderGraph* graph, u32 pass, u32 resource, u32 usage, VkClearValue* clear = nullptr);
+	
+	bool VulkanGraphCompile(VulkanRenderGraph* graph);
+	void VulkanGraphExecute(VulkanRenderGraph* graph, VkCommandBuffer commandBuffer);
+	
+	// Framebuffers reference image views, they have to go before the views they were built from are destroyed
+	void VulkanGraphRetireFramebuffers(VulkanRenderGraph* graph, u64 frameNumber);
+	void VulkanGraphCollectGarbage(VulkanRenderGraph* graph, u64 frameNumber, u32 framesInFlight, bool all);
+}
+
+#endif // HANDMADE_VULKAN_GRAPH_H
@@ -8,8 +8,10 @@
 #pragma warning(disable : 26812)
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
+#endif
 
 #include <cstdio>
 #include <cassert>